@@ -0,0 +1,96 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "compare.h"
+#include "../config/config.h"
+#include "../system/paths.h"
+#include "../system/threadpool.h"
+
+#define IMAGES_PER_TASK 512
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    // Read the directories of the two sets of annotations (and
+    // where to write their consensus), and whether every image
+    // which doesn't agree should be listed, rather than the first few.
+    vector<string> directories;
+    string consensus;
+    bool list_all = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--all") == 0) {
+            list_all = true;
+        } else if (strcmp(argv[i], "--consensus") == 0 && i + 1 < argc) {
+            consensus = argv[++i];
+        } else if (argv[i][0] != '-') {
+            directories.emplace_back(argv[i]);
+        } else {
+            directories.clear();
+            break;
+        }
+    }
+    if (directories.size() != 2) {
+        cerr << "Usage: " << argv[0] << " FIRST SECOND [--consensus DIRECTORY] [--all]" << endl;
+        return 1;
+    }
+    for (const auto& directory: directories) {
+        if (!path_exists(directory.c_str())) {
+            string msg = "The annotation directory \'" + directory + "\' does not exist";
+            error_exit(msg.c_str());
+        }
+    }
+    auto start = chrono::steady_clock::now();
+
+    // Load the same configuration as the annotator, which
+    // determines the images and the format of the annotation files.
+    UserConfig config;
+    config.load_config();
+    if (!path_exists(config.image_directory.c_str())) {
+        const char* msg = "The provided image directory does not exist";
+        error_exit(msg);
+    }
+    vector<string> image_paths = get_image_paths(config.image_directory.c_str(), config.recurse);
+    AnnotationComparer comparer(config.image_directory, directories[0], directories[1], consensus,
+                                config.mode_order, config.agreement_iou, list_all);
+
+    // Compare the images in chunks on all of the cores, each of which
+    // collects its own statistics (so they don't contend with each other).
+    ThreadPool pool(config.worker_threads);
+    vector<future<AgreementStats>> chunks;
+    for (size_t begin = 0; begin < image_paths.size(); begin += IMAGES_PER_TASK) {
+        size_t end = min(image_paths.size(), begin + IMAGES_PER_TASK);
+        chunks.push_back(pool.submit([&comparer, &image_paths, begin, end]() {
+            return comparer.compare_images(image_paths, begin, end);
+        }));
+    }
+
+    // Merge the statistics in order, so the examples are deterministic.
+    AgreementStats stats = comparer.empty_stats();
+    for (auto& chunk: chunks) {
+        stats.merge(chunk.get());
+    }
+    stats.print(cout);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "\nCompared " << stats.images << " images in " << seconds << " seconds" << endl;
+    return 0;
+}
@@ -0,0 +1,162 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include "assignment.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+/**
+ * Finds the optimal assignment of a (small) matrix of overlaps
+ * with the Hungarian algorithm, in O(n^3) time.
+ */
+static std::vector<int> hungarian(const std::vector<float>& overlaps, size_t rows,
+                                  size_t columns, float threshold) {
+    vector<int> matches(rows, -1);
+
+    // Minimize the negated overlaps over a square matrix, where the pairs
+    // below the threshold (and the padding) cost nothing, so they are only
+    // chosen when nothing better is left (and are then left unmatched).
+    size_t n = max(rows, columns);
+    auto cost = [&](size_t row, size_t column) -> double {
+        if (row >= rows || column >= columns)
+            return 0;
+        float overlap = overlaps[row * columns + column];
+        return (overlap >= threshold) ? -(double)overlap : 0;
+    };
+
+    // The potentials of the rows and columns, the row assigned to each
+    // column (one-based, where 0 is a virtual unassigned row), and the
+    // previous column on the shortest augmenting path to each column.
+    const double infinity = numeric_limits<double>::infinity();
+    vector<double> row_potential(n + 1, 0), column_potential(n + 1, 0);
+    vector<size_t> assigned(n + 1, 0), previous(n + 1, 0);
+    vector<double> slack(n + 1);
+    vector<bool> used(n + 1);
+
+    // Add the rows one at a time, each along a shortest augmenting path.
+    for (size_t row = 1; row <= n; row++) {
+        assigned[0] = row;
+        size_t column = 0;
+        fill(slack.begin(), slack.end(), infinity);
+        fill(used.begin(), used.end(), false);
+        do {
+            used[column] = true;
+            size_t current = assigned[column];
+            double delta = infinity;
+            size_t next = 0;
+            for (size_t j = 1; j <= n; j++) {
+                if (used[j])
+                    continue;
+                double reduced = cost(current - 1, j - 1) - row_potential[current] - column_potential[j];
+                if (reduced < slack[j]) {
+                    slack[j] = reduced;
+                    previous[j] = column;
+                }
+                if (slack[j] < delta) {
+                    delta = slack[j];
+                    next = j;
+                }
+            }
+            for (size_t j = 0; j <= n; j++) {
+                if (used[j]) {
+                    row_potential[assigned[j]] += delta;
+                    column_potential[j] -= delta;
+                } else {
+                    slack[j] -= delta;
+                }
+            }
+            column = next;
+        } while (assigned[column] != 0);
+
+        // Flip the assignments along the path.
+        do {
+            size_t before = previous[column];
+            assigned[column] = assigned[before];
+            column = before;
+        } while (column != 0);
+    }
+
+    // Keep the pairs which are real and overlap enough.
+    for (size_t j = 1; j <= n; j++) {
+        size_t row = assigned[j] - 1, column = j - 1;
+        if (row < rows && column < columns && overlaps[row * columns + column] >= threshold)
+            matches[row] = (int)column;
+    }
+    return matches;
+}
+
+/**
+ * Finds the root of an element in a disjoint set forest.
+ */
+static size_t find_root(std::vector<size_t>& parents, size_t i) {
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+std::vector<int> optimal_assignment(const std::vector<float>& overlaps, size_t rows,
+                                    size_t columns, float threshold) {
+    vector<int> matches(rows, -1);
+    if (rows == 0 || columns == 0)
+        return matches;
+
+    // Group the rows and columns (which are the boxes of the two sets)
+    // into the clusters which overlap enough to be matched, since each
+    // cluster can be assigned separately. Most boxes only overlap one
+    // other box, so this avoids almost all of the O(n^3) work.
+    vector<size_t> parents(rows + columns);
+    for (size_t i = 0; i < parents.size(); i++)
+        parents[i] = i;
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t column = 0; column < columns; column++) {
+            if (overlaps[row * columns + column] >= threshold)
+                parents[find_root(parents, row)] = find_root(parents, rows + column);
+        }
+    }
+    vector<vector<size_t>> cluster_rows(rows + columns), cluster_columns(rows + columns);
+    for (size_t row = 0; row < rows; row++)
+        cluster_rows[find_root(parents, row)].push_back(row);
+    for (size_t column = 0; column < columns; column++)
+        cluster_columns[find_root(parents, rows + column)].push_back(column);
+
+    // Assign each of the clusters, where a single pair is simply matched.
+    vector<float> cluster;
+    for (size_t root = 0; root < rows + columns; root++) {
+        const vector<size_t>& members = cluster_rows[root];
+        const vector<size_t>& candidates = cluster_columns[root];
+        if (members.empty() || candidates.empty())
+            continue;
+        if (members.size() == 1 && candidates.size() == 1) {
+            matches[members[0]] = (int)candidates[0];
+            continue;
+        }
+        cluster.resize(members.size() * candidates.size());
+        for (size_t i = 0; i < members.size(); i++) {
+            for (size_t j = 0; j < candidates.size(); j++)
+                cluster[i * candidates.size() + j] = overlaps[members[i] * columns + candidates[j]];
+        }
+        vector<int> cluster_matches = hungarian(cluster, members.size(), candidates.size(), threshold);
+        for (size_t i = 0; i < members.size(); i++) {
+            if (cluster_matches[i] != -1)
+                matches[members[i]] = (int)candidates[cluster_matches[i]];
+        }
+    }
+    return matches;
+}
@@ -0,0 +1,42 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#ifndef ANNOTATION_ASSIGNMENT_H
+#define ANNOTATION_ASSIGNMENT_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Matches the rows of a matrix of overlaps to its columns, one to one,
+ * so that the total overlap of the matched pairs is as large as possible
+ * (the optimal assignment). The rows and columns are first split into
+ * the clusters which overlap each other, and each cluster is assigned
+ * with the Hungarian algorithm (which is O(n^3) in the size of it).
+ *
+ * Pairs which overlap by less than `threshold` are never matched, so
+ * a row is only left unmatched if it can't be matched to any column
+ * without lowering the total overlap.
+ *
+ * @param overlaps: The overlap of each row with each column, row by row.
+ * @param rows: The number of rows.
+ * @param columns: The number of columns.
+ * @param threshold: The least overlap of a matched pair.
+ * @return The column matched to each row, or -1 if it is unmatched.
+ */
+std::vector<int> optimal_assignment(const std::vector<float>& overlaps, size_t rows,
+                                    size_t columns, float threshold);
+
+#endif //ANNOTATION_ASSIGNMENT_H
@@ -0,0 +1,333 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#include "compare.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+
+#include "assignment.h"
+#include "../merge/merge.h"
+#include "../stats/parser.h"
+#include "../writer/lineformat.h"
+
+using namespace std;
+namespace fs = std::__fs::filesystem;
+
+void AgreementStats::merge(const AgreementStats& other) {
+    this->images += other.images;
+    this->identical_images += other.identical_images;
+    this->missing_first += other.missing_first;
+    this->missing_second += other.missing_second;
+    for (const auto& label: other.labels) {
+        LabelAgreement& agreement = this->labels[label.first];
+        agreement.first += label.second.first;
+        agreement.second += label.second.second;
+        agreement.matched += label.second.matched;
+        agreement.overlap += label.second.overlap;
+        agreement.only_first += label.second.only_first;
+        agreement.only_second += label.second.only_second;
+    }
+    for (const auto& confusion: other.confusions)
+        this->confusions[confusion.first] += confusion.second;
+    this->disagreements += other.disagreements;
+    for (const auto& example: other.examples) {
+        if (!this->keep_all_examples && this->examples.size() >= MAX_DISAGREEMENT_EXAMPLES)
+            break;
+        this->examples.push_back(example);
+    }
+}
+
+/**
+ * Prints one row of the agreement table.
+ */
+static void print_agreement(std::ostream& out, const std::string& name, const LabelAgreement& agreement) {
+    uint64_t total = agreement.first + agreement.second;
+    double f1 = (total == 0) ? 1.0 : 2.0 * (double)agreement.matched / (double)total;
+    double overlap = (agreement.matched == 0) ? 0.0 : agreement.overlap / (double)agreement.matched;
+    out << "  " << setw(24) << left << name << right << setw(10) << agreement.first
+        << setw(10) << agreement.second << setw(10) << agreement.matched
+        << setw(12) << agreement.only_first << setw(12) << agreement.only_second
+        << fixed << setprecision(3) << setw(8) << f1 << setw(10) << overlap << "\n";
+    out.unsetf(ios::floatfield);
+}
+
+void AgreementStats::print(std::ostream& out) const {
+    // Print the overall counts.
+    out << "Images annotated in both: " << this->images << " (" << this->identical_images
+        << " which agree completely)\n"
+        << "Images only annotated in the first: " << this->missing_second << "\n"
+        << "Images only annotated in the second: " << this->missing_first << "\n";
+
+    // Print the agreement for each label, and then over all of them,
+    // where F1 is the share of the boxes which were matched.
+    out << "\nAgreement\n  " << setw(24) << left << "Label" << right << setw(10) << "First"
+        << setw(10) << "Second" << setw(10) << "Matched" << setw(12) << "Only first"
+        << setw(12) << "Only second" << setw(8) << "F1" << setw(10) << "Mean IoU" << "\n";
+    LabelAgreement total;
+    for (const auto& label: this->labels) {
+        print_agreement(out, label.first, label.second);
+        total.first += label.second.first;
+        total.second += label.second.second;
+        total.matched += label.second.matched;
+        total.overlap += label.second.overlap;
+        total.only_first += label.second.only_first;
+        total.only_second += label.second.only_second;
+    }
+    print_agreement(out, "(all)", total);
+
+    // Print the label confusions, the most common first.
+    vector<pair<uint64_t, const pair<string, string>*>> confusions;
+    for (const auto& confusion: this->confusions)
+        confusions.emplace_back(confusion.second, &confusion.first);
+    stable_sort(confusions.begin(), confusions.end(), [](const auto& a, const auto& b) {
+        return a.first > b.first;
+    });
+    out << "\nLabel confusions (first -> second)\n";
+    for (const auto& confusion: confusions) {
+        out << "  " << setw(36) << left << (confusion.second->first + " -> " + confusion.second->second)
+            << right << setw(12) << confusion.first << "\n";
+    }
+
+    // Print the images which don't agree.
+    out << "\nImages which disagree: " << this->disagreements << "\n";
+    for (const auto& example: this->examples) {
+        out << "      " << example << "\n";
+    }
+    if (this->disagreements > this->examples.size()) {
+        out << "      ... and " << (this->disagreements - this->examples.size()) << " more\n";
+    }
+}
+
+AnnotationComparer::AnnotationComparer(const std::string& images, const std::string& first,
+                                       const std::string& second, const std::string& consensus,
+                                       const std::vector<int>& mode_choice, float min_overlap,
+                                       bool keep_all)
+        : image_directory(images), first_directory(first), second_directory(second),
+          consensus_directory(consensus), mode(mode_choice), threshold(min_overlap),
+          keep_all_examples(keep_all) {
+    // The image paths are relative to the directory without a trailing
+    // separator (which would otherwise be an extra, empty component).
+    while (this->image_directory.size() > 1 && this->image_directory.back() == '/')
+        this->image_directory.pop_back();
+}
+
+std::string AnnotationComparer::annotation_path(const std::string& directory,
+                                                const std::string& image_path) const {
+    // Mirror the sub-directory of the image within the image directory.
+    fs::path image(image_path);
+    fs::path relative = image.parent_path().lexically_relative(this->image_directory);
+    return (fs::path(directory) / relative / (image.stem().string() + ".txt")).lexically_normal().string();
+}
+
+bool AnnotationComparer::read_boxes(const std::string& path, std::vector<Box>& boxes) const {
+    boxes.clear();
+    MappedFile file(path);
+    if (!file.is_open())
+        return false;
+    AnnotationParser parser(file.view(), this->mode);
+    ParsedBox box{};
+    ParseResult result;
+    while ((result = parser.next(box)) != PARSE_END) {
+        if (result != PARSE_BOX)
+            continue;
+        Box parsed{string(box.label), vector<int>(4)};
+        for (int i = 0; i < 4; i++) {
+            parsed.coordinates[i] = (int)lround(box.coordinates[i]);
+        }
+        boxes.push_back(std::move(parsed));
+    }
+    return true;
+}
+
+AgreementStats AnnotationComparer::compare_images(const std::vector<std::string>& image_paths,
+                                                  size_t begin, size_t end) const {
+    AgreementStats stats = this->empty_stats();
+    LineFormatter formatter(this->mode);
+    vector<Box> first, second;
+    vector<tuple<const char*, vector<int>>> consensus;
+    for (size_t i = begin; i < end; i++) {
+        // Only the images which were annotated in both sets are compared.
+        const string& image_path = image_paths[i];
+        bool has_first = this->read_boxes(this->annotation_path(this->first_directory, image_path), first);
+        bool has_second = this->read_boxes(this->annotation_path(this->second_directory, image_path), second);
+        if (!has_first || !has_second) {
+            if (has_first) stats.missing_second++;
+            if (has_second) stats.missing_first++;
+            continue;
+        }
+        stats.images++;
+        consensus.clear();
+        this->compare_boxes(image_path, first, second, stats, consensus);
+
+        // Write the boxes which both sets agree on.
+        if (this->consensus_directory.empty())
+            continue;
+        string path = this->annotation_path(this->consensus_directory, image_path);
+        error_code error;
+        fs::create_directories(fs::path(path).parent_path(), error);
+        string_view contents = formatter.format_boxes(consensus);
+        ofstream out(path, ios::binary | ios::trunc);
+        out.write(contents.data(), (streamsize)contents.size());
+        if (!out) {
+            stats.disagreements++;
+            if (stats.keep_all_examples || stats.examples.size() < MAX_DISAGREEMENT_EXAMPLES)
+                stats.examples.push_back(image_path + ": the consensus could not be written to \'" + path + "\'");
+        }
+    }
+    return stats;
+}
+
+void AnnotationComparer::compare_boxes(const std::string& image_path, const std::vector<Box>& first,
+                                       const std::vector<Box>& second, AgreementStats& stats,
+                                       std::vector<std::tuple<const char*, std::vector<int>>>& consensus) const {
+    // Sort both sets of boxes by their label, and add them to one set
+    // (the first set, then the second), so that the boxes with each label
+    // are contiguous and their overlaps can be computed several at a time.
+    auto by_label = [](const std::vector<Box>& boxes) {
+        vector<size_t> order(boxes.size());
+        iota(order.begin(), order.end(), 0);
+        stable_sort(order.begin(), order.end(), [&boxes](size_t a, size_t b) {
+            return boxes[a].label < boxes[b].label;
+        });
+        return order;
+    };
+    vector<size_t> first_order = by_label(first), second_order = by_label(second);
+    BoxSet boxes;
+    for (size_t index: first_order)
+        boxes.add(first[index].coordinates);
+    for (size_t index: second_order)
+        boxes.add(second[index].coordinates);
+    size_t offset = first.size();
+    for (size_t index: first_order)
+        stats.labels[first[index].label].first++;
+    for (size_t index: second_order)
+        stats.labels[second[index].label].second++;
+
+    // Match the boxes with each label (walking through the labels of
+    // both sets in order), keeping the average of each matched pair.
+    vector<bool> first_matched(first.size(), false), second_matched(second.size(), false);
+    vector<float> overlaps;
+    size_t i = 0, j = 0;
+    while (i < first.size() && j < second.size()) {
+        const string& first_label = first[first_order[i]].label;
+        const string& second_label = second[second_order[j]].label;
+        if (first_label != second_label) {
+            if (first_label < second_label) {
+                i++;
+            } else {
+                j++;
+            }
+            continue;
+        }
+        size_t first_end = i, second_end = j;
+        while (first_end < first.size() && first[first_order[first_end]].label == first_label)
+            first_end++;
+        while (second_end < second.size() && second[second_order[second_end]].label == first_label)
+            second_end++;
+
+        size_t rows = first_end - i, columns = second_end - j;
+        overlaps.resize(rows * columns);
+        for (size_t row = 0; row < rows; row++) {
+            iou_row(boxes, i + row, offset + j, offset + second_end, overlaps.data() + row * columns);
+        }
+        vector<int> matches = optimal_assignment(overlaps, rows, columns, this->threshold);
+        LabelAgreement& agreement = stats.labels[first_label];
+        for (size_t row = 0; row < rows; row++) {
+            if (matches[row] == -1)
+                continue;
+            const Box& a = first[first_order[i + row]];
+            const Box& b = second[second_order[j + matches[row]]];
+            agreement.matched++;
+            agreement.overlap += overlaps[row * columns + matches[row]];
+            first_matched[i + row] = true;
+            second_matched[j + matches[row]] = true;
+            vector<int> average(4);
+            for (int k = 0; k < 4; k++) {
+                average[k] = (int)lround((a.coordinates[k] + b.coordinates[k]) / 2.0);
+            }
+            consensus.emplace_back(a.label.c_str(), std::move(average));
+        }
+        i = first_end;
+        j = second_end;
+    }
+
+    // Match the leftover boxes regardless of their label, where
+    // the pairs which overlap are boxes with confused labels.
+    vector<size_t> first_left, second_left;
+    for (size_t k = 0; k < first.size(); k++) {
+        if (!first_matched[k])
+            first_left.push_back(k);
+    }
+    for (size_t k = 0; k < second.size(); k++) {
+        if (!second_matched[k])
+            second_left.push_back(k);
+    }
+    size_t confused = 0;
+    vector<bool> first_confused(first_left.size(), false), second_confused(second_left.size(), false);
+    if (!first_left.empty() && !second_left.empty()) {
+        vector<float> row(second.size());
+        overlaps.resize(first_left.size() * second_left.size());
+        for (size_t r = 0; r < first_left.size(); r++) {
+            iou_row(boxes, first_left[r], offset, offset + second.size(), row.data());
+            for (size_t c = 0; c < second_left.size(); c++) {
+                overlaps[r * second_left.size() + c] = row[second_left[c]];
+            }
+        }
+        vector<int> matches = optimal_assignment(overlaps, first_left.size(),
+                                                 second_left.size(), this->threshold);
+        for (size_t r = 0; r < first_left.size(); r++) {
+            if (matches[r] == -1)
+                continue;
+            const string& a = first[first_order[first_left[r]]].label;
+            const string& b = second[second_order[second_left[matches[r]]]].label;
+            stats.confusions[make_pair(a, b)]++;
+            first_confused[r] = true;
+            second_confused[matches[r]] = true;
+            confused++;
+        }
+    }
+
+    // The rest of the boxes are only in one of the sets.
+    size_t only_first = 0, only_second = 0;
+    for (size_t r = 0; r < first_left.size(); r++) {
+        if (!first_confused[r]) {
+            stats.labels[first[first_order[first_left[r]]].label].only_first++;
+            only_first++;
+        }
+    }
+    for (size_t c = 0; c < second_left.size(); c++) {
+        if (!second_confused[c]) {
+            stats.labels[second[second_order[second_left[c]]].label].only_second++;
+            only_second++;
+        }
+    }
+
+    // Describe the differences in the image, if there are any.
+    if (confused == 0 && only_first == 0 && only_second == 0) {
+        stats.identical_images++;
+        return;
+    }
+    stats.disagreements++;
+    if (stats.keep_all_examples || stats.examples.size() < MAX_DISAGREEMENT_EXAMPLES) {
+        stats.examples.push_back(image_path + ": " + to_string(only_first) + " only in the first, "
+                                 + to_string(only_second) + " only in the second, "
+                                 + to_string(confused) + " with different labels");
+    }
+}
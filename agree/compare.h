@@ -0,0 +1,190 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+
+#ifndef ANNOTATION_COMPARE_H
+#define ANNOTATION_COMPARE_H
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/* The number of images with disagreements which are described
+ * (unless every one of them is wanted). */
+#define MAX_DISAGREEMENT_EXAMPLES 10
+
+/**
+ * The agreement between the two sets of annotations for one label.
+ */
+struct LabelAgreement {
+    /* The number of boxes with the label in each set. */
+    uint64_t first = 0;
+    uint64_t second = 0;
+
+    /* The number of boxes which were matched to a box with the same
+     * label in the other set, and the total overlap of those pairs. */
+    uint64_t matched = 0;
+    double overlap = 0;
+
+    /* The number of boxes which only one of the sets has (those which
+     * overlap a box with a different label are counted as confusions). */
+    uint64_t only_first = 0;
+    uint64_t only_second = 0;
+};
+
+/**
+ * The agreement between two sets of annotations over (part of) a
+ * dataset, which is collected separately for each chunk of images and
+ * then merged together.
+ */
+struct AgreementStats {
+    /* The number of images which were annotated in both sets,
+     * and in which every box was matched with the same label. */
+    uint64_t images = 0;
+    uint64_t identical_images = 0;
+
+    /* The number of images which are missing from the first set
+     * (only annotated in the second), and from the second set. */
+    uint64_t missing_first = 0;
+    uint64_t missing_second = 0;
+
+    /* The agreement for each label. */
+    std::map<std::string, LabelAgreement> labels;
+
+    /* The number of boxes which overlap a box with a different
+     * label, keyed by the labels in the first and second sets. */
+    std::map<std::pair<std::string, std::string>, uint64_t> confusions;
+
+    /* A description of the differences in the first few images
+     * which don't agree (or all of them), and the number of them. */
+    std::vector<std::string> examples;
+    uint64_t disagreements = 0;
+    bool keep_all_examples = false;
+
+    /**
+     * Adds the statistics of another part of the dataset.
+     */
+    void merge(const AgreementStats& other);
+
+    /**
+     * Prints a report of the agreement.
+     * @param out: The stream to print to.
+     */
+    void print(std::ostream& out) const;
+};
+
+/**
+ * Compares two sets of annotations of the same images (e.g., from two
+ * annotators), which are each in their own directory that mirrors the
+ * sub-directories of the image directory (as the annotations directory
+ * does), and optionally writes the consensus of them to a third one.
+ *
+ * The boxes of each image are matched between the sets for each label,
+ * by the optimal assignment of their overlaps (intersection over union),
+ * and the leftover boxes are then matched regardless of their label to
+ * find the label confusions.
+ */
+class AnnotationComparer {
+private:
+    /* A box read from one of the sets. */
+    struct Box {
+        std::string label;
+        std::vector<int> coordinates;
+    };
+
+    /* The directory of images, and the directories of the two sets of
+     * annotations and of the consensus (which is empty for none). */
+    std::string image_directory;
+    std::string first_directory;
+    std::string second_directory;
+    std::string consensus_directory;
+
+    /* The column order of the coordinates in the files. */
+    std::vector<int> mode;
+
+    /* The least overlap of two boxes which are matched. */
+    float threshold;
+
+    /* Whether to describe every image which doesn't agree. */
+    bool keep_all_examples;
+
+public:
+    /**
+     * Creates a comparer for the annotations of a directory of images.
+     * @param images: The directory of images.
+     * @param first: The directory of the first set of annotations.
+     * @param second: The directory of the second set of annotations.
+     * @param consensus: The directory to write the consensus to, or empty.
+     * @param mode_choice: The column order of the coordinates.
+     * @param min_overlap: The least overlap of two boxes which are matched.
+     * @param keep_all: Whether to describe every image which doesn't agree.
+     */
+    AnnotationComparer(const std::string& images, const std::string& first,
+                       const std::string& second, const std::string& consensus,
+                       const std::vector<int>& mode_choice, float min_overlap, bool keep_all);
+
+    /**
+     * Compares the annotations of a range of images (and writes their
+     * consensus). This only reads the files of these images, so ranges
+     * can be compared on several threads at once.
+     * @param image_paths: All of the image paths.
+     * @param begin: The index of the first image to compare.
+     * @param end: The index after the last image to compare.
+     */
+    AgreementStats compare_images(const std::vector<std::string>& image_paths,
+                                  size_t begin, size_t end) const;
+
+    /**
+     * Creates an empty set of statistics.
+     */
+    AgreementStats empty_stats() const {
+        AgreementStats stats;
+        stats.keep_all_examples = keep_all_examples;
+        return stats;
+    }
+
+private:
+    /**
+     * Gets the path of the annotation file of an image in one of the sets.
+     * @param directory: The directory of the set.
+     * @param image_path: The path to the image.
+     */
+    std::string annotation_path(const std::string& directory, const std::string& image_path) const;
+
+    /**
+     * Reads the boxes of an annotation file.
+     * @param path: The path to the file.
+     * @param boxes: Receives the boxes.
+     * @return Whether the file exists.
+     */
+    bool read_boxes(const std::string& path, std::vector<Box>& boxes) const;
+
+    /**
+     * Matches the boxes of one image between the two sets.
+     * @param image_path: The path to the image (for the examples).
+     * @param first: The boxes in the first set.
+     * @param second: The boxes in the second set.
+     * @param stats: Receives the agreement.
+     * @param consensus: Receives the averages of the matched pairs.
+     */
+    void compare_boxes(const std::string& image_path, const std::vector<Box>& first,
+                       const std::vector<Box>& second, AgreementStats& stats,
+                       std::vector<std::tuple<const char*, std::vector<int>>>& consensus) const;
+};
+
+#endif //ANNOTATION_COMPARE_H
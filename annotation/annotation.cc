@@ -14,7 +14,10 @@
 
 #include "annotation.h"
 
+#include <algorithm>
 #include <filesystem>
+#include <iostream>
+#include <set>
 
 using namespace std;
 namespace fs = std::__fs::filesystem;
@@ -22,7 +25,8 @@ namespace fs = std::__fs::filesystem;
 Annotator::Annotator(
         const char *img_dir, const std::vector<std::string>& label_list,
         bool recurse, const std::vector<int>& mode_choice)
-        : handler("two-click", label_list), writer(mode_choice) {
+        : handler("two-click", label_list), writer(mode_choice),
+          image_cache(DEFAULT_IMAGE_CACHE_BYTES) {
     // Check whether the provided image directory exists.
     if (!fs::exists(fs::path(img_dir))) {
         const char* msg = "The provided image directory does not exist";
@@ -38,7 +42,8 @@ Annotator::Annotator(
 }
 
 Annotator::Annotator(const char *img_dir, const std::vector<std::string>& label_list)
-        : handler("two-click", label_list), writer() {
+        : handler("two-click", label_list), writer(),
+          image_cache(DEFAULT_IMAGE_CACHE_BYTES) {
     // Check whether the provided image directory exists.
     if (!fs::exists(fs::path(img_dir))) {
         const char* msg = "The provided image directory does not exist.";
@@ -49,18 +54,769 @@ Annotator::Annotator(const char *img_dir, const std::vector<std::string>& label_
     this->image_paths = get_image_paths(img_dir, recursive_search);
 }
 
+Annotator::Annotator(const UserConfig& config)
+        : Annotator(config.image_directory.c_str(), config.labels,
+                    config.recurse, config.mode_order) {
+    // Set the memory budget for the recently annotated images.
+    this->image_cache = ImageCache(config.image_cache_bytes);
+
+    // Open any additional windows, which each have their own handler.
+    if (config.windows < 1) {
+        error_exit("The number of windows must be at least one");
+    }
+    for (int i = 2; i <= config.windows; i++) {
+        this->extra_windows.emplace_back(new AnnotationHandler(
+                "two-click", config.labels, string(DEFAULT_WINDOW_NAME) + " " + to_string(i)));
+    }
+
+    // Reorder the images so that they are read in a storage-friendly
+    // order (the diversity order is applied once they are filtered).
+    if (config.image_order != "diversity")
+        order_image_paths(this->image_paths, config.image_order);
+    this->readahead_window = config.readahead_window;
+
+    // Share the decoded images with the other annotation
+    // processes on the host, when a shared budget is set.
+    std::shared_ptr<SharedImageCache> shared_cache;
+    if (config.shared_cache_bytes > 0) {
+        shared_cache = std::make_shared<SharedImageCache>(
+                config.shared_cache_name, config.shared_cache_bytes);
+    }
+
+    // Load the images through the two-stage pipeline, which also
+    // loads the upcoming images while the current one is annotated.
+    this->loader.reset(new ImageLoadPipeline(
+            config.io_threads, config.io_queue_depth,
+            config.decode_threads, config.decode_queue_depth, shared_cache));
+
+    // With several windows, the images are taken from the queue that
+    // many times faster, so as many more are loaded ahead of time.
+    this->prefetch_images = config.prefetch_images * config.windows;
+    for (AnnotationHandler* window: this->get_windows()) {
+        window->set_image_loader([this](const std::string& path) {
+            return this->request_image(path);
+        });
+    }
+
+    // Load the pre-labeling model, if one was provided, with each
+    // of its classes corresponding to one of the labels.
+    if (!config.prelabel_model.empty()) {
+        std::vector<const char*> class_labels;
+        for (const auto& label: config.labels) {
+            class_labels.push_back(this->handler.find_label(label));
+        }
+        this->prelabeler.reset(new PreLabeler(
+                config.prelabel_model, class_labels, config.prelabel_threads,
+                config.prelabel_lookahead, config.prelabel_batch,
+                config.prelabel_input_size, config.prelabel_threshold));
+    }
+
+    // Refine each drawn box on the worker threads, using only the
+    // region around the box, so that the user isn't kept waiting.
+    if (!is_refine_method(config.snap_mode)) {
+        string msg = "Invalid snap mode \'" + config.snap_mode + "\' received.";
+        error_exit(msg.c_str());
+    } else if (config.snap_mode != "none") {
+        string method = config.snap_mode;
+        int padding = config.snap_padding;
+        for (AnnotationHandler* window: this->get_windows()) {
+            window->set_box_refiner([this, method, padding](
+                    const cv::Mat& image, const std::vector<int>& box) {
+                return this->get_workers().submit([image, box, method, padding]() {
+                    return refine_box(image, box, method, padding);
+                }).share();
+            });
+        }
+    }
+
+    // Merge duplicate boxes when the annotations are written.
+    this->writer.set_merge_policy(config.merge_policy, config.merge_threshold);
+
+    // Apply the optional settings to the handlers.
+    for (AnnotationHandler* window: this->get_windows()) {
+        window->set_progressive_threshold(config.progressive_load_bytes);
+        window->set_window_size(cv::Size(config.window_width, config.window_height));
+    }
+    this->overview_size = cv::Size(config.window_width, config.window_height);
+    this->worker_threads = config.worker_threads;
+
+    // Replay a recorded session in place of the user's events,
+    // or otherwise record this session (if either is enabled). The
+    // events don't record which window they were in, so only one is allowed.
+    if (config.windows > 1 && (!config.replay_events.empty() || !config.record_events.empty())) {
+        error_exit("Events can only be recorded or replayed with one window");
+    } else if (!config.replay_events.empty()) {
+        if (config.replay_speed != "recorded" && config.replay_speed != "max") {
+            string msg = "Invalid replay speed \'" + config.replay_speed + "\' received.";
+            error_exit(msg.c_str());
+        }
+        this->replayer = std::make_shared<EventReplayer>(
+                config.replay_events, config.replay_speed == "max");
+        this->handler.set_event_replayer(this->replayer);
+    } else if (!config.record_events.empty()) {
+        this->handler.set_event_recorder(std::make_shared<EventRecorder>(config.record_events));
+    }
+
+    // Store the thumbnails alongside the images by default.
+    this->thumbnail_cache_path = config.thumbnail_cache.empty()
+            ? (fs::path(config.image_directory) / ".annotator-thumbnails").string()
+            : config.thumbnail_cache;
+
+    // Watch the image directory for images which are added or removed
+    // during the session (before any of the images are filtered out).
+    // The new images can't be checked against the duplicates or the
+    // review filter, or ranked by diversity against the images which
+    // were already shown, so those can't be combined with watch mode.
+    if (config.watch_directory) {
+        if (config.dedup_hash != "none" || !config.review_label.empty() ||
+            config.review_max_box_size > 0) {
+            error_exit("Watch mode can't be combined with removing duplicates or reviewing");
+        }
+        if (config.image_order == "diversity") {
+            error_exit("Watch mode can't be combined with the diversity order");
+        }
+        this->watcher.reset(new DirectoryWatcher(config.image_directory, config.recurse));
+        this->watched_order = config.image_order;
+        this->watched_images.insert(this->image_paths.begin(), this->image_paths.end());
+    }
+
+    // Only annotate one image from each cluster of near-duplicates.
+    if (!HashCache::is_method(config.dedup_hash)) {
+        string msg = "Invalid duplicate hash \'" + config.dedup_hash + "\' received.";
+        error_exit(msg.c_str());
+    } else if (config.dedup_hash != "none") {
+        this->remove_duplicates(config.dedup_hash, config.dedup_distance, config.hash_cache.empty()
+                ? (fs::path(config.image_directory) / ".annotator-hashes").string()
+                : config.hash_cache);
+        this->copy_to_duplicates = config.dedup_copy_boxes;
+    }
+
+    // Only review the images with boxes matching the filter.
+    if (!config.review_label.empty() || config.review_max_box_size > 0) {
+        this->filter_for_review(config.review_label, config.review_max_box_size,
+                                config.review_index.empty()
+                                ? (fs::path(config.image_directory) / ".annotator-index").string()
+                                : config.review_index);
+    }
+
+    // Annotate the most diverse images first.
+    if (config.image_order == "diversity") {
+        this->order_by_diversity(config.diversity_count, config.descriptor_cache.empty()
+                ? (fs::path(config.image_directory) / ".annotator-descriptors").string()
+                : config.descriptor_cache);
+    }
+}
+
 void Annotator::start_annotation_session() {
+    // Sessions with several windows take the images from a shared queue.
+    if (!this->extra_windows.empty()) {
+        this->annotate_in_windows();
+        return;
+    }
+
     // Iterate over each of the images in the list of paths.
-    for (const auto& path: image_paths) {
+    int index = 0;
+    bool waiting = false;
+    while (true) {
+        // Pick up any images which were added or removed in watch mode.
+        if (this->watcher)
+            this->apply_watched_changes(index);
+
+        // After the last image, either end the session or (in watch
+        // mode) wait for more images until the user exits.
+        if (index >= (int)this->image_paths.size()) {
+            if (!this->watcher)
+                break;
+            if (!waiting) {
+                cout << "Waiting for new images (press `q` to exit)..." << endl;
+                waiting = true;
+            }
+            if ((cv::waitKey(WATCH_POLL_MS) & 0xFF) == 'q')
+                break;
+            continue;
+        }
+        waiting = false;
+
         // Conduct the bounding box annotation session.
-        int res = this->handler.annotate(path.c_str());
-        if (res == -1) {
+        const std::string& path = this->image_paths[index];
+        this->schedule_upcoming(index);
+        this->memory_stats.begin_image();
+        auto previous_boxes = this->open_image(this->handler, path);
+        int res = this->handler.wait_for_result();
+        if (res == ANNOTATION_EXIT) {
             // An issue was encountered.
             const char* msg = "Encountered an error while annotating";
+            this->print_stats();
             perror(msg); exit(1);
         }
-        // Extract the bounding boxes and pass them to the writer.
-        this->writer.build_annotation_file(
-            path.c_str(), this->handler.get_bounding_boxes());
+        this->finish_image(this->handler, path, previous_boxes, res);
+        this->memory_stats.end_image();
+
+        // Move to the next image to annotate.
+        if (res == ANNOTATION_COMPLETE) {
+            index += 1;
+        } else if (res == ANNOTATION_PREVIOUS) {
+            index = max(0, index - 1);
+        } else if (res == ANNOTATION_OVERVIEW) {
+            int chosen = this->show_overview(index);
+            if (chosen != -1)
+                index = chosen;
+        }
+    }
+
+    // Report how long loading the images took.
+    this->print_stats();
+}
+
+void Annotator::annotate_in_windows() {
+    std::vector<WindowSession> windows;
+    for (AnnotationHandler* window: this->get_windows()) {
+        WindowSession session;
+        session.handler = window;
+        windows.push_back(std::move(session));
+    }
+
+    // The allocations are measured between each image being finished
+    // (in any window), since the windows annotate their images at once.
+    int next_index = 0;
+    bool waiting = false;
+    this->memory_stats.begin_image();
+    while (true) {
+        // Pick up any images which were added or removed in watch mode
+        // (the open images are tracked by their paths, so only the
+        // position of the queue needs to be updated).
+        if (this->watcher)
+            this->apply_watched_changes(next_index);
+
+        // Give each of the windows without an image the next one.
+        bool any_open = false;
+        for (auto& window: windows) {
+            if (window.path.empty())
+                this->open_next_image(window, windows, next_index);
+            any_open = any_open || !window.path.empty();
+        }
+
+        // Once every image is done, either end the session or (in
+        // watch mode) wait for more images until the user exits.
+        if (!any_open) {
+            if (!this->watcher)
+                break;
+            if (!waiting) {
+                cout << "Waiting for new images (press `q` to exit)..." << endl;
+                waiting = true;
+            }
+            if ((cv::waitKey(WATCH_POLL_MS) & 0xFF) == 'q')
+                break;
+            continue;
+        }
+        waiting = false;
+
+        // Display the windows which have changed, and then wait briefly for
+        // a key (once for all of the windows, which also lets them all process
+        // their events). The key goes to the window the pointer was last over.
+        for (auto& window: windows) {
+            if (!window.path.empty())
+                window.handler->show_changes();
+        }
+        int key = cv::waitKey(1);
+        AnnotationHandler* pointer = AnnotationHandler::get_pointer_window();
+        AnnotationHandler* focused = nullptr;
+        for (auto& window: windows) {
+            if (window.path.empty())
+                continue;
+            if (focused == nullptr || window.handler == pointer)
+                focused = window.handler;
+        }
+
+        // Let each of the windows handle its background work (and the key).
+        for (auto& window: windows) {
+            if (window.path.empty())
+                continue;
+            int res = window.handler->handle_key(window.handler == focused ? key : -1);
+            if (res == ANNOTATION_PENDING) {
+                continue;
+            } else if (res == ANNOTATION_EXIT) {
+                // An issue was encountered.
+                const char* msg = "Encountered an error while annotating";
+                this->print_stats();
+                perror(msg); exit(1);
+            }
+            this->finish_image(*window.handler, window.path, window.previous_boxes, res);
+            this->memory_stats.end_image();
+            this->memory_stats.begin_image();
+
+            // Move back to the image which this window finished before,
+            // or to the image chosen from the overview, unless it is open
+            // in another window. The image which is left is returned to later.
+            std::string chosen;
+            if (res == ANNOTATION_PREVIOUS && !window.history.empty()) {
+                chosen = window.history.back();
+                window.history.pop_back();
+            } else if (res == ANNOTATION_OVERVIEW) {
+                // (The image may have been removed in watch mode.)
+                auto current = std::find(this->image_paths.begin(), this->image_paths.end(), window.path);
+                int choice = (current == this->image_paths.end()) ? -1
+                        : this->show_overview((int)(current - this->image_paths.begin()));
+                if (choice != -1)
+                    chosen = this->image_paths[choice];
+            }
+            bool taken = std::any_of(windows.begin(), windows.end(), [&](const WindowSession& other) {
+                return &other != &window && other.path == chosen;
+            });
+            if (res == ANNOTATION_COMPLETE) {
+                window.history.push_back(window.path);
+                window.path.clear();
+            } else if (!chosen.empty() && !taken && chosen != window.path) {
+                window.returning.push_back(window.path);
+                window.path = chosen;
+                window.previous_boxes = this->open_image(*window.handler, window.path);
+            } else {
+                // Otherwise, the image stays open (e.g., moving back
+                // from the first image, as with a single window).
+                window.previous_boxes = this->open_image(*window.handler, window.path);
+            }
+        }
+    }
+
+    // Report how long loading the images took.
+    this->print_stats();
+}
+
+void Annotator::open_next_image(WindowSession& window, const std::vector<WindowSession>& windows,
+                                int& next_index) {
+    auto is_open = [&windows](const std::string& path) {
+        return std::any_of(windows.begin(), windows.end(), [&path](const WindowSession& other) {
+            return other.path == path;
+        });
+    };
+
+    // Return to any image which the window moved back from first.
+    while (!window.returning.empty() && window.path.empty()) {
+        if (!is_open(window.returning.back()))
+            window.path = window.returning.back();
+        window.returning.pop_back();
+    }
+
+    // Otherwise, take the next image from the queue.
+    while (window.path.empty() && next_index < (int)this->image_paths.size()) {
+        const std::string& path = this->image_paths[next_index];
+        if (!is_open(path)) {
+            window.path = path;
+            this->schedule_upcoming(next_index);
+        }
+        next_index += 1;
+    }
+
+    // Close the window if there are no images left for it (in watch
+    // mode, it is kept open, since more images are waited for).
+    if (window.path.empty()) {
+        if (!this->watcher)
+            window.handler->close_window();
+        return;
+    }
+    window.previous_boxes = this->open_image(*window.handler, window.path);
+}
+
+std::vector<std::tuple<const char*, std::vector<int>>>
+Annotator::open_image(AnnotationHandler& window, const std::string& path) {
+    // Get the decoded image and bounding boxes from the cache if
+    // the image was recently annotated, otherwise read any boxes
+    // from an existing annotation file for the image.
+    cv::Mat cached_image;
+    std::vector<std::tuple<const char*, std::vector<int>>> previous_boxes;
+    const ImageCache::Entry* entry = this->image_cache.find(path);
+    if (entry != nullptr) {
+        cached_image = entry->image;
+        previous_boxes = entry->boxes;
+    } else {
+        previous_boxes = this->read_existing_boxes(path);
+    }
+
+    // Images which have never been annotated start with the
+    // boxes proposed by the pre-labeling model (if there is one).
+    std::shared_future<PreLabeler::Proposals> proposals;
+    if (this->prelabeler && entry == nullptr && previous_boxes.empty() &&
+        !this->writer.annotation_exists(path.c_str())) {
+        proposals = this->prelabeler->request(path);
+    }
+
+    window.open_image(path.c_str(), previous_boxes, cached_image, proposals);
+    return previous_boxes;
+}
+
+void Annotator::finish_image(AnnotationHandler& window, const std::string& path,
+                             const std::vector<std::tuple<const char*, std::vector<int>>>& previous_boxes,
+                             int res) {
+    // Keep the decoded image and its boxes in the cache, in
+    // case the user comes back to this image later.
+    auto boxes = window.get_bounding_boxes();
+    this->image_cache.put(path, window.get_image(), boxes);
+
+    // Extract the bounding boxes and pass them to the writer. Only
+    // this image's file is written, and only if the boxes changed
+    // (or it is complete, but has never been written before).
+    if (boxes != previous_boxes ||
+        (res == ANNOTATION_COMPLETE && !this->writer.annotation_exists(path.c_str()))) {
+        this->writer.build_annotation_file(path.c_str(), boxes);
+        if (this->copy_to_duplicates)
+            this->copy_boxes_to_duplicates(path, boxes);
     }
 }
+
+void Annotator::schedule_upcoming(int index) {
+    this->schedule_readahead(index);
+    this->schedule_prefetch(index);
+    if (this->prelabeler)
+        this->prelabeler->schedule(this->image_paths, index);
+}
+
+std::vector<AnnotationHandler*> Annotator::get_windows() {
+    std::vector<AnnotationHandler*> windows {&this->handler};
+    for (auto& window: this->extra_windows) {
+        windows.push_back(window.get());
+    }
+    return windows;
+}
+
+std::shared_future<cv::Mat> Annotator::request_image(const std::string& path) {
+    // Use the image if it was already requested ahead of time.
+    auto prefetched = this->prefetched_images.find(path);
+    if (prefetched != this->prefetched_images.end()) {
+        std::shared_future<cv::Mat> image = prefetched->second;
+        this->prefetched_images.erase(prefetched);
+        return image;
+    }
+
+    // Otherwise, request it from the pipeline (or use a default
+    // background decode if there is no pipeline).
+    if (this->loader)
+        return this->loader->request(path);
+    return std::async(std::launch::async, [path]() { return cv::imread(path); }).share();
+}
+
+void Annotator::schedule_prefetch(int index) {
+    if (!this->loader)
+        return;
+
+    // Drop any prefetched images which are no longer upcoming
+    // (e.g., after jumping to a different image).
+    int last = min((int)this->image_paths.size(), index + 1 + this->prefetch_images);
+    std::set<std::string> upcoming(this->image_paths.begin() + min(index + 1, last),
+                                   this->image_paths.begin() + last);
+    for (auto it = this->prefetched_images.begin(); it != this->prefetched_images.end();) {
+        if (upcoming.count(it->first) == 0) {
+            it = this->prefetched_images.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Request the upcoming images which aren't already decoded in the cache.
+    for (const auto& path: upcoming) {
+        if (this->prefetched_images.count(path) == 0 &&
+            this->image_cache.find(path) == nullptr) {
+            this->prefetched_images[path] = this->loader->request(path);
+        }
+    }
+}
+
+void Annotator::remove_duplicates(const std::string& method, int max_distance,
+                                  const std::string& cache_path) {
+    // Hash each of the images which aren't in the cache on the workers.
+    HashCache cache(cache_path, method);
+    size_t count = this->image_paths.size();
+    std::vector<uint64_t> hashes(count, 0);
+    std::vector<bool> valid(count, false);
+    std::vector<std::pair<size_t, std::future<bool>>> pending;
+    for (size_t i = 0; i < count; i++) {
+        if (cache.get(this->image_paths[i], hashes[i])) {
+            valid[i] = true;
+            continue;
+        }
+        const std::string& path = this->image_paths[i];
+        uint64_t* hash = &hashes[i];
+        pending.emplace_back(i, this->get_workers().submit([&cache, path, method, hash]() {
+            if (!HashCache::compute(path, method, *hash))
+                return false;
+            cache.put(path, *hash);
+            return true;
+        }));
+    }
+    if (!pending.empty())
+        cout << "Hashing " << pending.size() << " images to find near-duplicates..." << endl;
+    for (auto& task: pending) {
+        valid[task.first] = task.second.get();
+    }
+    cache.save();
+
+    // Group the images into clusters, in the order that they are annotated
+    // (so the first image of each cluster is the one which is annotated).
+    std::vector<int> representatives = find_duplicate_clusters(hashes, valid, max_distance);
+    std::vector<std::string> kept;
+    for (size_t i = 0; i < count; i++) {
+        if (representatives[i] == (int)i) {
+            kept.push_back(this->image_paths[i]);
+        } else {
+            this->duplicates[this->image_paths[representatives[i]]].push_back(this->image_paths[i]);
+        }
+    }
+    if (kept.size() < count) {
+        cout << "Skipping " << (count - kept.size()) << " near-duplicate images ("
+             << kept.size() << " of " << count << " images remain)." << endl;
+    }
+    this->image_paths = std::move(kept);
+}
+
+void Annotator::order_by_diversity(size_t count, const std::string& cache_path) {
+    // Compute the descriptor of each of the images which
+    // aren't in the cache on the workers.
+    DescriptorCache cache(cache_path);
+    size_t total = this->image_paths.size();
+    std::vector<uint8_t> descriptors(total * DESCRIPTOR_BYTES, 0);
+    std::vector<bool> valid(total, false);
+    std::vector<std::pair<size_t, std::future<bool>>> pending;
+    for (size_t i = 0; i < total; i++) {
+        uint8_t* descriptor = descriptors.data() + i * DESCRIPTOR_BYTES;
+        if (cache.get(this->image_paths[i], descriptor)) {
+            valid[i] = true;
+            continue;
+        }
+        const std::string& path = this->image_paths[i];
+        pending.emplace_back(i, this->get_workers().submit([&cache, path, descriptor]() {
+            if (!DescriptorCache::compute(path, descriptor))
+                return false;
+            cache.put(path, descriptor);
+            return true;
+        }));
+    }
+    if (!pending.empty())
+        cout << "Computing the descriptors of " << pending.size() << " images to order them..." << endl;
+    for (auto& task: pending) {
+        valid[task.first] = task.second.get();
+    }
+    cache.save();
+
+    // Choose the first images by farthest-point sampling, then reorder the paths.
+    std::vector<size_t> order = diversity_order(descriptors, valid, count, &this->get_workers());
+    std::vector<std::string> ordered;
+    ordered.reserve(total);
+    for (size_t index: order) {
+        ordered.push_back(std::move(this->image_paths[index]));
+    }
+    this->image_paths = std::move(ordered);
+}
+
+void Annotator::filter_for_review(const std::string& label, int max_box_size,
+                                  const std::string& index_path) {
+    // Bring the index up to date, which only reads the annotation
+    // files that have changed since the last session.
+    AnnotationIndex index(index_path, this->writer, this->writer.get_mode());
+    index.update(this->image_paths, this->get_workers());
+
+    // Keep the matching images (in the same order).
+    size_t count = this->image_paths.size();
+    this->image_paths = index.query(label, max_box_size);
+    cout << "Reviewing " << this->image_paths.size() << " of " << count << " images";
+    if (!label.empty())
+        cout << " with a \'" << label << "\' box";
+    if (max_box_size > 0)
+        cout << " with a box smaller than " << max_box_size << " pixels";
+    cout << "." << endl;
+}
+
+void Annotator::copy_boxes_to_duplicates(const std::string& path,
+                                         const std::vector<std::tuple<const char*, std::vector<int>>>& boxes) {
+    auto cluster = this->duplicates.find(path);
+    int width, height;
+    if (cluster == this->duplicates.end() || !read_image_size(path, width, height))
+        return;
+    for (const auto& duplicate: cluster->second) {
+        // Don't overwrite annotations made separately for the duplicate.
+        if (this->copied_duplicates.count(duplicate) == 0 &&
+            this->writer.annotation_exists(duplicate.c_str()))
+            continue;
+
+        // Scale the boxes, in case the duplicate is a resized copy.
+        int duplicate_width, duplicate_height;
+        if (!read_image_size(duplicate, duplicate_width, duplicate_height))
+            continue;
+        double scale_x = duplicate_width / (double)width;
+        double scale_y = duplicate_height / (double)height;
+        auto scaled = boxes;
+        for (auto& bounding_box: scaled) {
+            std::vector<int>& box = std::get<1>(bounding_box);
+            box[0] = (int)lround(box[0] * scale_x); box[2] = (int)lround(box[2] * scale_x);
+            box[1] = (int)lround(box[1] * scale_y); box[3] = (int)lround(box[3] * scale_y);
+        }
+        this->writer.build_annotation_file(duplicate.c_str(), scaled);
+        this->copied_duplicates.insert(duplicate);
+    }
+}
+
+void Annotator::print_stats() {
+    if (this->loader)
+        this->loader->print_stats();
+    if (this->prelabeler)
+        this->prelabeler->print_stats();
+    this->memory_stats.print();
+    printf("Cache:  %zu images, %.1f MB\n", this->image_cache.size(),
+           this->image_cache.size_bytes() / 1e6);
+    if (this->replayer)
+        this->replayer->print_report();
+}
+
+void Annotator::schedule_readahead(int index) {
+    // If the session jumped outside of the files which were
+    // advised, then start a new range from the current image.
+    if (index + 1 < this->readahead_from || index + 1 > this->readahead_until) {
+        this->readahead_from = index + 1;
+        this->readahead_until = index + 1;
+    }
+
+    // Find the files in the window after the current image
+    // which haven't had read advice issued for them yet.
+    int first = max(index + 1, this->readahead_until);
+    int last = min((int)this->image_paths.size(), index + 1 + this->readahead_window);
+    if (this->readahead_window <= 0 || first >= last)
+        return;
+    std::vector<std::string> upcoming(this->image_paths.begin() + first,
+                                      this->image_paths.begin() + last);
+    this->readahead_until = last;
+
+    // Issue the advice in the background, since opening
+    // files can itself be slow on network storage.
+    this->get_workers().submit([upcoming]() {
+        for (const auto& path: upcoming) {
+            advise_willneed(path);
+        }
+    });
+}
+
+std::vector<std::tuple<const char*, std::vector<int>>>
+Annotator::read_existing_boxes(const std::string& path) {
+    // Read the annotation file, if there is one.
+    std::vector<std::tuple<std::string, std::vector<int>>> content;
+    std::vector<std::tuple<const char*, std::vector<int>>> boxes;
+    if (!this->writer.read_annotation_file(path.c_str(), content))
+        return boxes;
+
+    // Match each of the labels to the handler's labels.
+    for (auto& line: content) {
+        const char* label = this->handler.find_label(std::get<0>(line));
+        if (label == nullptr) {
+            std::cerr << "Skipping the unknown label \'" << std::get<0>(line)
+                      << "\' in the annotations for \'" << path << "\'." << std::endl;
+            continue;
+        }
+        boxes.emplace_back(label, std::move(std::get<1>(line)));
+    }
+    return boxes;
+}
+
+void Annotator::apply_watched_changes(int& index) {
+    // Take the changes, or rescan the directory if any were lost.
+    std::vector<std::string> added, removed;
+    if (this->watcher->take_changes(added, removed)) {
+        std::vector<std::string> current = get_image_paths(this->image_directory, this->recursive_search);
+        std::set<std::string> present(current.begin(), current.end());
+        for (const auto& path: this->watched_images) {
+            if (present.count(path) == 0)
+                removed.push_back(path);
+        }
+        added.insert(added.end(), current.begin(), current.end());
+    }
+    if (added.empty() && removed.empty())
+        return;
+
+    // Split the removals into images and whole directories. An image
+    // which was replaced (e.g., renamed over) is still on disk, so it is kept.
+    auto is_file = [](const std::string& path) {
+        std::error_code error;
+        return fs::is_regular_file(fs::path(path), error);
+    };
+    std::set<std::string> removed_images;
+    std::vector<std::string> removed_directories;
+    for (const auto& path: removed) {
+        if (path.back() == '/') {
+            removed_directories.push_back(path);
+        } else if (!is_file(path)) {
+            removed_images.insert(path);
+        }
+    }
+    auto is_removed = [&](const std::string& path) {
+        if (removed_images.count(path) != 0)
+            return true;
+        for (const auto& directory: removed_directories) {
+            if (path.compare(0, directory.size(), directory) == 0)
+                return true;
+        }
+        return false;
+    };
+
+    // Remove the images, moving the current index back by the
+    // number of images removed before it.
+    size_t before = this->image_paths.size();
+    std::vector<std::string> kept;
+    int kept_index = 0;
+    for (int i = 0; i < (int)this->image_paths.size(); i++) {
+        if (is_removed(this->image_paths[i]))
+            continue;
+        if (i < index)
+            kept_index += 1;
+        kept.push_back(std::move(this->image_paths[i]));
+    }
+    for (auto it = this->watched_images.begin(); it != this->watched_images.end();) {
+        if (is_removed(*it)) {
+            it = this->watched_images.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    bool changed = kept.size() != before;
+
+    // Append the new images which still exist, in the same order as
+    // the images the session started with (among each batch of them).
+    std::vector<std::string> new_images;
+    for (const auto& path: added) {
+        if (this->watched_images.count(path) == 0 && is_file(path)) {
+            this->watched_images.insert(path);
+            new_images.push_back(path);
+        }
+    }
+    order_image_paths(new_images, this->watched_order);
+    kept.insert(kept.end(), new_images.begin(), new_images.end());
+    changed = changed || !new_images.empty();
+    if (!changed)
+        return;
+    this->image_paths = std::move(kept);
+    index = kept_index;
+    this->readahead_from = 0;
+    this->readahead_until = 0;
+
+    // The overview grid is sized for the old list of images, so it is
+    // rebuilt (once its thumbnails have finished) the next time it is opened.
+    if (this->overview) {
+        this->get_workers().wait_idle();
+        this->overview.reset();
+    }
+}
+
+int Annotator::show_overview(int current_index) {
+    // Create the thumbnail cache and grid the first time.
+    if (!this->overview) {
+        this->thumbnails.reset(new ThumbnailCache(this->thumbnail_cache_path, 128));
+        this->overview.reset(new OverviewGrid(
+                this->image_paths, *this->thumbnails, this->get_workers(),
+                [this](int i) { return this->writer.annotation_exists(this->image_paths[i].c_str()); },
+                this->overview_size));
+    }
+
+    // Display the grid and return the chosen image.
+    return this->overview->show(current_index);
+}
+
+ThreadPool& Annotator::get_workers() {
+    if (!this->workers)
+        this->workers.reset(new ThreadPool(this->worker_threads));
+    return *this->workers;
+}
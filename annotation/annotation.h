@@ -17,10 +17,37 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <map>
+#include <future>
+#include <set>
 
 #include "../system/paths.h"
+#include "../system/ordering.h"
 #include "../writer/textwriter.h"
 #include "../handler/handler.h"
+#include "../config/config.h"
+#include "../system/threadpool.h"
+#include "../cache/imagecache.h"
+#include "../loader/pipeline.h"
+#include "../prelabel/prelabel.h"
+#include "../refine/refine.h"
+#include "../dedup/hashes.h"
+#include "../dedup/clusters.h"
+#include "../dedup/descriptors.h"
+#include "../system/imageinfo.h"
+#include "../review/index.h"
+#include "../system/watcher.h"
+#include "../system/memstats.h"
+#include "../thumbnails/thumbnails.h"
+#include "../thumbnails/overview.h"
+
+/* The default memory budget for the recently annotated images. */
+#define DEFAULT_IMAGE_CACHE_BYTES (512ULL * 1024 * 1024)
+
+/* How often (in milliseconds) new images are checked
+ * for while waiting for them in watch mode. */
+#define WATCH_POLL_MS 200
 
 /**
  * The primary class that conducts the annotation
@@ -51,9 +78,78 @@ protected:
     /* The AnnotationHandler for the class. */
     AnnotationHandler handler;
 
+    /* The additional annotation windows, which each have their own
+     * handler, but share everything else (e.g., the loading pipeline,
+     * the caches and the writer) with the first one. */
+    std::vector<std::unique_ptr<AnnotationHandler>> extra_windows;
+
     /* The FileWriter for the class. */
     TextFileWriter writer;
 
+    /* The recently annotated images and their bounding boxes,
+     * which allow moving back and forth between images. */
+    ImageCache image_cache;
+
+    /* The number of upcoming images to issue read advice for,
+     * and the range [from, until) it has already been issued for. */
+    int readahead_window = 0;
+    int readahead_from = 0;
+    int readahead_until = 0;
+
+    /* The pipeline which reads and decodes the images. */
+    std::unique_ptr<ImageLoadPipeline> loader;
+
+    /* The upcoming images which have been requested from the
+     * pipeline ahead of time, and how many to request. */
+    std::map<std::string, std::shared_future<cv::Mat>> prefetched_images;
+    int prefetch_images = 0;
+
+    /* The model which proposes boxes for the upcoming images. */
+    std::unique_ptr<PreLabeler> prelabeler;
+
+    /* The near-duplicates of each annotated image, which were
+     * removed from the list of images, whether the boxes drawn on
+     * an image are copied to its duplicates, and the duplicates
+     * which have been copied to during this session. */
+    std::map<std::string, std::vector<std::string>> duplicates;
+    bool copy_to_duplicates = false;
+    std::set<std::string> copied_duplicates;
+
+    /* The number of threads used for background work
+     * (zero uses the number of hardware threads). */
+    unsigned int worker_threads = 0;
+
+    /* The path to the thumbnail cache file, and the
+     * size of the window which the overview is shown in. */
+    std::string thumbnail_cache_path;
+    cv::Size overview_size = cv::Size(1600, 900);
+
+    /* The thumbnails and overview grid, which are
+     * created the first time that the overview is opened. */
+    std::unique_ptr<ThumbnailCache> thumbnails;
+    std::unique_ptr<OverviewGrid> overview;
+
+    /* The watcher which reports images added to (or removed from) the
+     * image directory during the session, and every image which has
+     * been seen (including those filtered out), so none are added twice. */
+    std::unique_ptr<DirectoryWatcher> watcher;
+    std::set<std::string> watched_images;
+
+    /* The storage order which the new images are put in. */
+    std::string watched_order = "none";
+
+    /* The allocations made for each image, and the growth of the
+     * heap over the session, which are reported when it ends. */
+    SessionMemoryStats memory_stats;
+
+    /* The recorded session which is replayed instead of the
+     * user's events, whose latencies are reported at the end. */
+    std::shared_ptr<EventReplayer> replayer;
+
+    /* The pool of background workers. This is declared after
+     * everything its tasks use, so that it is destroyed first. */
+    std::unique_ptr<ThreadPool> workers;
+
 public:
     /**
      * Instantiates the Annotator class with
@@ -75,6 +171,13 @@ public:
      */
     Annotator(const char* img_dir, const std::vector<std::string>& label_list);
 
+    /**
+     * Instantiates the Annotator class with all of
+     * the choices from the user's configuration.
+     * @param config: The loaded user configuration.
+     */
+    explicit Annotator(const UserConfig& config);
+
     /**
      * Conducts the actual annotation session, e.g.
      * displaying each image file, drawing bounding
@@ -83,6 +186,168 @@ public:
      */
     void start_annotation_session();
 
+private:
+    /**
+     * The state of one of the windows, when there are several of them.
+     */
+    struct WindowSession {
+        /* The handler which draws into the window. */
+        AnnotationHandler* handler;
+
+        /* The image which is open in the window (which is empty
+         * when there is none), and its boxes when it was opened. */
+        std::string path;
+        std::vector<std::tuple<const char*, std::vector<int>>> previous_boxes;
+
+        /* The images which were finished in this window (the most
+         * recent last), and the images which were left by moving back
+         * (or to another image), which are returned to before any new ones. */
+        std::vector<std::string> history;
+        std::vector<std::string> returning;
+    };
+
+    /**
+     * Conducts the annotation session with several windows, which
+     * each take the next image from the shared queue when their
+     * current one is complete (all driven from this thread).
+     */
+    void annotate_in_windows();
+
+    /**
+     * Opens the next image in a window: an image it moved back
+     * from, or otherwise the next image in the queue which isn't
+     * open in another window. The window is closed if there is none.
+     * @param window: The window to open the image in.
+     * @param windows: All of the windows.
+     * @param next_index: The index of the next image in the queue.
+     */
+    void open_next_image(WindowSession& window, const std::vector<WindowSession>& windows,
+                         int& next_index);
+
+    /**
+     * Opens an image in a window, with its boxes from the cache (or its
+     * annotation file), or the proposed boxes if it has never been annotated.
+     * @param window: The handler of the window.
+     * @param path: The path to the image.
+     * @return The boxes which the image already had.
+     */
+    std::vector<std::tuple<const char*, std::vector<int>>>
+    open_image(AnnotationHandler& window, const std::string& path);
+
+    /**
+     * Keeps the image which a window is finished with in the cache,
+     * and writes its annotation file (if its boxes changed).
+     * @param window: The handler of the window.
+     * @param path: The path to the image.
+     * @param previous_boxes: The boxes when the image was opened.
+     * @param res: The `AnnotationResult` which the image finished with.
+     */
+    void finish_image(AnnotationHandler& window, const std::string& path,
+                      const std::vector<std::tuple<const char*, std::vector<int>>>& previous_boxes,
+                      int res);
+
+    /**
+     * Starts reading, decoding and pre-labeling the upcoming images.
+     * @param index: The index of the current image.
+     */
+    void schedule_upcoming(int index);
+
+    /**
+     * Returns the handlers of all of the windows.
+     */
+    std::vector<AnnotationHandler*> get_windows();
+
+    /**
+     * Reads the bounding boxes from an image's existing
+     * annotation file, if it has one.
+     * @param path: The path to the image.
+     */
+    std::vector<std::tuple<const char*, std::vector<int>>>
+    read_existing_boxes(const std::string& path);
+
+    /**
+     * Asks the kernel to start reading the upcoming images
+     * into the page cache, in the background.
+     * @param index: The index of the current image.
+     */
+    void schedule_readahead(int index);
+
+    /**
+     * Requests an image from the loading pipeline, or returns it
+     * if it was already requested ahead of time.
+     * @param path: The path to the image.
+     */
+    std::shared_future<cv::Mat> request_image(const std::string& path);
+
+    /**
+     * Requests the upcoming images from the loading pipeline.
+     * @param index: The index of the current image.
+     */
+    void schedule_prefetch(int index);
+
+    /**
+     * Hashes each of the images (or reads their hashes from the cache),
+     * and removes all but one image from each cluster of near-duplicates.
+     * @param method: The perceptual hash method.
+     * @param max_distance: The maximum number of differing bits.
+     * @param cache_path: The path to the hash cache file.
+     */
+    void remove_duplicates(const std::string& method, int max_distance,
+                           const std::string& cache_path);
+
+    /**
+     * Reorders the images so that the first of them cover the dataset
+     * as well as possible, using their (cached) global descriptors.
+     * @param count: The number of images which are chosen by diversity.
+     * @param cache_path: The path to the descriptor cache file.
+     */
+    void order_by_diversity(size_t count, const std::string& cache_path);
+
+    /**
+     * Restricts the images to those with a box matching a filter,
+     * which are found using the (persisted) annotation index.
+     * @param label: The label of the box, or empty for any label.
+     * @param max_box_size: The longest side of the box must be
+     * shorter than this, or zero for boxes of any size.
+     * @param index_path: The path to the annotation index file.
+     */
+    void filter_for_review(const std::string& label, int max_box_size,
+                           const std::string& index_path);
+
+    /**
+     * Copies the boxes of an image to its near-duplicates, scaled to
+     * their dimensions, unless they have their own annotation files.
+     * @param path: The path to the annotated image.
+     * @param boxes: The bounding boxes on the image.
+     */
+    void copy_boxes_to_duplicates(const std::string& path,
+                                  const std::vector<std::tuple<const char*, std::vector<int>>>& boxes);
+
+    /**
+     * Appends the images added to the watched directory, and removes
+     * those which were deleted, keeping the current image in place.
+     * @param index: The index of the current image, which is updated.
+     */
+    void apply_watched_changes(int& index);
+
+    /**
+     * Prints the timing statistics of the loading pipeline and the
+     * pre-labeling model, the memory usage, and the replayed latencies.
+     */
+    void print_stats();
+
+    /**
+     * Displays the overview grid of all of the images.
+     * @param current_index: The index of the current image.
+     * @return The index of the chosen image, or -1.
+     */
+    int show_overview(int current_index);
+
+    /**
+     * Returns the pool of background workers, creating it if necessary.
+     */
+    ThreadPool& get_workers();
+
 };
 
 #endif //ANNOTATION_ANNOTATOR_H
@@ -24,11 +24,7 @@ int main() {
     config.load_config();
 
     // Construct the annotator with the user-provided choices.
-    Annotator annotator = Annotator(
-        config.image_directory.c_str(),
-        config.labels, config.recurse,
-        config.mode_order
-    );
+    Annotator annotator = Annotator(config);
 
     // Start the annotation session.
     annotator.start_annotation_session();
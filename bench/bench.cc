@@ -0,0 +1,296 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../agree/assignment.h"
+#include "../dedup/diversity.h"
+#include "../merge/merge.h"
+#include "../writer/lineformat.h"
+
+#define BENCH_REPEATS 20
+
+using namespace std;
+
+/**
+ * Runs a function several times (after an untimed warm-up
+ * run) and returns the median time in milliseconds.
+ */
+template <typename F>
+static double time_ms(F function) {
+    function();
+    vector<double> times;
+    for (int i = 0; i < BENCH_REPEATS; i++) {
+        auto start = chrono::steady_clock::now();
+        function();
+        times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+/**
+ * Generates a set of boxes where roughly half are jittered
+ * copies of another box (like repeated pre-labels or tracks).
+ */
+static vector<tuple<const char*, vector<int>>> random_boxes(size_t count,
+                                                             const vector<const char*>& labels,
+                                                             mt19937& rng) {
+    uniform_int_distribution<int> position(0, 3800), size(10, 200), jitter(-4, 4);
+    uniform_int_distribution<size_t> label(0, labels.size() - 1);
+    vector<tuple<const char*, vector<int>>> boxes;
+    while (boxes.size() < count) {
+        int x = position(rng), y = position(rng), w = size(rng), h = size(rng);
+        const char* name = labels[label(rng)];
+        boxes.emplace_back(name, vector<int>{x, y, x + w, y + h});
+        if (boxes.size() < count && rng() % 2 == 0) {
+            boxes.emplace_back(name, vector<int>{x + jitter(rng), y + jitter(rng),
+                                                 x + w + jitter(rng), y + h + jitter(rng)});
+        }
+    }
+    return boxes;
+}
+
+/**
+ * Compares the SIMD and scalar intersection over union kernels, and
+ * times the complete merge of a set of boxes with each of the policies.
+ */
+static void bench_merge() {
+    printf("Box merging\n");
+    printf("%8s %14s %14s %8s %12s %12s %12s\n", "boxes", "iou scalar ms", "iou simd ms",
+           "speedup", "suppress ms", "average ms", "union ms");
+    mt19937 rng(7);
+    vector<const char*> labels = {"car", "person", "bike", "sign", "light"};
+    for (size_t count: {100, 1000, 2000, 5000}) {
+        auto boxes = random_boxes(count, labels, rng);
+        BoxSet set;
+        for (const auto& box: boxes) {
+            set.add(std::get<1>(box));
+        }
+
+        // Compute every pair with both kernels, and check that they agree.
+        vector<float> scalar(count), simd(count);
+        float checksum = 0.0f;
+        double scalar_ms = time_ms([&]() {
+            for (size_t i = 0; i < count; i++) {
+                iou_row_scalar(set, i, i + 1, count, scalar.data());
+                checksum += scalar[0];
+            }
+        });
+        double simd_ms = time_ms([&]() {
+            for (size_t i = 0; i < count; i++) {
+                iou_row(set, i, i + 1, count, simd.data());
+                checksum += simd[0];
+            }
+        });
+        for (size_t i = 0; i < count; i++) {
+            iou_row_scalar(set, i, 0, count, scalar.data());
+            iou_row(set, i, 0, count, simd.data());
+            for (size_t j = 0; j < count; j++) {
+                if (fabs(scalar[j] - simd[j]) > 1e-6f) {
+                    fprintf(stderr, "Mismatch at (%zu, %zu): %f != %f\n", i, j, scalar[j], simd[j]);
+                    exit(1);
+                }
+            }
+        }
+
+        // Time the complete merge (on a fresh copy each time, so
+        // the time taken to make the copy is measured separately).
+        vector<vector<tuple<const char*, vector<int>>>> copies(BENCH_REPEATS + 1, boxes);
+        double policy_ms[3];
+        const char* policies[3] = {"suppress", "average", "union"};
+        for (int p = 0; p < 3; p++) {
+            int repeat = 0;
+            for (auto& copy: copies)
+                copy = boxes;
+            policy_ms[p] = time_ms([&]() {
+                merge_boxes(copies[repeat++], policies[p], 0.5f);
+            });
+        }
+        printf("%8zu %14.3f %14.3f %7.2fx %12.3f %12.3f %12.3f\n", count, scalar_ms, simd_ms,
+               scalar_ms / simd_ms, policy_ms[0], policy_ms[1], policy_ms[2]);
+        if (checksum < 0.0f)
+            printf("\n");
+    }
+}
+
+/**
+ * Formats the lines of a file the way the text writer did before the line
+ * formatter, by concatenating strings (this is the baseline it is timed against).
+ */
+static string format_lines_baseline(const vector<tuple<const char*, vector<int>>>& boxes,
+                                    const vector<int>& mode) {
+    vector<string> file_lines;
+    file_lines.reserve(boxes.size());
+    for (auto box: boxes) {
+        vector<int> points = std::get<1>(box);
+        string line = string(std::get<0>(box)) + " ";
+        for (int value: mode) {
+            line += to_string((double)points[value]) + " ";
+        }
+        line += "\n";
+        file_lines.emplace_back(line);
+    }
+    string lines;
+    for (const auto& line: file_lines) {
+        lines += line;
+    }
+    return lines;
+}
+
+/**
+ * Compares the throughput of the line formatter against string
+ * concatenation, checking that they produce the same lines.
+ */
+static void bench_format() {
+    printf("\nAnnotation line formatting (millions of lines per second)\n");
+    printf("%8s %8s %10s %10s %8s\n", "boxes", "order", "baseline", "formatter", "speedup");
+    mt19937 rng(11);
+    vector<const char*> labels = {"car", "person", "bicycle", "traffic_light", "stop_sign"};
+    for (size_t count: {10, 100, 1000}) {
+        auto boxes = random_boxes(count, labels, rng);
+        for (const auto& mode: vector<vector<int>>{{0, 1, 2, 3}, {1, 0, 3, 2}}) {
+            // Check that the formatter agrees with the baseline.
+            LineFormatter formatter(mode);
+            if (formatter.format_boxes(boxes) != format_lines_baseline(boxes, mode)) {
+                fprintf(stderr, "The formatted lines don't match the baseline\n");
+                exit(1);
+            }
+
+            // Time formatting the same file many times over.
+            size_t files = 100000 / count, checksum = 0;
+            double baseline_ms = time_ms([&]() {
+                for (size_t i = 0; i < files; i++)
+                    checksum += format_lines_baseline(boxes, mode).size();
+            });
+            double formatter_ms = time_ms([&]() {
+                for (size_t i = 0; i < files; i++)
+                    checksum += formatter.format_boxes(boxes).size();
+            });
+            double lines = (double)(files * count) / 1000.0;
+            string order = to_string(mode[0]) + to_string(mode[1]) + to_string(mode[2]) + to_string(mode[3]);
+            printf("%8zu %8s %10.2f %10.2f %7.1fx\n", count, order.c_str(),
+                   lines / baseline_ms, lines / formatter_ms, baseline_ms / formatter_ms);
+            if (checksum == 0)
+                printf("\n");
+        }
+    }
+}
+
+/**
+ * Compares the SIMD and scalar descriptor distance kernels, and times
+ * the diversity ordering of a dataset (on one thread, and on all cores).
+ */
+static void bench_diversity() {
+    printf("\nDiversity ordering (%d byte descriptors)\n", DESCRIPTOR_BYTES);
+    printf("%8s %8s %14s %14s %8s %14s %14s\n", "images", "chosen", "scalar ms",
+           "simd ms", "speedup", "order 1T ms", "order pool ms");
+    mt19937 rng(7);
+    ThreadPool workers;
+    for (size_t count: {10000, 100000}) {
+        // Generate clusters of similar descriptors (like runs of video frames).
+        vector<uint8_t> descriptors(count * DESCRIPTOR_BYTES);
+        uniform_int_distribution<int> value(0, 255), jitter(-6, 6);
+        for (size_t i = 0; i < count; i++) {
+            uint8_t* descriptor = descriptors.data() + i * DESCRIPTOR_BYTES;
+            for (size_t j = 0; j < DESCRIPTOR_BYTES; j++) {
+                descriptor[j] = (i % 50 == 0) ? (uint8_t)value(rng)
+                        : (uint8_t)max(0, min(255, descriptor[j - DESCRIPTOR_BYTES] + jitter(rng)));
+            }
+        }
+        vector<bool> valid(count, true);
+
+        // Time the distances from one descriptor to all of the others.
+        vector<uint32_t> scalar(count), simd(count);
+        double scalar_ms = time_ms([&]() {
+            for (size_t i = 0; i < count; i++)
+                scalar[i] = descriptor_distance_scalar(descriptors.data(), descriptors.data() + i * DESCRIPTOR_BYTES);
+        });
+        double simd_ms = time_ms([&]() {
+            for (size_t i = 0; i < count; i++)
+                simd[i] = descriptor_distance(descriptors.data(), descriptors.data() + i * DESCRIPTOR_BYTES);
+        });
+        if (scalar != simd) {
+            fprintf(stderr, "The descriptor distance kernels don't match\n");
+            exit(1);
+        }
+
+        // Time choosing the first images of the ordering.
+        size_t chosen = 200;
+        double single_ms = time_ms([&]() { diversity_order(descriptors, valid, chosen); });
+        double pool_ms = time_ms([&]() { diversity_order(descriptors, valid, chosen, &workers); });
+        printf("%8zu %8zu %14.3f %14.3f %7.2fx %14.2f %14.2f\n", count, chosen, scalar_ms,
+               simd_ms, scalar_ms / simd_ms, single_ms, pool_ms);
+    }
+}
+
+/**
+ * Times matching the boxes of two annotators of an image (jittered
+ * copies of each other, with some missing from each), from computing
+ * their overlaps to the optimal assignment of them.
+ */
+static void bench_assignment() {
+    printf("\nAnnotator agreement (optimal assignment)\n");
+    printf("%8s %14s %14s %14s\n", "boxes", "overlaps us", "assign us", "matched");
+    mt19937 rng(11);
+    uniform_int_distribution<int> jitter(-3, 3);
+    for (size_t count: {8, 32, 128}) {
+        // The second annotator draws most of the first's boxes, slightly
+        // differently, and in a different order, along with a few others.
+        auto first = random_boxes(count, {"car"}, rng);
+        auto second = random_boxes(count / 8, {"car"}, rng);
+        for (const auto& box: first) {
+            if (rng() % 8 == 0)
+                continue;
+            vector<int> moved = get<1>(box);
+            for (int& coordinate: moved)
+                coordinate += jitter(rng);
+            second.emplace_back("car", moved);
+        }
+        shuffle(second.begin(), second.end(), rng);
+        BoxSet boxes;
+        for (const auto& box: first)
+            boxes.add(get<1>(box));
+        for (const auto& box: second)
+            boxes.add(get<1>(box));
+
+        // Time the overlaps of every pair, and then the assignment.
+        size_t rows = first.size(), columns = second.size();
+        vector<float> overlaps(rows * columns);
+        double overlap_ms = time_ms([&]() {
+            for (size_t i = 0; i < rows; i++)
+                iou_row(boxes, i, rows, rows + columns, overlaps.data() + i * columns);
+        });
+        vector<int> matches;
+        double assign_ms = time_ms([&]() { matches = optimal_assignment(overlaps, rows, columns, 0.5f); });
+        size_t matched = count_if(matches.begin(), matches.end(), [](int match) { return match != -1; });
+        printf("%8zu %14.2f %14.2f %14zu\n", count, overlap_ms * 1000, assign_ms * 1000, matched);
+    }
+}
+
+int main() {
+    bench_merge();
+    bench_format();
+    bench_diversity();
+    bench_assignment();
+}
@@ -0,0 +1,71 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "imagecache.h"
+
+using namespace std;
+
+ImageCache::ImageCache(size_t budget) : byte_budget(budget) {}
+
+const ImageCache::Entry* ImageCache::find(const std::string& path) {
+    // Check whether the image is in the cache.
+    auto position = this->positions.find(path);
+    if (position == this->positions.end())
+        return nullptr;
+
+    // Move the entry to the front of the list, since it is now
+    // the most recently used (this doesn't invalidate iterators).
+    this->entries.splice(this->entries.begin(), this->entries, position->second);
+    return &(*position->second);
+}
+
+void ImageCache::put(const std::string& path, const cv::Mat& image,
+                     const std::vector<std::tuple<const char*, std::vector<int>>>& boxes) {
+    // Remove the existing entry for the image, if there is one.
+    auto position = this->positions.find(path);
+    if (position != this->positions.end()) {
+        this->bytes_used -= ImageCache::entry_bytes(*position->second);
+        this->entries.erase(position->second);
+        this->positions.erase(position);
+    }
+
+    // Images which could never fit in the cache only have their boxes
+    // cached, which prevents them from evicting everything else.
+    cv::Mat cached_image = image;
+    if (ImageCache::image_bytes(image) > this->byte_budget)
+        cached_image = cv::Mat();
+
+    // Add the new entry at the front of the list.
+    this->entries.push_front(Entry {path, cached_image, boxes});
+    this->positions[path] = this->entries.begin();
+    this->bytes_used += ImageCache::entry_bytes(this->entries.front());
+
+    // Evict the least recently used entries until the cache fits.
+    while (this->bytes_used > this->byte_budget && this->entries.size() > 1) {
+        Entry& oldest = this->entries.back();
+        this->bytes_used -= ImageCache::entry_bytes(oldest);
+        this->positions.erase(oldest.path);
+        this->entries.pop_back();
+    }
+}
+
+size_t ImageCache::image_bytes(const cv::Mat& image) {
+    return image.empty() ? 0 : image.total() * image.elemSize();
+}
+
+size_t ImageCache::entry_bytes(const Entry& entry) {
+    size_t box_bytes = sizeof(std::tuple<const char*, std::vector<int>>) + 4 * sizeof(int);
+    return ImageCache::image_bytes(entry.image) + sizeof(Entry) + entry.path.size() +
+           entry.boxes.size() * box_bytes;
+}
@@ -0,0 +1,105 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_IMAGECACHE_H
+#define ANNOTATION_IMAGECACHE_H
+
+#include <list>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/**
+ * A least-recently-used cache of decoded images and the
+ * bounding boxes which were drawn on them, so that moving
+ * back to a recently annotated image doesn't require it
+ * to be decoded (or its annotation file parsed) again.
+ *
+ * The cache is limited by the total number of bytes in
+ * the decoded images, rather than the number of images,
+ * since the images in a dataset can vary greatly in size.
+ * The paths and boxes are counted as well, so entries without
+ * an image can't grow the cache without bound either.
+ */
+class ImageCache {
+public:
+    /* A cached image alongside its bounding boxes. */
+    struct Entry {
+        std::string path;
+        cv::Mat image;
+        std::vector<std::tuple<const char*, std::vector<int>>> boxes;
+    };
+
+private:
+    /* The entries, ordered from most to least recently used. */
+    std::list<Entry> entries;
+
+    /* The position of each entry in the list, keyed by path. */
+    std::unordered_map<std::string, std::list<Entry>::iterator> positions;
+
+    /* The maximum and current number of bytes in the entries. */
+    size_t byte_budget;
+    size_t bytes_used = 0;
+
+public:
+    /**
+     * Creates an empty cache.
+     * @param budget: The maximum number of image bytes.
+     */
+    explicit ImageCache(size_t budget);
+
+    /**
+     * Finds an entry, marking it as the most recently used.
+     * @param path: The path to the image.
+     * @return The entry, or a nullptr if it is not cached.
+     */
+    const Entry* find(const std::string& path);
+
+    /**
+     * Adds or replaces an entry, and evicts the least recently
+     * used entries until the cache fits within its budget.
+     * @param path: The path to the image.
+     * @param image: The decoded image (which may be empty,
+     * in which case only the bounding boxes are cached).
+     * @param boxes: The bounding boxes drawn on the image.
+     */
+    void put(const std::string& path, const cv::Mat& image,
+             const std::vector<std::tuple<const char*, std::vector<int>>>& boxes);
+
+    /**
+     * Returns the number of bytes used by the cached entries.
+     */
+    size_t size_bytes() const { return bytes_used; }
+
+    /**
+     * Returns the number of cached entries.
+     */
+    size_t size() const { return entries.size(); }
+
+private:
+    /**
+     * Returns the number of bytes used by an image.
+     */
+    static size_t image_bytes(const cv::Mat& image);
+
+    /**
+     * Returns the number of bytes used by an entry, including its image.
+     */
+    static size_t entry_bytes(const Entry& entry);
+};
+
+#endif //ANNOTATION_IMAGECACHE_H
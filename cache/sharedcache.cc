@@ -0,0 +1,554 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "sharedcache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../system/error.h"
+#include "../system/paths.h"
+
+using namespace std;
+
+/* Identifies a segment which has been initialized with this layout. */
+#define SHARED_CACHE_MAGIC 0x414e4e4f54415445ULL
+#define SHARED_CACHE_VERSION 2
+
+/* How long to wait for another process to initialize the segment. */
+#define SHARED_CACHE_INIT_TIMEOUT_MS 2000
+
+/* The alignment of the paths and images in the segment. */
+#define SHARED_CACHE_ALIGNMENT 64
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+              std::atomic<uint64_t>::is_always_lock_free,
+              "The shared image cache needs lock-free atomics");
+
+/* The states of a slot. Only ready slots can be attached to, and
+ * a slot is only evicted once nothing is attached to it. */
+enum SlotState : uint32_t {
+    SLOT_EMPTY = 0,
+    SLOT_WRITING,
+    SLOT_READY,
+    SLOT_EVICTING
+};
+
+/* The start of the segment. */
+struct SharedCacheHeader {
+    /* Set once the creating process has initialized everything else. */
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+
+    /* The number of slots, and where the slots and the image data
+     * start (and how large the data is, which is the budget). */
+    uint32_t slot_count;
+    uint64_t slots_offset;
+    uint64_t data_offset;
+    uint64_t data_bytes;
+    uint64_t total_bytes;
+
+    /* The lock taken to add or evict images. */
+    pthread_mutex_t lock;
+
+    /* The clock which orders the uses of the images, and the
+     * number of bytes used by all of the images. */
+    std::atomic<uint64_t> clock;
+    std::atomic<uint64_t> bytes_used;
+
+    /* The processes which can attach images, where each entry is a
+     * process id (or zero when it is free), and its index is the bit
+     * of the process in the slots. Entries are taken under the lock. */
+    std::atomic<int32_t> processes[SHARED_CACHE_MAX_PROCESSES];
+};
+
+/* A slot of the table, holding one image. */
+struct SharedCacheSlot {
+    /* The state of the slot, the processes with the image
+     * attached (a bit each), and when it was last used. */
+    std::atomic<uint32_t> state;
+    std::atomic<uint64_t> holders;
+    std::atomic<uint64_t> last_used;
+
+    /* The process which is copying the image in (so the slot can be
+     * reclaimed if it dies), and the key of the image. */
+    pid_t writer;
+    int32_t flags;
+    uint64_t hash;
+    int64_t modified;
+    uint32_t path_length;
+
+    /* The shape of the image. */
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    uint64_t step;
+
+    /* The position of the path (followed by the pixels) in the data. */
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+/* The two mappings of the segment, which are unmapped once
+ * neither the cache nor any attached image uses them. */
+struct SharedCacheMapping {
+    void* writable = MAP_FAILED;
+    void* readable = MAP_FAILED;
+    size_t length = 0;
+
+    /* The entry of this process in the table of processes (or -1 if
+     * it couldn't take one), and how many copies of the image in each
+     * slot are attached in this process, so that its bit is only set
+     * while any of them are. */
+    int process = -1;
+    std::vector<uint32_t> attached;
+    std::mutex mutex;
+
+    /**
+     * Attaches a copy of the image in a slot to this process.
+     * @return Whether the process could attach it.
+     */
+    bool attach(SharedCacheSlot& slot, uint32_t index) {
+        if (this->process == -1)
+            return false;
+        lock_guard<std::mutex> lock(this->mutex);
+        if (this->attached[index]++ == 0)
+            slot.holders.fetch_or(1ULL << this->process);
+        return true;
+    }
+
+    /**
+     * Detaches a copy of the image in a slot from this process.
+     */
+    void detach(SharedCacheSlot& slot, uint32_t index) {
+        lock_guard<std::mutex> lock(this->mutex);
+        if (--this->attached[index] == 0)
+            slot.holders.fetch_and(~(1ULL << this->process));
+    }
+
+    ~SharedCacheMapping() {
+        // Free the entry of this process, which no longer
+        // has any images attached (so no bits are set).
+        if (this->process != -1)
+            static_cast<SharedCacheHeader*>(this->writable)->processes[this->process].store(0);
+        if (this->writable != MAP_FAILED)
+            munmap(this->writable, this->length);
+        if (this->readable != MAP_FAILED)
+            munmap(this->readable, this->length);
+    }
+};
+
+namespace {
+    /* An image attached to a slot. */
+    struct SharedAttachment {
+        std::shared_ptr<SharedCacheMapping> mapping;
+        SharedCacheSlot* slot;
+        uint32_t index;
+    };
+
+    /**
+     * Releases the images attached to the segment, once OpenCV has
+     * released every `cv::Mat` which refers to them (in the same way
+     * that the Python bindings wrap arrays which they don't own).
+     */
+    class SharedFrameAllocator : public cv::MatAllocator {
+    public:
+        cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                               cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+            return cv::Mat::getDefaultAllocator()->allocate(dims, sizes, type, data, step, flags, usage);
+        }
+
+        bool allocate(cv::UMatData* u, cv::AccessFlag flags, cv::UMatUsageFlags usage) const override {
+            return cv::Mat::getDefaultAllocator()->allocate(u, flags, usage);
+        }
+
+        void deallocate(cv::UMatData* u) const override {
+            if (u == nullptr || u->refcount > 0)
+                return;
+            auto* attachment = static_cast<SharedAttachment*>(u->userdata);
+            attachment->mapping->detach(*attachment->slot, attachment->index);
+            delete attachment;
+            delete u;
+        }
+    };
+
+    SharedFrameAllocator frame_allocator;
+
+    /**
+     * Rounds a number of bytes up to the alignment.
+     */
+    size_t align_bytes(size_t bytes) {
+        return (bytes + SHARED_CACHE_ALIGNMENT - 1) / SHARED_CACHE_ALIGNMENT * SHARED_CACHE_ALIGNMENT;
+    }
+
+    /**
+     * Returns the key of an image decoded with certain flags.
+     */
+    uint64_t cache_key(const std::string& path, int flags) {
+        return hash_path(path) ^ ((uint64_t)(uint32_t)flags * 0x9e3779b97f4a7c15ULL);
+    }
+}
+
+SharedImageCache::SharedImageCache(const std::string& name, size_t budget) {
+#ifdef __linux__
+    this->mapping = make_shared<SharedCacheMapping>();
+
+    // Open the segment, creating it if this is the first process to use it.
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+    bool created = (fd != -1);
+    if (!created && errno == EEXIST)
+        fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1) {
+        string msg = "Could not open the shared image cache \'" + name + "\'";
+        error_exit(msg.c_str());
+    }
+
+    // Size the table for the budget, then size the segment (which
+    // is sparse, so the budget is only used as images are added).
+    size_t slot_count = min<size_t>(SHARED_CACHE_MAX_SLOTS,
+                                    max<size_t>(SHARED_CACHE_MIN_SLOTS, budget / SHARED_CACHE_SLOT_BYTES));
+    size_t slots_offset = align_bytes(sizeof(SharedCacheHeader));
+    size_t data_offset = align_bytes(slots_offset + slot_count * sizeof(SharedCacheSlot));
+    if (created && ftruncate(fd, (off_t)(data_offset + budget)) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        string msg = "Could not allocate the shared image cache \'" + name + "\'";
+        error_exit(msg.c_str());
+    }
+
+    // Otherwise, wait for the process which created it to size it.
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(SHARED_CACHE_INIT_TIMEOUT_MS);
+    struct stat buf{};
+    while (fstat(fd, &buf) == 0 && buf.st_size == 0 && chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    this->mapping->length = (size_t)buf.st_size;
+
+    // Map the segment twice, so that attached images are read-only.
+    if (this->mapping->length >= sizeof(SharedCacheHeader)) {
+        this->mapping->writable = mmap(nullptr, this->mapping->length,
+                                       PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        this->mapping->readable = mmap(nullptr, this->mapping->length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (this->mapping->writable == MAP_FAILED || this->mapping->readable == MAP_FAILED) {
+        string msg = "Could not map the shared image cache \'" + name + "\'";
+        error_exit(msg.c_str());
+    }
+    this->header = static_cast<SharedCacheHeader*>(this->mapping->writable);
+
+    if (created) {
+        // Initialize the header and the slots, with a lock which is
+        // released if the process holding it dies.
+        new (this->header) SharedCacheHeader();
+        this->header->version = SHARED_CACHE_VERSION;
+        this->header->slot_count = (uint32_t)slot_count;
+        this->header->slots_offset = slots_offset;
+        this->header->data_offset = data_offset;
+        this->header->data_bytes = budget;
+        this->header->total_bytes = this->mapping->length;
+        auto* first_slot = reinterpret_cast<SharedCacheSlot*>(
+                static_cast<uchar*>(this->mapping->writable) + slots_offset);
+        for (size_t i = 0; i < slot_count; i++) {
+            new (first_slot + i) SharedCacheSlot();
+        }
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&this->header->lock, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        this->header->magic.store(SHARED_CACHE_MAGIC);
+    } else {
+        // Wait for the process which created it to initialize it.
+        while (this->header->magic.load() != SHARED_CACHE_MAGIC && chrono::steady_clock::now() < deadline) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        if (this->header->magic.load() != SHARED_CACHE_MAGIC ||
+            this->header->version != SHARED_CACHE_VERSION ||
+            this->header->total_bytes != this->mapping->length) {
+            string msg = "The shared image cache \'" + name + "\' is incompatible or was never "
+                         "initialized (remove /dev/shm" + name + " to recreate it)";
+            error_exit(msg.c_str());
+        }
+    }
+
+    // Find the table and the image data.
+    auto* base = static_cast<uchar*>(this->mapping->writable);
+    this->slots = reinterpret_cast<SharedCacheSlot*>(base + this->header->slots_offset);
+    this->data = base + this->header->data_offset;
+    this->view = static_cast<const uchar*>(this->mapping->readable) + this->header->data_offset;
+
+    // Take an entry in the table of processes, to attach images with.
+    this->lock();
+    this->register_process();
+    this->unlock();
+#else
+    const char* msg = "The shared image cache is only supported on Linux";
+    error_exit(msg);
+#endif
+}
+
+cv::Mat SharedImageCache::find(const std::string& path, int64_t modified, int flags) {
+    uint64_t hash = cache_key(path, flags);
+    for (uint32_t i = 0; i < SHARED_CACHE_PROBES; i++) {
+        uint32_t index = (uint32_t)((hash + i) % this->header->slot_count);
+        SharedCacheSlot& slot = this->slots[index];
+        if (slot.state.load() != SLOT_READY)
+            continue;
+
+        // Attach to the slot first, so that it can't be evicted, then check
+        // that it is (still) ready and holds this version of the image.
+        if (!this->mapping->attach(slot, index))
+            return cv::Mat();
+        if (slot.state.load() != SLOT_READY || slot.modified != modified ||
+            !this->holds(slot, hash, path, flags)) {
+            this->mapping->detach(slot, index);
+            continue;
+        }
+        slot.last_used.store(this->header->clock.fetch_add(1) + 1);
+
+        // Wrap the pixels in a matrix, whose data is released
+        // (detaching from the slot) along with its last copy.
+        auto* u = new cv::UMatData(&frame_allocator);
+        u->data = u->origdata = const_cast<uchar*>(
+                this->view + slot.offset + align_bytes(slot.path_length));
+        u->size = (size_t)slot.rows * slot.step;
+        u->userdata = new SharedAttachment {this->mapping, &slot, index};
+        cv::Mat image(slot.rows, slot.cols, slot.type, u->data, slot.step);
+        image.u = u;
+        image.addref();
+        return image;
+    }
+    return cv::Mat();
+}
+
+void SharedImageCache::put(const std::string& path, int64_t modified, int flags, const cv::Mat& image) {
+    if (image.empty() || !image.isContinuous())
+        return;
+    size_t path_bytes = align_bytes(path.size());
+    size_t pixel_bytes = image.total() * image.elemSize();
+    size_t bytes = path_bytes + align_bytes(pixel_bytes);
+    uint64_t hash = cache_key(path, flags);
+
+    this->lock();
+
+    // Find an empty slot for the image, skipping it if it is already cached
+    // (or being copied in by another process), and evicting older versions.
+    SharedCacheSlot* target = nullptr;
+    SharedCacheSlot* oldest = nullptr;
+    for (uint32_t i = 0; i < SHARED_CACHE_PROBES; i++) {
+        SharedCacheSlot& slot = this->slots[(hash + i) % this->header->slot_count];
+        uint32_t state = slot.state.load();
+        if (state == SLOT_EMPTY) {
+            target = (target == nullptr) ? &slot : target;
+            continue;
+        }
+        if (this->holds(slot, hash, path, flags)) {
+            if (slot.modified == modified) {
+                this->unlock();
+                return;
+            }
+            if (this->evict(slot) && target == nullptr)
+                target = &slot;
+            continue;
+        }
+        if (state == SLOT_READY && slot.holders.load() == 0 &&
+            (oldest == nullptr || slot.last_used.load() < oldest->last_used.load()))
+            oldest = &slot;
+    }
+
+    // When all of the slots are taken, replace the least recently used
+    // image among them, then find space for the image in the data.
+    if (target == nullptr && oldest != nullptr && this->evict(*oldest))
+        target = oldest;
+    uint64_t offset = 0;
+    if (target == nullptr || !this->allocate(bytes, offset)) {
+        this->unlock();
+        return;
+    }
+
+    // Claim the slot and the space, and copy in the path.
+    target->writer = getpid();
+    target->flags = flags;
+    target->hash = hash;
+    target->modified = modified;
+    target->path_length = (uint32_t)path.size();
+    target->rows = image.rows;
+    target->cols = image.cols;
+    target->type = image.type();
+    target->step = image.cols * image.elemSize();
+    target->offset = offset;
+    target->bytes = bytes;
+    target->last_used.store(this->header->clock.fetch_add(1) + 1);
+    memcpy(this->data + offset, path.data(), path.size());
+    this->header->bytes_used.fetch_add(bytes);
+    target->state.store(SLOT_WRITING);
+    this->unlock();
+
+    // Copy in the pixels without holding the lock, then publish the image.
+    memcpy(this->data + offset + path_bytes, image.data, pixel_bytes);
+    target->state.store(SLOT_READY);
+}
+
+size_t SharedImageCache::size_bytes() const {
+    return this->header->bytes_used.load();
+}
+
+bool SharedImageCache::holds(const SharedCacheSlot& slot, uint64_t hash,
+                             const std::string& path, int flags) const {
+    return slot.hash == hash && slot.flags == flags && slot.path_length == path.size() &&
+           memcmp(this->view + slot.offset, path.data(), path.size()) == 0;
+}
+
+bool SharedImageCache::evict(SharedCacheSlot& slot) {
+    // Mark the slot as being evicted, then back off if an image was
+    // attached in the meantime (a process attaching to it at the same
+    // time either sees the new state, or its attachment is seen here).
+    uint32_t expected = SLOT_READY;
+    if (!slot.state.compare_exchange_strong(expected, SLOT_EVICTING))
+        return false;
+    if (slot.holders.load() != 0) {
+        slot.state.store(SLOT_READY);
+        return false;
+    }
+    this->header->bytes_used.fetch_sub(slot.bytes);
+    slot.state.store(SLOT_EMPTY);
+    return true;
+}
+
+bool SharedImageCache::allocate(size_t bytes, uint64_t& offset) {
+    if (bytes > this->header->data_bytes)
+        return false;
+
+    // Find the slots which hold images, and those which can be evicted
+    // (oldest first), reclaiming any slots whose writer died, and the
+    // attachments of any processes which died.
+    uint64_t dead = this->reclaim_processes();
+    vector<SharedCacheSlot*> occupied;
+    vector<SharedCacheSlot*> evictable;
+    for (uint32_t i = 0; i < this->header->slot_count; i++) {
+        SharedCacheSlot& slot = this->slots[i];
+        uint32_t state = slot.state.load();
+        if (dead != 0)
+            slot.holders.fetch_and(~dead);
+        if (state == SLOT_WRITING && kill(slot.writer, 0) != 0 && errno == ESRCH) {
+            this->header->bytes_used.fetch_sub(slot.bytes);
+            slot.state.store(SLOT_EMPTY);
+            continue;
+        }
+        if (state == SLOT_EMPTY)
+            continue;
+        occupied.push_back(&slot);
+        if (state == SLOT_READY && slot.holders.load() == 0)
+            evictable.push_back(&slot);
+    }
+    sort(evictable.begin(), evictable.end(), [](SharedCacheSlot* a, SharedCacheSlot* b) {
+        return a->last_used.load() < b->last_used.load(); });
+
+    // Evict the least recently used images until the image fits in the budget.
+    size_t next = 0;
+    while (this->header->bytes_used.load() + bytes > this->header->data_bytes && next < evictable.size()) {
+        this->evict(*evictable[next++]);
+    }
+
+    // Then find the first gap which is large enough, evicting
+    // more images while the free space is too fragmented.
+    vector<pair<uint64_t, uint64_t>> ranges;
+    while (true) {
+        ranges.clear();
+        for (SharedCacheSlot* slot: occupied) {
+            if (slot->state.load() != SLOT_EMPTY)
+                ranges.emplace_back(slot->offset, slot->bytes);
+        }
+        sort(ranges.begin(), ranges.end());
+        uint64_t position = 0;
+        for (const auto& range: ranges) {
+            if (range.first >= position + bytes)
+                break;
+            position = max(position, range.first + range.second);
+        }
+        if (position + bytes <= this->header->data_bytes) {
+            offset = position;
+            return true;
+        }
+        if (next == evictable.size())
+            return false;
+        this->evict(*evictable[next++]);
+    }
+}
+
+uint64_t SharedImageCache::reclaim_processes() {
+    uint64_t dead = 0;
+    for (int i = 0; i < SHARED_CACHE_MAX_PROCESSES; i++) {
+        int32_t pid = this->header->processes[i].load();
+        if (pid != 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+            this->header->processes[i].store(0);
+            dead |= 1ULL << i;
+        }
+    }
+    return dead;
+}
+
+void SharedImageCache::register_process() {
+    // Free the entries of the processes which died, then take a free entry.
+    uint64_t dead = this->reclaim_processes();
+    for (int i = 0; i < SHARED_CACHE_MAX_PROCESSES && this->mapping->process == -1; i++) {
+        if (this->header->processes[i].load() == 0) {
+            this->header->processes[i].store((int32_t)getpid());
+            this->mapping->process = i;
+        }
+    }
+    if (this->mapping->process == -1) {
+        cerr << "Every entry of the shared image cache is taken, so images will "
+             << "be added to it but not read from it" << endl;
+        return;
+    }
+    this->mapping->attached.assign(this->header->slot_count, 0);
+
+    // Clear the bits of the entries which were freed (including this
+    // one, if the process which had it died) from all of the slots.
+    dead |= 1ULL << this->mapping->process;
+    for (uint32_t i = 0; i < this->header->slot_count; i++) {
+        this->slots[i].holders.fetch_and(~dead);
+    }
+}
+
+void SharedImageCache::lock() {
+#ifdef __linux__
+    // If the process holding the lock died, then take it over
+    // (it never leaves a slot half-updated while holding it).
+    if (pthread_mutex_lock(&this->header->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&this->header->lock);
+#endif
+}
+
+void SharedImageCache::unlock() {
+    pthread_mutex_unlock(&this->header->lock);
+}
@@ -0,0 +1,168 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_SHAREDCACHE_H
+#define ANNOTATION_SHAREDCACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+/* The number of consecutive slots of the table which an
+ * image can be stored in, starting from the hash of its path. */
+#define SHARED_CACHE_PROBES 16
+
+/* The average size of a decoded image which the table is sized
+ * for, and the minimum and maximum number of slots in the table. */
+#define SHARED_CACHE_SLOT_BYTES (256 * 1024)
+#define SHARED_CACHE_MIN_SLOTS 1024
+#define SHARED_CACHE_MAX_SLOTS 65536
+
+/* The maximum number of processes which can have images
+ * attached at the same time (one bit of a slot each). */
+#define SHARED_CACHE_MAX_PROCESSES 64
+
+/* The layout of the shared memory segment, which is
+ * only used by the implementation. */
+struct SharedCacheHeader;
+struct SharedCacheSlot;
+struct SharedCacheMapping;
+
+/**
+ * A cache of decoded images which is shared by every process on the
+ * host, in a POSIX shared memory segment, so that many annotation
+ * sessions over the same dataset only decode each image once.
+ *
+ * The images are keyed by their path, the modification time of their
+ * file (so a changed file is never served stale), and the flags they
+ * were decoded with. Lookups don't take any lock: each slot
+ * of the table has a state and the set of processes with the image
+ * attached, which are updated atomically, and a found image is attached
+ * as a `cv::Mat` header pointing straight into the segment (through a
+ * read-only mapping) rather than being copied. A slot can't be evicted
+ * while any process still has an image attached to it.
+ *
+ * Each process takes an entry in a table of processes in the segment,
+ * which is its bit in the slots. The entries of processes which died
+ * (with images still attached) are reclaimed along with their bits, in
+ * the same way as the slots of processes which died while adding an
+ * image. Once every entry is taken by a live process, other processes
+ * still add images but decode every image themselves.
+ *
+ * Adding images takes a (process-shared) lock to allocate space in the
+ * segment, evicting the least recently used images until the image fits
+ * within the host-wide budget, but the pixels are copied in after the
+ * lock is released. The budget is set by the process which creates the
+ * segment, and the segment persists (under `/dev/shm`) until the host
+ * restarts or it is removed.
+ *
+ * This is only supported on Linux.
+ */
+class SharedImageCache {
+private:
+    /* The mappings of the segment, which are kept alive by
+     * the images attached to it as well. */
+    std::shared_ptr<SharedCacheMapping> mapping;
+
+    /* The header, the table of slots, and the image data (which
+     * is written through `data`, and attached through `view`). */
+    SharedCacheHeader* header = nullptr;
+    SharedCacheSlot* slots = nullptr;
+    uchar* data = nullptr;
+    const uchar* view = nullptr;
+
+public:
+    /**
+     * Opens the shared segment, creating it if it doesn't exist yet.
+     * @param name: The name of the segment (e.g., `/annotator-images`).
+     * @param budget: The maximum number of bytes of images, if the
+     * segment is created (otherwise, its existing budget is used).
+     */
+    SharedImageCache(const std::string& name, size_t budget);
+
+    SharedImageCache(const SharedImageCache&) = delete;
+    SharedImageCache& operator=(const SharedImageCache&) = delete;
+
+    /**
+     * Finds an image, attaching it without copying its pixels.
+     * @param path: The path to the image.
+     * @param modified: The modification time of the file.
+     * @param flags: The flags the image was decoded with.
+     * @return The image (which must not be written to), or an
+     * empty image if it is not cached.
+     */
+    cv::Mat find(const std::string& path, int64_t modified, int flags);
+
+    /**
+     * Adds an image (if it isn't already cached), evicting the least
+     * recently used images until it fits. Images which can't fit (or
+     * when every other image is attached) are silently not cached.
+     * @param path: The path to the image.
+     * @param modified: The modification time of the file.
+     * @param flags: The flags the image was decoded with.
+     * @param image: The decoded image.
+     */
+    void put(const std::string& path, int64_t modified, int flags, const cv::Mat& image);
+
+    /**
+     * Returns the number of bytes of images cached by all of the processes.
+     */
+    size_t size_bytes() const;
+
+private:
+    /**
+     * Returns whether a slot (which is locked, or has the image
+     * attached) holds a certain image, ignoring its version.
+     */
+    bool holds(const SharedCacheSlot& slot, uint64_t hash,
+               const std::string& path, int flags) const;
+
+    /**
+     * Evicts an image, unless it is attached (the lock must be held).
+     * @return Whether the slot was emptied.
+     */
+    bool evict(SharedCacheSlot& slot);
+
+    /**
+     * Frees the entries of the processes which have died (the lock must
+     * be held), so their images can be evicted and the entries reused.
+     * @return The bits of the entries which were freed.
+     */
+    uint64_t reclaim_processes();
+
+    /**
+     * Takes an entry in the table of processes, so that this
+     * process can attach images (the lock must be held).
+     */
+    void register_process();
+
+    /**
+     * Finds space for an image in the segment, evicting the least
+     * recently used images if necessary (the lock must be held).
+     * @param bytes: The number of bytes to allocate.
+     * @param offset: Receives the offset of the space in the data.
+     * @return Whether the space could be allocated.
+     */
+    bool allocate(size_t bytes, uint64_t& offset);
+
+    /**
+     * Takes and releases the process-shared lock.
+     */
+    void lock();
+    void unlock();
+};
+
+#endif //ANNOTATION_SHAREDCACHE_H
@@ -84,9 +84,126 @@ void UserConfig::load_config() {
             this->mode_order = extracted_labels;
         }
 
+        // Any further lines contain optional `key value` settings.
+        if (curr >= 4) {
+            this->parse_option(line);
+        }
+
         // Increment the iterator.
         curr += 1;
 
     }
 }
 
+void UserConfig::parse_option(const std::string& line) {
+    // Skip empty lines and comments.
+    if (line.empty() || line[0] == '#')
+        return;
+
+    // Split the line into the key and the value.
+    size_t pos = line.find(' ');
+    if (pos == string::npos) {
+        string msg = "Expected a value for the setting \'" + line + "\' in the configuration";
+        error_exit(msg.c_str());
+    }
+    string key = line.substr(0, pos);
+    string value = line.substr(pos + 1);
+
+    // Set the corresponding value in the configuration.
+    if (key == "progressive_load_bytes") {
+        this->progressive_load_bytes = stoull(value);
+    } else if (key == "window_width") {
+        this->window_width = stoi(value);
+    } else if (key == "window_height") {
+        this->window_height = stoi(value);
+    } else if (key == "windows") {
+        this->windows = stoi(value);
+    } else if (key == "image_cache_bytes") {
+        this->image_cache_bytes = stoull(value);
+    } else if (key == "shared_cache_bytes") {
+        this->shared_cache_bytes = stoull(value);
+    } else if (key == "shared_cache_name") {
+        this->shared_cache_name = value;
+    } else if (key == "image_order") {
+        this->image_order = value;
+    } else if (key == "diversity_count") {
+        this->diversity_count = stoull(value);
+    } else if (key == "descriptor_cache") {
+        this->descriptor_cache = value;
+    } else if (key == "readahead_window") {
+        this->readahead_window = stoi(value);
+    } else if (key == "io_threads") {
+        this->io_threads = stoi(value);
+    } else if (key == "io_queue_depth") {
+        this->io_queue_depth = stoi(value);
+    } else if (key == "decode_threads") {
+        this->decode_threads = stoi(value);
+    } else if (key == "decode_queue_depth") {
+        this->decode_queue_depth = stoi(value);
+    } else if (key == "prefetch_images") {
+        this->prefetch_images = stoi(value);
+    } else if (key == "prelabel_model") {
+        this->prelabel_model = value;
+    } else if (key == "prelabel_threshold") {
+        this->prelabel_threshold = stof(value);
+    } else if (key == "prelabel_threads") {
+        this->prelabel_threads = stoi(value);
+    } else if (key == "prelabel_lookahead") {
+        this->prelabel_lookahead = stoi(value);
+    } else if (key == "prelabel_batch") {
+        this->prelabel_batch = stoi(value);
+    } else if (key == "prelabel_input_size") {
+        this->prelabel_input_size = stoi(value);
+    } else if (key == "snap_mode") {
+        this->snap_mode = value;
+    } else if (key == "snap_padding") {
+        this->snap_padding = stoi(value);
+    } else if (key == "merge_policy") {
+        this->merge_policy = value;
+    } else if (key == "merge_threshold") {
+        this->merge_threshold = stof(value);
+    } else if (key == "dedup_hash") {
+        this->dedup_hash = value;
+    } else if (key == "dedup_distance") {
+        this->dedup_distance = stoi(value);
+    } else if (key == "dedup_copy_boxes") {
+        this->dedup_copy_boxes = (value == "true");
+    } else if (key == "hash_cache") {
+        this->hash_cache = value;
+    } else if (key == "review_label") {
+        this->review_label = value;
+    } else if (key == "review_max_box_size") {
+        this->review_max_box_size = stoi(value);
+    } else if (key == "review_index") {
+        this->review_index = value;
+    } else if (key == "watch_directory") {
+        this->watch_directory = (value == "true");
+    } else if (key == "record_events") {
+        this->record_events = value;
+    } else if (key == "replay_events") {
+        this->replay_events = value;
+    } else if (key == "replay_speed") {
+        this->replay_speed = value;
+    } else if (key == "crop_directory") {
+        this->crop_directory = value;
+    } else if (key == "crop_size") {
+        this->crop_size = stoi(value);
+    } else if (key == "crop_context") {
+        this->crop_context = stod(value);
+    } else if (key == "crop_square") {
+        this->crop_square = (value == "true");
+    } else if (key == "crop_format") {
+        this->crop_format = value;
+    } else if (key == "crop_memory_bytes") {
+        this->crop_memory_bytes = stoull(value);
+    } else if (key == "agreement_iou") {
+        this->agreement_iou = stof(value);
+    } else if (key == "worker_threads") {
+        this->worker_threads = stoi(value);
+    } else if (key == "thumbnail_cache") {
+        this->thumbnail_cache = value;
+    } else {
+        string msg = "Unknown setting \'" + key + "\' in the configuration";
+        error_exit(msg.c_str());
+    }
+}
@@ -28,6 +28,147 @@ public:
     /* The mode order for file writing. */
     std::vector<int> mode_order;
 
+    /* Images with a file size of at least this many bytes
+     * are first displayed using a reduced-resolution decode
+     * while the full image is decoded in the background.
+     * Setting this to zero disables progressive loading. */
+    uintmax_t progressive_load_bytes = 8 * 1024 * 1024;
+
+    /* The maximum size of the annotation window, which
+     * larger images are scaled down to fit inside of. */
+    int window_width = 1600;
+    int window_height = 900;
+
+    /* The number of annotation windows, which each show a different
+     * image but share the loading pipeline, caches and writer. */
+    int windows = 1;
+
+    /* The memory budget (in bytes) for the decoded images
+     * which are kept so that the user can move back to them. */
+    size_t image_cache_bytes = 512ULL * 1024 * 1024;
+
+    /* The host-wide memory budget for the decoded images shared
+     * between annotation processes (zero disables sharing), and
+     * the name of the shared memory segment they are kept in. */
+    size_t shared_cache_bytes = 0;
+    std::string shared_cache_name = "/annotator-images";
+
+    /* The order that the images are annotated (and read) in,
+     * one of `none`, `name`, `inode`, `extent`, or `diversity`. */
+    std::string image_order = "none";
+
+    /* When the images are ordered by `diversity`, the number of
+     * images which are chosen for it (the rest follow in their
+     * original order), and the path to the descriptor cache file
+     * (which is stored in the image directory when empty). */
+    size_t diversity_count = 1000;
+    std::string descriptor_cache;
+
+    /* The number of upcoming images which the kernel is asked
+     * to start reading ahead of time (zero disables this). */
+    int readahead_window = 8;
+
+    /* The number of threads reading image files, and the
+     * maximum number of reads waiting for one of them. */
+    int io_threads = 4;
+    int io_queue_depth = 16;
+
+    /* The number of threads decoding images (zero uses the
+     * number of hardware threads), and the maximum number of
+     * read files waiting to be decoded. */
+    int decode_threads = 0;
+    int decode_queue_depth = 4;
+
+    /* The number of upcoming images to load ahead of time. */
+    int prefetch_images = 2;
+
+    /* The path to an ONNX detection model which proposes boxes
+     * for each new image (pre-labeling is disabled when empty),
+     * and the minimum score for a proposal to be kept. */
+    std::string prelabel_model;
+    float prelabel_threshold = 0.5f;
+
+    /* The number of threads running the model, the number of
+     * upcoming images to label, the maximum number of images
+     * in each batch, and the width and height of the input. */
+    int prelabel_threads = 1;
+    int prelabel_lookahead = 4;
+    int prelabel_batch = 1;
+    int prelabel_input_size = 640;
+
+    /* The method used to refine each drawn box (`none`, `edges`,
+     * or `grabcut`), and how far each edge of the box can move. */
+    std::string snap_mode = "none";
+    int snap_padding = 16;
+
+    /* How duplicate boxes are merged before they are written (`none`,
+     * `suppress`, `average`, or `union`), and the overlap (IoU)
+     * above which two boxes with the same label are duplicates. */
+    std::string merge_policy = "none";
+    float merge_threshold = 0.7f;
+
+    /* The perceptual hash used to find near-duplicate images (`none`,
+     * `dhash`, or `phash`), the maximum number of differing bits for
+     * two images to be duplicates, and whether the boxes drawn on the
+     * one image of each cluster which is annotated are copied to the rest. */
+    std::string dedup_hash = "none";
+    int dedup_distance = 6;
+    bool dedup_copy_boxes = false;
+
+    /* The path to the image hash cache file. When this is
+     * empty, it is stored in the image directory instead. */
+    std::string hash_cache;
+
+    /* When either of these are set, only the images with a box
+     * with this label, and/or whose longest side is shorter than
+     * this many pixels, are shown (to review the annotations). */
+    std::string review_label;
+    int review_max_box_size = 0;
+
+    /* The path to the annotation index file, which is used to
+     * find the images to review. When this is empty, it is
+     * stored in the image directory instead. */
+    std::string review_index;
+
+    /* Whether to keep watching the image directory for new (or
+     * removed) images, and wait for more after the last one. */
+    bool watch_directory = false;
+
+    /* The file which the session's mouse and key events are recorded
+     * to, or a recorded session to replay instead of the user's events
+     * (either is disabled when empty), and whether to replay it with
+     * the `recorded` timing or at the `max` speed. */
+    std::string record_events;
+    std::string replay_events;
+    std::string replay_speed = "recorded";
+
+    /* Where `annotator-crops` writes the crop of each box (in a
+     * directory for each label), the width and height of the crops
+     * (zero keeps their original size), the context added around each
+     * box (as a fraction of its size), whether the crops are padded to
+     * squares rather than stretched, and their format. */
+    std::string crop_directory = "crops";
+    int crop_size = 224;
+    double crop_context = 0.0;
+    bool crop_square = true;
+    std::string crop_format = "jpg";
+
+    /* The memory budget for the images which `annotator-crops` is
+     * decoding and cropping at once. */
+    size_t crop_memory_bytes = 1024ULL * 1024 * 1024;
+
+    /* The least overlap (intersection over union) of two boxes which
+     * `annotator-agree` matches between the two sets of annotations. */
+    float agreement_iou = 0.5f;
+
+    /* The number of threads used for background work,
+     * where zero uses the number of hardware threads. */
+    unsigned int worker_threads = 0;
+
+    /* The path to the thumbnail cache file. When this is
+     * empty, it is stored in the image directory instead. */
+    std::string thumbnail_cache;
+
 private:
     /* The path to the configuration file. */
     const char* config_path = "./config.txt";
@@ -42,6 +183,13 @@ public:
      * `config.txt` file (in the top-level).
      */
     void load_config();
+
+private:
+    /**
+     * Parses one of the optional `key value` settings
+     * which follow the first four lines of the file.
+     */
+    void parse_option(const std::string& line);
 };
 
 #endif //ANNOTATOR_CONFIG_H
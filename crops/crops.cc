@@ -0,0 +1,161 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "extract.h"
+#include "../config/config.h"
+#include "../stats/parser.h"
+#include "../system/imageinfo.h"
+#include "../system/paths.h"
+#include "../system/threadpool.h"
+#include "../writer/textwriter.h"
+
+/* How often (in images) the progress is reported. */
+#define CROPS_REPORT_INTERVAL 1000
+
+/* The decoded size assumed for images whose headers can't be read. */
+#define CROPS_UNKNOWN_IMAGE_BYTES (4096 * 4096 * 3)
+
+using namespace std;
+namespace fs = std::__fs::filesystem;
+
+/**
+ * Reads the boxes from the annotation file of an image.
+ */
+static vector<CropBox> read_boxes(const std::string& annotation_path, const std::vector<int>& mode) {
+    vector<CropBox> boxes;
+    MappedFile file(annotation_path);
+    if (!file.is_open())
+        return boxes;
+    AnnotationParser parser(file.view(), mode);
+    ParsedBox box{};
+    ParseResult result;
+    while ((result = parser.next(box)) != PARSE_END) {
+        if (result != PARSE_BOX)
+            continue;
+        CropBox crop{string(box.label), {}};
+        for (int i = 0; i < 4; i++) {
+            crop.coordinates[i] = (int)lround(box.coordinates[i]);
+        }
+        boxes.push_back(crop);
+    }
+    return boxes;
+}
+
+int main() {
+    auto start = chrono::steady_clock::now();
+
+    // Load the same configuration as the annotator, which determines
+    // where the annotation files are and their format, and the crops.
+    UserConfig config;
+    config.load_config();
+    if (!path_exists(config.image_directory.c_str())) {
+        const char* msg = "The provided image directory does not exist";
+        error_exit(msg);
+    }
+    vector<string> image_paths = get_image_paths(config.image_directory.c_str(), config.recurse);
+    TextFileWriter writer(config.mode_order);
+    CropOptions options;
+    options.output_directory = config.crop_directory;
+    options.size = config.crop_size;
+    options.context = config.crop_context;
+    options.square = config.crop_square;
+    options.format = config.crop_format;
+    CropExtractor extractor(options);
+
+    // Read the boxes of each of the images, since the
+    // images without any boxes don't need to be decoded.
+    vector<string> annotated_paths;
+    vector<vector<CropBox>> annotated_boxes;
+    for (const auto& image_path: image_paths) {
+        vector<CropBox> boxes = read_boxes(writer.annotation_path(image_path.c_str()), config.mode_order);
+        if (boxes.empty())
+            continue;
+        annotated_paths.push_back(image_path);
+        annotated_boxes.push_back(std::move(boxes));
+    }
+
+    // Read the dimensions of all of the images from their headers
+    // on all of the cores, before any of the decoding starts.
+    ThreadPool pool(config.worker_threads);
+    vector<ImageSize> sizes = probe_images(annotated_paths, pool);
+
+    // Decode the images on all of the cores, but only start decoding
+    // an image once the (estimated) memory of the images which are
+    // being decoded and cropped fits within the budget.
+    mutex memory_mutex;
+    condition_variable memory_released;
+    size_t in_flight = 0;
+    atomic<size_t> images(0), crops(0), failed(0);
+    for (size_t i = 0; i < annotated_paths.size(); i++) {
+        const string& image_path = annotated_paths[i];
+        const vector<CropBox>& boxes = annotated_boxes[i];
+
+        // Estimate the size of the decoded image from its header.
+        size_t bytes = CROPS_UNKNOWN_IMAGE_BYTES;
+        if (sizes[i].valid)
+            bytes = (size_t)sizes[i].width * sizes[i].height * 3;
+        int factor = extractor.reduction(boxes);
+        bytes /= (size_t)(factor * factor);
+        {
+            unique_lock<mutex> lock(memory_mutex);
+            memory_released.wait(lock, [&]() {
+                return in_flight == 0 || in_flight + bytes <= config.crop_memory_bytes;
+            });
+            in_flight += bytes;
+        }
+
+        // Name the crops after the path of the image within the image
+        // directory, so that images in different directories don't clash.
+        string name = fs::relative(fs::path(image_path), fs::path(config.image_directory))
+                .replace_extension().string();
+        replace(name.begin(), name.end(), '/', '_');
+        pool.submit([&, image_path, name, boxes, bytes]() {
+            int written = extractor.extract(image_path, name, boxes);
+            if (written < 0) {
+                failed += 1;
+            } else {
+                crops += written;
+            }
+            size_t done = ++images;
+            {
+                lock_guard<mutex> lock(memory_mutex);
+                in_flight -= bytes;
+            }
+            memory_released.notify_all();
+            if (done % CROPS_REPORT_INTERVAL == 0) {
+                double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                printf("%zu images, %zu crops (%.1f images/sec)\n", done, crops.load(), done / seconds);
+            }
+        });
+    }
+    pool.wait_idle();
+
+    // Report the throughput, and any of the images which couldn't be decoded.
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("Wrote %zu crops from %zu images to %s in %.2f seconds (%.1f images/sec, %.1f crops/sec)\n",
+           crops.load(), images.load(), options.output_directory.c_str(), seconds,
+           images / seconds, crops / seconds);
+    if (failed > 0)
+        printf("%zu images could not be decoded\n", failed.load());
+    return 0;
+}
@@ -0,0 +1,119 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "extract.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+namespace fs = std::__fs::filesystem;
+
+CropExtractor::CropExtractor(CropOptions crop_options) : options(std::move(crop_options)) {}
+
+int CropExtractor::extract(const std::string& image_path, const std::string& name,
+                           const std::vector<CropBox>& boxes) const {
+    // Decode the image once, at the lowest resolution which keeps the crops' size.
+    int factor = this->reduction(boxes);
+    static const int flags[] = {cv::IMREAD_COLOR, cv::IMREAD_REDUCED_COLOR_2,
+                                cv::IMREAD_REDUCED_COLOR_4, cv::IMREAD_REDUCED_COLOR_8};
+    cv::Mat image = cv::imread(image_path, flags[(int)log2(factor)]);
+    if (image.empty())
+        return -1;
+
+    // Write the crop of each of the boxes into the directory of its label.
+    int written = 0;
+    for (size_t i = 0; i < boxes.size(); i++) {
+        cv::Rect region = this->crop_region(boxes[i]);
+        region = cv::Rect((int)floor(region.x / (double)factor), (int)floor(region.y / (double)factor),
+                          max(1, (int)lround(region.width / (double)factor)),
+                          max(1, (int)lround(region.height / (double)factor)));
+        cv::Mat cropped = this->crop(image, region);
+        if (cropped.empty())
+            continue;
+
+        // Labels are used as directory names, so they can't contain separators.
+        string label = boxes[i].label;
+        replace(label.begin(), label.end(), '/', '_');
+        fs::path directory = fs::path(this->options.output_directory) / label;
+        std::error_code error;
+        fs::create_directories(directory, error);
+        string file = name + "_" + to_string(i) + "." + this->options.format;
+        if (cv::imwrite((directory / file).string(), cropped))
+            written += 1;
+    }
+    return written;
+}
+
+int CropExtractor::reduction(const std::vector<CropBox>& boxes) const {
+    // Crops which keep their original size need the full image.
+    if (this->options.size <= 0 || boxes.empty())
+        return 1;
+
+    // Otherwise, find the smallest side of any of the regions, which
+    // still has to be at least the size of a crop after the reduction.
+    int smallest = INT32_MAX;
+    for (const auto& box: boxes) {
+        cv::Rect region = this->crop_region(box);
+        smallest = min(smallest, this->options.square ? max(region.width, region.height)
+                                                      : min(region.width, region.height));
+    }
+    int factor = 8;
+    while (factor > 1 && smallest / factor < this->options.size)
+        factor /= 2;
+    return factor;
+}
+
+cv::Rect CropExtractor::crop_region(const CropBox& box) const {
+    // Normalize the corners (the coordinates are inclusive).
+    const int* c = box.coordinates;
+    int x1 = min(c[0], c[2]), x2 = max(c[0], c[2]);
+    int y1 = min(c[1], c[3]), y2 = max(c[1], c[3]);
+    double width = x2 - x1 + 1, height = y2 - y1 + 1;
+
+    // Add the context around the box, then grow the shorter side
+    // (around the center of the box) to make the region square.
+    width *= 1.0 + 2.0 * this->options.context;
+    height *= 1.0 + 2.0 * this->options.context;
+    if (this->options.square)
+        width = height = max(width, height);
+    double center_x = (x1 + x2 + 1) / 2.0, center_y = (y1 + y2 + 1) / 2.0;
+    return cv::Rect((int)floor(center_x - width / 2.0), (int)floor(center_y - height / 2.0),
+                    max(1, (int)lround(width)), max(1, (int)lround(height)));
+}
+
+cv::Mat CropExtractor::crop(const cv::Mat& image, const cv::Rect& region) const {
+    // Copy the part of the region inside of the image, and
+    // pad the rest of it with black.
+    cv::Rect inside = region & cv::Rect(0, 0, image.cols, image.rows);
+    if (inside.empty())
+        return cv::Mat();
+    cv::Mat cropped;
+    cv::copyMakeBorder(image(inside), cropped, inside.y - region.y,
+                       region.y + region.height - inside.y - inside.height,
+                       inside.x - region.x, region.x + region.width - inside.x - inside.width,
+                       cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0));
+
+    // Resize the crop (with area interpolation when it is shrunk).
+    cv::Size size(this->options.size, this->options.size);
+    if (this->options.size > 0 && cropped.size() != size) {
+        int interpolation = (cropped.cols > this->options.size) ? cv::INTER_AREA : cv::INTER_LINEAR;
+        cv::resize(cropped, cropped, size, 0, 0, interpolation);
+    }
+    return cropped;
+}
@@ -0,0 +1,110 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_EXTRACT_H
+#define ANNOTATION_EXTRACT_H
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/**
+ * How the crops of the boxes are extracted.
+ */
+struct CropOptions {
+    /* The directory which the crops are written to, with
+     * one sub-directory for each of the labels. */
+    std::string output_directory;
+
+    /* The width and height of each crop, or zero to
+     * keep each crop at its original size. */
+    int size = 224;
+
+    /* The context added around each box, as a fraction of its size. */
+    double context = 0.0;
+
+    /* Whether each crop is padded to a square (so that it isn't
+     * stretched when it is resized), rather than just resized. */
+    bool square = true;
+
+    /* The extension (and so the format) of the crop files. */
+    std::string format = "jpg";
+};
+
+/**
+ * A box to crop, with its label and coordinates in the
+ * order [x1, y1, x2, y2] (in full-resolution pixels).
+ */
+struct CropBox {
+    std::string label;
+    int coordinates[4];
+};
+
+/**
+ * Extracts the crops of the boxes of an image, decoding
+ * each image only once for all of its boxes.
+ *
+ * Since the crops are usually much smaller than the images, images
+ * are decoded at a reduced resolution (which the JPEG decoder does
+ * much faster, by only partially decoding each block) whenever every
+ * crop is still at least as large as the requested size.
+ */
+class CropExtractor {
+private:
+    /* The options for the crops. */
+    CropOptions options;
+
+public:
+    /**
+     * Creates an extractor.
+     * @param crop_options: How the crops are extracted.
+     */
+    explicit CropExtractor(CropOptions crop_options);
+
+    /**
+     * Decodes an image and writes the crop of each of its boxes.
+     * @param image_path: The path to the image.
+     * @param name: The name which the crop files start with.
+     * @param boxes: The boxes to crop.
+     * @return The number of crops which were written, or -1 if
+     * the image could not be decoded.
+     */
+    int extract(const std::string& image_path, const std::string& name,
+                const std::vector<CropBox>& boxes) const;
+
+    /**
+     * Returns the factor (1, 2, 4, or 8) which an image can be
+     * reduced by while decoding, for the crops to keep their size.
+     * @param boxes: The boxes which are cropped from the image.
+     */
+    int reduction(const std::vector<CropBox>& boxes) const;
+
+private:
+    /**
+     * Finds the region of the image (in full-resolution pixels)
+     * which is cropped for a box, including the context around it.
+     */
+    cv::Rect crop_region(const CropBox& box) const;
+
+    /**
+     * Crops a region out of an image, padding the parts of
+     * it outside of the image, and resizes it.
+     * @param image: The decoded image.
+     * @param region: The region, in the pixels of the decoded image.
+     */
+    cv::Mat crop(const cv::Mat& image, const cv::Rect& region) const;
+};
+
+#endif //ANNOTATION_EXTRACT_H
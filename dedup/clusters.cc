@@ -0,0 +1,78 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "clusters.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+std::vector<int> find_duplicate_clusters(const std::vector<uint64_t>& hashes,
+                                         const std::vector<bool>& valid, int max_distance) {
+    vector<int> representatives(hashes.size());
+    for (size_t i = 0; i < hashes.size(); i++)
+        representatives[i] = (int)i;
+    if (max_distance < 0)
+        return representatives;
+
+    // Split the hashes into blocks of (nearly) equal width.
+    int num_blocks = min(max_distance + 1, 64);
+    vector<int> shifts(num_blocks);
+    vector<uint64_t> masks(num_blocks);
+    for (int b = 0; b < num_blocks; b++) {
+        int begin = b * 64 / num_blocks, end = (b + 1) * 64 / num_blocks;
+        shifts[b] = begin;
+        masks[b] = (end - begin == 64) ? ~0ULL : ((1ULL << (end - begin)) - 1);
+    }
+
+    // One table for each block, mapping the value of the
+    // block to the representatives with that value.
+    vector<unordered_map<uint64_t, vector<int>>> tables(num_blocks);
+    vector<int> last_checked(hashes.size(), -1);
+    for (size_t i = 0; i < hashes.size(); i++) {
+        if (!valid[i])
+            continue;
+        uint64_t hash = hashes[i];
+
+        // Find the closest representative among the candidates
+        // which share at least one block with this image.
+        int best = -1, best_distance = max_distance + 1;
+        for (int b = 0; b < num_blocks; b++) {
+            auto bucket = tables[b].find((hash >> shifts[b]) & masks[b]);
+            if (bucket == tables[b].end())
+                continue;
+            for (int candidate: bucket->second) {
+                if (last_checked[candidate] == (int)i)
+                    continue;
+                last_checked[candidate] = (int)i;
+                int distance = __builtin_popcountll(hash ^ hashes[candidate]);
+                if (distance < best_distance ||
+                    (distance == best_distance && candidate < best)) {
+                    best = candidate;
+                    best_distance = distance;
+                }
+            }
+        }
+
+        // Join that cluster, or otherwise start a new one.
+        if (best != -1) {
+            representatives[i] = best;
+        } else {
+            for (int b = 0; b < num_blocks; b++)
+                tables[b][(hash >> shifts[b]) & masks[b]].push_back((int)i);
+        }
+    }
+    return representatives;
+}
@@ -0,0 +1,43 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_CLUSTERS_H
+#define ANNOTATION_CLUSTERS_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Groups images into clusters of near-duplicates, where an image
+ * joins the cluster of the closest earlier representative whose
+ * hash is within `max_distance` bits of its own (otherwise, it
+ * becomes the representative of a new cluster). Every member of
+ * a cluster is therefore close to the representative itself.
+ *
+ * Rather than comparing all pairs, the representatives are stored
+ * in a multi-index hash table: the hashes are split into
+ * `max_distance + 1` blocks, and (by the pigeonhole principle)
+ * any hash within `max_distance` bits matches in at least one of
+ * the blocks, so only the exact matches of each block are compared.
+ *
+ * @param hashes: The 64-bit perceptual hash of each image.
+ * @param valid: Whether each hash is valid (images which
+ * could not be hashed are always their own cluster).
+ * @param max_distance: The maximum number of differing bits.
+ * @return The index of the representative of each image.
+ */
+std::vector<int> find_duplicate_clusters(const std::vector<uint64_t>& hashes,
+                                         const std::vector<bool>& valid, int max_distance);
+
+#endif //ANNOTATION_CLUSTERS_H
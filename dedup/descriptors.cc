@@ -0,0 +1,144 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "descriptors.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "../system/paths.h"
+
+#define DESCRIPTOR_MAGIC "ANNDESC1"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Computes a checksum of the records, so that a file which
+ * was only partially written can be detected and discarded.
+ */
+static uint64_t checksum(const void* data, size_t size) {
+    const auto* bytes = (const unsigned char*)data;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+DescriptorCache::DescriptorCache(const std::string& path) : cache_path(path) {
+    // Read the existing cache, if there is one.
+    this->load();
+}
+
+void DescriptorCache::load() {
+    ifstream in(this->cache_path, ios::binary);
+    if (!in.is_open())
+        return;
+
+    // Read and validate the header. If the descriptors have
+    // a different size, the cache is simply regenerated.
+    FileHeader header{};
+    if (!in.read((char*)&header, sizeof(header)) ||
+        memcmp(header.magic, DESCRIPTOR_MAGIC, 8) != 0 ||
+        header.record_size != sizeof(Record)) {
+        return;
+    }
+
+    // Read the records, and discard them if they were not completely written.
+    vector<Record> entries(header.count);
+    size_t bytes = entries.size() * sizeof(Record);
+    if (!in.read((char*)entries.data(), (streamsize)bytes) ||
+        checksum(entries.data(), bytes) != header.checksum) {
+        cerr << "The image descriptor cache is invalid, so it will be rebuilt." << endl;
+        return;
+    }
+    this->records.reserve(entries.size());
+    for (const auto& entry: entries) {
+        this->records[entry.key] = entry;
+    }
+}
+
+bool DescriptorCache::get(const std::string& image_path, uint8_t* descriptor) {
+    int64_t mtime = file_mtime(image_path);
+    lock_guard<std::mutex> lock(this->mutex);
+    auto record = this->records.find(hash_path(image_path));
+    if (record == this->records.end() || record->second.mtime != mtime)
+        return false;
+    memcpy(descriptor, record->second.descriptor, DESCRIPTOR_BYTES);
+    return true;
+}
+
+void DescriptorCache::put(const std::string& image_path, const uint8_t* descriptor) {
+    Record record {hash_path(image_path), file_mtime(image_path), {}};
+    memcpy(record.descriptor, descriptor, DESCRIPTOR_BYTES);
+    lock_guard<std::mutex> lock(this->mutex);
+    this->records[record.key] = record;
+    this->modified = true;
+}
+
+void DescriptorCache::save() {
+    lock_guard<std::mutex> lock(this->mutex);
+    if (!this->modified)
+        return;
+
+    // Write the complete cache to a temporary file, and then move it over
+    // the old one, so that an interrupted save never loses the old descriptors.
+    vector<Record> entries; entries.reserve(this->records.size());
+    for (const auto& record: this->records) {
+        entries.push_back(record.second);
+    }
+    size_t bytes = entries.size() * sizeof(Record);
+    FileHeader header{};
+    memcpy(header.magic, DESCRIPTOR_MAGIC, 8);
+    header.record_size = sizeof(Record);
+    header.count = entries.size();
+    header.checksum = checksum(entries.data(), bytes);
+
+    string temporary_path = this->cache_path + ".tmp";
+    ofstream out(temporary_path, ios::binary | ios::trunc);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)entries.data(), (streamsize)bytes);
+    out.close();
+    if (!out || rename(temporary_path.c_str(), this->cache_path.c_str()) != 0) {
+        cerr << "Could not write the image descriptor cache to \'" << this->cache_path << "\'." << endl;
+        remove(temporary_path.c_str());
+        return;
+    }
+    this->modified = false;
+}
+
+bool DescriptorCache::compute(const std::string& image_path, uint8_t* descriptor) {
+    // The descriptor only needs a tiny image, so decode at an eighth of
+    // the resolution (the codec scales while decoding, which is much faster).
+    Mat image = imread(image_path, IMREAD_REDUCED_COLOR_8);
+    if (image.empty())
+        return false;
+
+    // Average the image down to the descriptor's size.
+    Mat small;
+    resize(image, small, Size(DESCRIPTOR_SIZE, DESCRIPTOR_SIZE), 0, 0, INTER_AREA);
+    if (!small.isContinuous())
+        small = small.clone();
+    memcpy(descriptor, small.data, DESCRIPTOR_BYTES);
+    return true;
+}
@@ -0,0 +1,105 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_DESCRIPTORS_H
+#define ANNOTATION_DESCRIPTORS_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "diversity.h"
+
+/**
+ * A cache of the global descriptors of images, which is stored on
+ * disk so that each version of an image is only decoded once to order
+ * the images by diversity (it is keyed by the path and mtime).
+ *
+ * The file has the same layout as the hash cache: a header followed
+ * by an array of fixed size records, rewritten in full when saved.
+ */
+class DescriptorCache {
+private:
+    /* A record in the cache file. */
+    struct Record {
+        uint64_t key;
+        int64_t mtime;
+        uint8_t descriptor[DESCRIPTOR_BYTES];
+    };
+
+    /* The header at the start of the cache file. */
+    struct FileHeader {
+        char magic[8];
+        uint32_t record_size;
+        uint32_t reserved;
+        uint64_t count;
+        uint64_t checksum;
+    };
+
+    /* The path to the cache file. */
+    std::string cache_path;
+
+    /* The cached descriptors, keyed by path hash. */
+    std::unordered_map<uint64_t, Record> records;
+
+    /* Whether any descriptors have been added since the cache was loaded. */
+    bool modified = false;
+
+    /* Synchronizes access from the workers. */
+    std::mutex mutex;
+
+public:
+    /**
+     * Opens the descriptor cache, reading it if it exists.
+     * @param path: The path to the cache file.
+     */
+    explicit DescriptorCache(const std::string& path);
+
+    /**
+     * Gets the cached descriptor of an image, if it is up to date.
+     * @param image_path: The path to the image.
+     * @param descriptor: Receives the descriptor (`DESCRIPTOR_BYTES` long).
+     * @return Whether the descriptor was found.
+     */
+    bool get(const std::string& image_path, uint8_t* descriptor);
+
+    /**
+     * Adds the descriptor of an image to the cache.
+     */
+    void put(const std::string& image_path, const uint8_t* descriptor);
+
+    /**
+     * Writes the cache file, if any descriptors were added.
+     */
+    void save();
+
+    /**
+     * Computes the descriptor of an image, which is the image downsampled
+     * to 8x8 pixels (from a reduced resolution decode of it, so it is
+     * cheap). This does not access the cache, so it can run on any thread.
+     * @param image_path: The path to the image.
+     * @param descriptor: Receives the descriptor (`DESCRIPTOR_BYTES` long).
+     * @return Whether the image could be decoded.
+     */
+    static bool compute(const std::string& image_path, uint8_t* descriptor);
+
+private:
+    /**
+     * Reads an existing cache file.
+     */
+    void load();
+};
+
+#endif //ANNOTATION_DESCRIPTORS_H
@@ -0,0 +1,129 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "diversity.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+static_assert(DESCRIPTOR_BYTES % 16 == 0, "The descriptors are compared sixteen bytes at a time");
+
+uint32_t descriptor_distance_scalar(const uint8_t* a, const uint8_t* b) {
+    uint32_t distance = 0;
+    for (size_t i = 0; i < DESCRIPTOR_BYTES; i++) {
+        distance += (uint32_t)abs((int)a[i] - (int)b[i]);
+    }
+    return distance;
+}
+
+uint32_t descriptor_distance(const uint8_t* a, const uint8_t* b) {
+#if defined(__SSE2__)
+    // Sum the absolute differences of sixteen bytes at a time, into
+    // two 64-bit lanes (which can't overflow for these descriptors).
+    __m128i sum = _mm_setzero_si128();
+    for (size_t i = 0; i < DESCRIPTOR_BYTES; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(x, y));
+    }
+    return (uint32_t)(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+#elif defined(__aarch64__)
+    // Widen the absolute differences into 16-bit lanes as they are summed.
+    uint16x8_t sum = vdupq_n_u16(0);
+    for (size_t i = 0; i < DESCRIPTOR_BYTES; i += 16) {
+        uint8x16_t difference = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        sum = vpadalq_u8(sum, difference);
+    }
+    return vaddlvq_u16(sum);
+#else
+    return descriptor_distance_scalar(a, b);
+#endif
+}
+
+std::vector<size_t> diversity_order(const std::vector<uint8_t>& descriptors,
+                                    const std::vector<bool>& valid, size_t count,
+                                    ThreadPool* workers) {
+    // Track the distance from each image to its nearest chosen image,
+    // where the chosen images (and those without a descriptor) are -1.
+    size_t total = valid.size();
+    vector<int32_t> nearest(total, INT32_MAX);
+    for (size_t i = 0; i < total; i++) {
+        if (!valid[i])
+            nearest[i] = -1;
+    }
+
+    // Start from the first image with a descriptor.
+    vector<size_t> order;
+    order.reserve(total);
+    size_t next = find(valid.begin(), valid.end(), true) - valid.begin();
+    while (order.size() < count && next < total) {
+        order.push_back(next);
+        nearest[next] = -1;
+
+        // Update the distances to the new image in a range of the images,
+        // and find the farthest remaining one (the first, if there are ties).
+        const uint8_t* chosen = descriptors.data() + next * DESCRIPTOR_BYTES;
+        auto update = [&descriptors, &nearest, chosen](size_t begin, size_t end) {
+            pair<int32_t, size_t> farthest(-1, 0);
+            for (size_t i = begin; i < end; i++) {
+                if (nearest[i] < 0)
+                    continue;
+                int32_t distance = (int32_t)descriptor_distance(chosen, descriptors.data() + i * DESCRIPTOR_BYTES);
+                nearest[i] = min(nearest[i], distance);
+                if (nearest[i] > farthest.first)
+                    farthest = make_pair(nearest[i], i);
+            }
+            return farthest;
+        };
+
+        // Split large datasets into chunks across the workers.
+        pair<int32_t, size_t> farthest(-1, 0);
+        if (workers != nullptr && total > DIVERSITY_CHUNK) {
+            vector<future<pair<int32_t, size_t>>> chunks;
+            for (size_t begin = 0; begin < total; begin += DIVERSITY_CHUNK) {
+                size_t end = min(total, begin + DIVERSITY_CHUNK);
+                chunks.push_back(workers->submit([&update, begin, end]() { return update(begin, end); }));
+            }
+            for (auto& chunk: chunks) {
+                pair<int32_t, size_t> candidate = chunk.get();
+                if (candidate.first > farthest.first)
+                    farthest = candidate;
+            }
+        } else {
+            farthest = update(0, total);
+        }
+        next = (farthest.first < 0) ? total : farthest.second;
+    }
+
+    // The rest of the images follow in their original order.
+    vector<bool> ordered(total, false);
+    for (size_t index: order) {
+        ordered[index] = true;
+    }
+    for (size_t i = 0; i < total; i++) {
+        if (!ordered[i])
+            order.push_back(i);
+    }
+    return order;
+}
@@ -0,0 +1,73 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_DIVERSITY_H
+#define ANNOTATION_DIVERSITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../system/threadpool.h"
+
+/* The size of the global descriptor of an image, which is
+ * the image downsampled to 8x8 pixels (with three channels). */
+#define DESCRIPTOR_SIZE 8
+#define DESCRIPTOR_BYTES (DESCRIPTOR_SIZE * DESCRIPTOR_SIZE * 3)
+
+/* The number of images whose distances are updated by each
+ * task, when the ordering is split across the workers. */
+#define DIVERSITY_CHUNK 8192
+
+/**
+ * Computes the L1 distance between two descriptors, one byte at a time.
+ * @param a: The first descriptor.
+ * @param b: The second descriptor.
+ * @return The sum of the absolute differences of the bytes.
+ */
+uint32_t descriptor_distance_scalar(const uint8_t* a, const uint8_t* b);
+
+/**
+ * Computes the L1 distance between two descriptors, using SIMD
+ * instructions where they are available (SSE2 or NEON), which
+ * compare sixteen bytes at a time (the result is the same).
+ * @param a: The first descriptor.
+ * @param b: The second descriptor.
+ * @return The sum of the absolute differences of the bytes.
+ */
+uint32_t descriptor_distance(const uint8_t* a, const uint8_t* b);
+
+/**
+ * Orders images so that the first of them cover the dataset as well as
+ * possible, by greedy farthest-point sampling: starting from the first
+ * image, each next image is the one farthest from all of the images
+ * chosen so far (so consecutive near-identical frames are spread out,
+ * and rare scenes come up early).
+ *
+ * Each step updates the distance from every image to its nearest chosen
+ * image, so choosing `count` images takes `count` passes over them (split
+ * into chunks across the workers). The remaining images keep their order.
+ *
+ * @param descriptors: The descriptors of the images, one after another.
+ * @param valid: Whether each image has a descriptor (images
+ * which could not be decoded are never chosen early).
+ * @param count: The number of images to choose by diversity.
+ * @param workers: The pool to split the passes across, or a nullptr.
+ * @return The indices of the images, in their new order.
+ */
+std::vector<size_t> diversity_order(const std::vector<uint8_t>& descriptors,
+                                    const std::vector<bool>& valid, size_t count,
+                                    ThreadPool* workers = nullptr);
+
+#endif //ANNOTATION_DIVERSITY_H
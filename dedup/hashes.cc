@@ -0,0 +1,183 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "hashes.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "../system/paths.h"
+
+#define HASH_MAGIC "ANNHASH1"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Returns the identifier of a hash method which is stored in the
+ * cache file, so that hashes from another method are not reused.
+ */
+static uint32_t method_id(const std::string& method) {
+    return (method == "phash") ? 2 : 1;
+}
+
+/**
+ * Computes a checksum of the records, so that a file which
+ * was only partially written can be detected and discarded.
+ */
+static uint64_t checksum(const void* data, size_t size) {
+    const auto* bytes = (const unsigned char*)data;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+HashCache::HashCache(const std::string& path, const std::string& method_choice)
+        : cache_path(path), method(method_choice) {
+    // Read the existing cache, if there is one.
+    this->load();
+}
+
+void HashCache::load() {
+    ifstream in(this->cache_path, ios::binary);
+    if (!in.is_open())
+        return;
+
+    // Read and validate the header. If the file holds hashes
+    // from a different method, it is simply regenerated.
+    FileHeader header{};
+    if (!in.read((char*)&header, sizeof(header)) ||
+        memcmp(header.magic, HASH_MAGIC, 8) != 0 ||
+        header.method != method_id(this->method)) {
+        return;
+    }
+
+    // Read the records, and discard them if they were not completely written.
+    vector<Record> entries(header.count);
+    size_t bytes = entries.size() * sizeof(Record);
+    if (!in.read((char*)entries.data(), (streamsize)bytes) ||
+        checksum(entries.data(), bytes) != header.checksum) {
+        cerr << "The image hash cache is invalid, so it will be rebuilt." << endl;
+        return;
+    }
+    this->records.reserve(entries.size());
+    for (const auto& entry: entries) {
+        this->records[entry.key] = entry;
+    }
+}
+
+bool HashCache::get(const std::string& image_path, uint64_t& hash) {
+    int64_t mtime = file_mtime(image_path);
+    lock_guard<std::mutex> lock(this->mutex);
+    auto record = this->records.find(hash_path(image_path));
+    if (record == this->records.end() || record->second.mtime != mtime)
+        return false;
+    hash = record->second.hash;
+    return true;
+}
+
+void HashCache::put(const std::string& image_path, uint64_t hash) {
+    Record record {hash_path(image_path), file_mtime(image_path), hash};
+    lock_guard<std::mutex> lock(this->mutex);
+    this->records[record.key] = record;
+    this->modified = true;
+}
+
+void HashCache::save() {
+    lock_guard<std::mutex> lock(this->mutex);
+    if (!this->modified)
+        return;
+
+    // Write the complete cache to a temporary file, and then move it over
+    // the old one, so that an interrupted save never loses the old hashes.
+    vector<Record> entries; entries.reserve(this->records.size());
+    for (const auto& record: this->records) {
+        entries.push_back(record.second);
+    }
+    size_t bytes = entries.size() * sizeof(Record);
+    FileHeader header{};
+    memcpy(header.magic, HASH_MAGIC, 8);
+    header.method = method_id(this->method);
+    header.count = entries.size();
+    header.checksum = checksum(entries.data(), bytes);
+
+    string temporary_path = this->cache_path + ".tmp";
+    ofstream out(temporary_path, ios::binary | ios::trunc);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)entries.data(), (streamsize)bytes);
+    out.close();
+    if (!out || rename(temporary_path.c_str(), this->cache_path.c_str()) != 0) {
+        cerr << "Could not write the image hash cache to \'" << this->cache_path << "\'." << endl;
+        remove(temporary_path.c_str());
+        return;
+    }
+    this->modified = false;
+}
+
+bool HashCache::compute(const std::string& image_path, const std::string& method, uint64_t& hash) {
+    // The hash only needs a tiny image, so decode at an eighth of the
+    // resolution (the codec scales while decoding, which is much faster).
+    Mat gray = imread(image_path, IMREAD_REDUCED_GRAYSCALE_8);
+    if (gray.empty())
+        return false;
+
+    hash = 0;
+    if (method == "phash") {
+        // Take the DCT of a 32x32 image, and compare each of the lowest
+        // 8x8 frequencies with their median (excluding the average).
+        Mat small, frequencies;
+        resize(gray, small, Size(32, 32), 0, 0, INTER_AREA);
+        small.convertTo(small, CV_32F);
+        dct(small, frequencies);
+        float values[64];
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 8; x++) {
+                values[y * 8 + x] = frequencies.at<float>(y, x);
+            }
+        }
+        float sorted[63];
+        copy(values + 1, values + 64, sorted);
+        nth_element(sorted, sorted + 31, sorted + 63);
+        float median = sorted[31];
+        for (int i = 0; i < 64; i++) {
+            hash = (hash << 1) | (values[i] > median ? 1 : 0);
+        }
+    } else {
+        // Compare each pixel of a 9x8 image with the one to its right.
+        Mat small;
+        resize(gray, small, Size(9, 8), 0, 0, INTER_AREA);
+        for (int y = 0; y < 8; y++) {
+            const uchar* row = small.ptr<uchar>(y);
+            for (int x = 0; x < 8; x++) {
+                hash = (hash << 1) | (row[x] < row[x + 1] ? 1 : 0);
+            }
+        }
+    }
+    return true;
+}
+
+bool HashCache::is_method(const std::string& method) {
+    return method == "none" || method == "dhash" || method == "phash";
+}
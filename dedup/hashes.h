@@ -0,0 +1,120 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_HASHES_H
+#define ANNOTATION_HASHES_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * A cache of the perceptual hashes of images, which is stored
+ * on disk so that the hashes are only computed once for each
+ * version of an image (it is keyed by the path and mtime).
+ *
+ * The file consists of a header followed by an array of fixed
+ * size records, and is rewritten in full when it is saved (the
+ * records are small, so this is fast even for large datasets).
+ */
+class HashCache {
+private:
+    /* A record in the cache file. */
+    struct Record {
+        uint64_t key;
+        int64_t mtime;
+        uint64_t hash;
+    };
+
+    /* The header at the start of the cache file. */
+    struct FileHeader {
+        char magic[8];
+        uint32_t method;
+        uint32_t reserved;
+        uint64_t count;
+        uint64_t checksum;
+    };
+
+    /* The path to the cache file, and the hash method it holds. */
+    std::string cache_path;
+    std::string method;
+
+    /* The cached hashes, keyed by path hash. */
+    std::unordered_map<uint64_t, Record> records;
+
+    /* Whether any hashes have been added since the cache was loaded. */
+    bool modified = false;
+
+    /* Synchronizes access from the hashing workers. */
+    std::mutex mutex;
+
+public:
+    /**
+     * Opens the hash cache, reading it if it exists.
+     * @param path: The path to the cache file.
+     * @param method_choice: The hash method (`dhash` or `phash`).
+     */
+    HashCache(const std::string& path, const std::string& method_choice);
+
+    /**
+     * Gets the cached hash of an image, if it is up to date.
+     * @param image_path: The path to the image.
+     * @param hash: Receives the hash.
+     * @return Whether the hash was found.
+     */
+    bool get(const std::string& image_path, uint64_t& hash);
+
+    /**
+     * Adds the hash of an image to the cache.
+     */
+    void put(const std::string& image_path, uint64_t hash);
+
+    /**
+     * Writes the cache file, if any hashes were added.
+     */
+    void save();
+
+    /**
+     * Computes the perceptual hash of an image, from a reduced
+     * resolution decode of it. This does not access the cache,
+     * so it can be run on any thread.
+     *
+     * - `dhash`: Compares each pixel of a 9x8 grayscale image with
+     *   its right neighbor (fast, and robust to scaling and encoding).
+     * - `phash`: Compares the lowest 8x8 frequencies of the DCT of a
+     *   32x32 grayscale image with their median (slower, but more
+     *   robust to small changes such as brightness and cropping).
+     *
+     * @param image_path: The path to the image.
+     * @param method: The hash method.
+     * @param hash: Receives the 64-bit hash.
+     * @return Whether the image could be decoded.
+     */
+    static bool compute(const std::string& image_path, const std::string& method, uint64_t& hash);
+
+    /**
+     * Checks whether a hash method is valid.
+     * @param method: The name of the method, or `none`.
+     */
+    static bool is_method(const std::string& method);
+
+private:
+    /**
+     * Reads an existing cache file.
+     */
+    void load();
+};
+
+#endif //ANNOTATION_HASHES_H
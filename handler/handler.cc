@@ -15,22 +15,24 @@
 #include "handler.h"
 
 #include <random>
+#include <chrono>
 #include <filesystem>
 
-#define WINDOW_NAME "Annotation"
+#define BUTTON_BAR_HEIGHT 50
+#define MIN_BUTTON_WIDTH 120
+#define PAGE_BUTTON_WIDTH 50
+#define TYPEAHEAD_MATCHES 8
 
 using namespace std;
 using namespace cv;
 namespace fs = std::__fs::filesystem;
 
-// The list of colors needs to be initialized here.
-std::vector<cv::Scalar> AnnotationHandler::colors = { // NOLINT
-        Scalar(255, 225, 186), Scalar(255, 179, 186), Scalar(255, 255, 186),
-        Scalar(186, 255, 201), Scalar(186, 225, 255)
-};
+AnnotationHandler* AnnotationHandler::pointer_window = nullptr;
 
 AnnotationHandler::AnnotationHandler(const char *mode_choice,
-                                     const std::vector<std::string>& class_list) {
+                                     const std::vector<std::string>& class_list,
+                                     const std::string& window)
+                                     : window_name(window), labels(class_list) {
     // Validate and initialize the chosen mode.
     static std::set<const char*> mode_choices {"debug", "two-click", "drag"};
     if (mode_choices.find(mode_choice) != mode_choices.end()) {
@@ -40,107 +42,424 @@ AnnotationHandler::AnnotationHandler(const char *mode_choice,
         error_exit(msg.c_str());
     }
 
+    // Create the window, with this class instance as its event handler.
+    this->create_window();
+
+    // Set the current label to be the first one in the list.
+    this->current_label = this->labels.label(0).c_str();
+}
+
+AnnotationHandler::~AnnotationHandler() {
+    // Keys can no longer be sent to this handler.
+    if (pointer_window == this)
+        pointer_window = nullptr;
+}
+
+void AnnotationHandler::create_window() {
     // Create the relevant OpenCV methods, e.g. the named window
     // and then this class instance as the event handler.
-    namedWindow(WINDOW_NAME);
-    setMouseCallback(WINDOW_NAME, AnnotationHandler::dispatch_handler, (void*)(this));
+    namedWindow(this->window_name);
+    setMouseCallback(this->window_name, AnnotationHandler::dispatch_handler, (void*)(this));
+    this->window_open = true;
+}
 
-    // Initialize the list of labels and the trackbar which
-    // will be used to control the actual label choice.
-    if (class_list.size() > 5) {
-        const char* msg = "The list of class labels should not be longer than 5.";
-        error_exit(msg);
-    }
-    this->label_list = class_list;
+void AnnotationHandler::close_window() {
+    if (!this->window_open)
+        return;
+    destroyWindow(this->window_name);
+    this->window_open = false;
+    if (pointer_window == this)
+        pointer_window = nullptr;
+}
 
-    // Set the current label to be the first one in the list.
-    this->current_label = this->label_list[0].c_str();
+int AnnotationHandler::annotate(const char *image_path,
+                                const std::vector<std::tuple<const char*,
+                                        std::vector<int>>>& initial_boxes,
+                                const cv::Mat& decoded_image,
+                                const std::shared_future<std::vector<std::tuple<
+                                        const char*, std::vector<int>>>>& proposals) {
+    this->open_image(image_path, initial_boxes, decoded_image, proposals);
+    return this->wait_for_result();
 }
 
-int AnnotationHandler::annotate(const char *image_path) {
+int AnnotationHandler::wait_for_result() {
+    // Iterate over the image and conduct an annotation session.
+    while (true) {
+        // Display the image (if it has changed), and then capture
+        // the "WaitKey" value (or the next replayed key).
+        bool displayed = this->show_changes();
+        int res = this->handle_key(this->next_key(displayed));
+        if (res != ANNOTATION_PENDING)
+            return res;
+    }
+}
+
+void AnnotationHandler::open_image(const char *image_path,
+                                   const std::vector<std::tuple<const char*,
+                                           std::vector<int>>>& initial_boxes,
+                                   const cv::Mat& decoded_image,
+                                   const std::shared_future<std::vector<std::tuple<
+                                           const char*, std::vector<int>>>>& proposals) {
+    // Reopen the window if it was closed.
+    if (!this->window_open)
+        this->create_window();
+
     // Check whether the path exists or not.
     if (!fs::exists(image_path)) {
         string msg = "The provided image path \'" +
                      string(image_path) + "\' does not exist";
         error_exit(msg.c_str());
+    } else if (!decoded_image.empty()) {
+        // The image has already been decoded, so use it directly.
+        Mat img = decoded_image;
+        this->source_scale = 1;
+        this->update_states(img);
     } else {
         // Read the image and update the class state.
-        Mat img = imread(image_path);
+        Mat img = this->load_image(image_path);
         this->update_states(img);
     }
 
+    // Restore any bounding boxes which were previously drawn.
+    if (!initial_boxes.empty()) {
+        for (const auto& initial_box: initial_boxes) {
+            this->add_bounding_box(std::get<0>(initial_box), std::get<1>(initial_box));
+        }
+        this->draw_annotations();
+    }
+
+    // Track any proposed boxes, which are added once they are ready.
+    this->pending_proposals = proposals;
+
     // Update the button animations for the first button.
     if (this->clicked_index == -1) {
         this->update_button_animations(0);
     } else {
         this->update_button_animations(this->clicked_index);
     }
+}
+
+bool AnnotationHandler::show_changes() {
+    // Display the image, but only if it has changed, since
+    // each call pushes the complete canvas to the window.
+    if (!this->needs_redraw)
+        return false;
+    imshow(this->window_name, this->image);
+    this->needs_redraw = false;
+    return true;
+}
+
+int AnnotationHandler::handle_key(int k) {
+    // Swap in the full-resolution image once it has been decoded.
+    if (this->pending_image.valid() &&
+        this->pending_image.wait_for(chrono::seconds(0)) == future_status::ready) {
+        this->swap_in_full_image();
+    }
+
+    // Add the proposed boxes once they are ready.
+    if (this->pending_proposals.valid() &&
+        this->pending_proposals.wait_for(chrono::seconds(0)) == future_status::ready) {
+        this->add_proposals();
+    }
+
+    // Replace any drawn boxes which have been refined.
+    if (!this->pending_refinements.empty()) {
+        this->apply_refinements(false);
+    }
+
+    // While the typeahead picker is open, all of
+    // the keys are used to search for a label.
+    if (this->typeahead_active) {
+        this->handle_typeahead_key(k);
+        return ANNOTATION_PENDING;
+    }
 
-    // Set a boolean to exit.
+    // Check whether the key is a label hotkey.
+    if (this->handle_label_hotkey(k))
+        return ANNOTATION_PENDING;
+
+    // Track what the key finishes the image with.
     bool exit = false;
     bool complete = false;
+    bool overview = false;
+    bool previous = false;
+
+    // Iterate over the different cases for `k`.
+    switch(k) {
+        case (int) ('q'): // Exit the loop.
+            exit = true;
+            break;
+        case (int) ('c'): {// Restart the session for the image.
+            // We can't just use the regular `update_button_animations`
+            // with the regular class values here, so we first update
+            // the class states, then access the current button and
+            // use that to re-initialize all of them.
+            this->update_states(this->image_cache);
+            int current_button_index = this->clicked_index;
+            this->clicked_index = -1;
+            this->update_button_animations(current_button_index);
+            break;
+        }
+        case (int) ('u'): // Undo the last bounding box.
+            this->undo_bounding_box();
+            break;
+        case (int) ('/'): // Open the typeahead label picker.
+            this->typeahead_active = true;
+            this->typeahead_query.clear();
+            this->typeahead_choice = 0;
+            this->update_window_title();
+            break;
+        case (int) ('['): // Move to the previous page of labels.
+            this->change_page(this->current_page - 1);
+            break;
+        case (int) (']'): // Move to the next page of labels.
+            this->change_page(this->current_page + 1);
+            break;
+        case (int) ('\r'): // The annotation is complete.
+        case (int) ('\n'):
+        case (int) (' '):
+        case (int) ('n'):
+            complete = true;
+            break;
+        case (int) ('b'): // Move back to the previous image.
+        case (int) ('p'):
+            previous = true;
+            break;
+        case (int) ('g'): // Open the overview of all the images.
+            overview = true;
+            break;
+        default: // Continue throughout the session.
+            break;
+    }
 
-    // Iterate over the image and conduct an annotation session.
-    while (true) {
-        // Display the image.
-        imshow(WINDOW_NAME, this->image);
+    // If we need to exit, then exit.
+    if (exit) {
+        return ANNOTATION_EXIT;
+    } else if (complete || overview || previous) {
+        // The bounding boxes need to be in full-resolution
+        // coordinates, so wait for the full image if necessary.
+        if (this->pending_image.valid()) {
+            this->swap_in_full_image();
+        }
+        this->apply_refinements(true);
+        if (overview)
+            return ANNOTATION_OVERVIEW;
+        return previous ? ANNOTATION_PREVIOUS : ANNOTATION_COMPLETE;
+    }
+    return ANNOTATION_PENDING;
+}
 
-        // Capture the "WaitKey" value.
-        int k = waitKey(1);
+const char* AnnotationHandler::find_label(const std::string& label) const {
+    int index = this->labels.index_of(label);
+    return (index == -1) ? nullptr : this->labels.label(index).c_str();
+}
 
-        // Iterate over the different cases for `k`.
-        switch(k) {
-            case (int) ('q'): // Exit the loop.
-                exit = true;
-                break;
-            case (int) ('c'): {// Restart the session for the image.
-                // We can't just use the regular `update_button_animations`
-                // with the regular class values here, so we first update
-                // the class states, then access the current button and
-                // use that to re-initialize all of them.
-                this->update_states(this->image_cache);
-                int current_button_index = this->clicked_index;
-                this->clicked_index = -1;
-                this->update_button_animations(current_button_index);
+cv::Mat AnnotationHandler::load_image(const char* image_path) {
+    // Request the full image, either from the image loader (which may
+    // have already loaded it ahead of time), or in the background.
+    this->source_scale = 1;
+    string path(image_path);
+    shared_future<Mat> full = this->image_loader
+            ? this->image_loader(path)
+            : async(launch::async, [path]() { return imread(path); }).share();
+
+    // Smaller images (and those which have already been loaded) are
+    // simply waited for, since a preview wouldn't be any faster.
+    uintmax_t file_size = fs::file_size(image_path);
+    if (this->progressive_threshold == 0 || file_size < this->progressive_threshold ||
+        full.wait_for(chrono::seconds(0)) == future_status::ready) {
+        return full.get();
+    }
+    this->pending_image = full;
+
+    // Otherwise, decode a reduced-resolution preview of the image (the
+    // codec scales while decoding, so this is considerably faster).
+    int reduction = (file_size >= 4 * this->progressive_threshold) ? 8 : 4;
+    Mat preview = imread(image_path, (reduction == 8)
+                                     ? IMREAD_REDUCED_COLOR_8 : IMREAD_REDUCED_COLOR_4);
+    if (preview.empty()) {
+        this->pending_image = shared_future<Mat>();
+        return full.get();
+    }
+
+    // The preview is displayed through the same transform as
+    // the full image, so it only needs to track its reduction.
+    this->source_scale = reduction;
+    return preview;
+}
+
+void AnnotationHandler::swap_in_full_image() {
+    // Get the full image, and keep the preview if it could not be decoded.
+    Mat full = this->pending_image.get();
+    this->pending_image = shared_future<Mat>();
+    if (full.empty())
+        return;
+
+    // The size of the full image was estimated from the preview, so
+    // correct any of the bounding boxes drawn in the meantime (as
+    // well as a box which is in progress) for the exact size.
+    double scale_x = full.cols / (double)this->full_size.width;
+    double scale_y = full.rows / (double)this->full_size.height;
+    auto remap_x = [&](int x) { return min((int)lround(x * scale_x), full.cols - 1); };
+    auto remap_y = [&](int y) { return min((int)lround(y * scale_y), full.rows - 1); };
+    for (auto& bounding_box: this->bounding_boxes) {
+        auto& box = std::get<1>(bounding_box);
+        box[0] = remap_x(box[0]); box[1] = remap_y(box[1]);
+        box[2] = remap_x(box[2]); box[3] = remap_y(box[3]);
+    }
+    if (this->is_drawing) {
+        this->ix = remap_x(this->ix); this->iy = remap_y(this->iy);
+    }
+
+    // Rebuild the display with the full image.
+    this->image_cache = full;
+    this->source_scale = 1;
+    this->update_display_transform();
+    this->redraw_canvas();
+}
+
+void AnnotationHandler::add_proposals() {
+    // Add each of the proposed boxes, clamped to the image.
+    auto proposals = this->pending_proposals.get();
+    this->pending_proposals = shared_future<std::vector<std::tuple<const char*, std::vector<int>>>>();
+    for (auto& proposal: proposals) {
+        std::vector<int>& box = std::get<1>(proposal);
+        box[0] = min(box[0], this->full_size.width - 1);
+        box[2] = min(box[2], this->full_size.width - 1);
+        box[1] = min(box[1], this->full_size.height - 1);
+        box[3] = min(box[3], this->full_size.height - 1);
+        this->add_bounding_box(std::get<0>(proposal), box);
+    }
+    this->draw_annotations();
+}
+
+void AnnotationHandler::apply_refinements(bool wait) {
+    bool changed = false;
+    for (auto it = this->pending_refinements.begin(); it != this->pending_refinements.end();) {
+        shared_future<std::vector<int>>& refined = std::get<1>(*it);
+        if (!wait && refined.wait_for(chrono::seconds(0)) != future_status::ready) {
+            ++it;
+            continue;
+        }
+
+        // Replace the drawn box, unless it was removed in the meantime.
+        const std::vector<int>& drawn = std::get<0>(*it);
+        for (auto& bounding_box: this->bounding_boxes) {
+            auto& box = std::get<1>(bounding_box);
+            if (std::equal(box.begin(), box.end(), drawn.begin(), drawn.end())) {
+                const std::vector<int>& refined_box = refined.get();
+                box.assign(refined_box.begin(), refined_box.end());
+                changed = true;
                 break;
             }
-            case (int) ('\r'): // The annotation is complete.
-            case (int) ('\n'):
-            case (int) (' '):
-            case (int) ('n'):
-                complete = true;
-                break;
-            default: // Continue throughout the session.
-                break;
         }
+        it = this->pending_refinements.erase(it);
+    }
 
-        // If we need to exit, then exit.
-        if (exit) {
-            return -1;
-        } else if (complete) {
-            return 0;
-        } else {
-            continue;
-        }
+    // Redraw the image with the refined boxes.
+    if (changed)
+        this->redraw_canvas();
+}
+
+void AnnotationHandler::undo_bounding_box() {
+    // Cancel a box which is in progress, or otherwise remove the last box.
+    if (this->is_drawing) {
+        this->ix = -1; this->iy = -1;
+        this->is_drawing = false;
+    } else if (!this->bounding_boxes.empty()) {
+        this->bounding_boxes.pop_back();
+    } else {
+        return;
+    }
+
+    // Redraw the image without the box.
+    this->redraw_canvas();
+}
+
+void AnnotationHandler::redraw_canvas() {
+    // Rebuild the canvas from the displayed image, and redraw the
+    // button animation and any of the existing annotations.
+    this->add_buttons_to_image();
+    int current_button_index = this->clicked_index;
+    this->clicked_index = -1;
+    this->update_button_animations(current_button_index);
+    this->draw_annotations();
+}
+
+void AnnotationHandler::update_display_transform() {
+    // Get the size of the full-resolution image.
+    this->full_size = Size(this->image_cache.cols * this->source_scale,
+                           this->image_cache.rows * this->source_scale);
+
+    // Determine the scale which fits the image into the window (below
+    // the button bar), but never enlarge images smaller than the window.
+    int available_height = max(1, this->window_size.height - BUTTON_BAR_HEIGHT);
+    this->display_scale = min(1.0, min(
+            this->window_size.width / (double)this->full_size.width,
+            available_height / (double)this->full_size.height));
+
+    // Render the downscaled view of the image once, so that the
+    // cost of displaying it depends on the window and not the image.
+    Size display_size(max(1, (int)lround(this->full_size.width * this->display_scale)),
+                      max(1, (int)lround(this->full_size.height * this->display_scale)));
+    // The view may share the previous image's pixels, so it is
+    // released rather than resized into (which would overwrite them).
+    this->display_cache = Mat();
+    if (display_size == this->image_cache.size()) {
+        this->display_cache = this->image_cache;
+    } else {
+        int interpolation = (display_size.width < this->image_cache.cols)
+                            ? INTER_AREA : INTER_LINEAR;
+        resize(this->image_cache, this->display_cache, display_size, 0, 0, interpolation);
     }
 }
 
+cv::Point AnnotationHandler::to_source(int x, int y) const {
+    // Remove the button bar offset and undo the display scale,
+    // then clamp the point to the bounds of the image.
+    int source_x = (int)lround(x / this->display_scale);
+    int source_y = (int)lround((y - BUTTON_BAR_HEIGHT) / this->display_scale);
+    return Point(max(0, min(source_x, this->full_size.width - 1)),
+                 max(0, min(source_y, this->full_size.height - 1)));
+}
+
+cv::Point AnnotationHandler::to_display(int x, int y) const {
+    return Point((int)lround(x * this->display_scale),
+                 (int)lround(y * this->display_scale) + BUTTON_BAR_HEIGHT);
+}
+
+void AnnotationHandler::draw_annotations() {
+    // Draw each of the completed bounding boxes.
+    for (const auto& bounding_box: this->bounding_boxes) {
+        const auto& box = std::get<1>(bounding_box);
+        int index = this->labels.index_of(std::get<0>(bounding_box));
+        rectangle(this->image, this->to_display(box[0], box[1]),
+                  this->to_display(box[2], box[3]),
+                  this->labels.color(max(0, index)), 3);
+    }
+
+    // Draw the start point of a box which is in progress.
+    if (this->is_drawing) {
+        circle(this->image, this->to_display(this->ix, this->iy), 1,
+               this->labels.color(this->clicked_index), 3);
+    }
+    this->needs_redraw = true;
+}
+
 void AnnotationHandler::update_states(cv::Mat& new_image) {
     // Reset the position and drawing trackers.
     this->ix = -1; this->iy = -1;
     this->is_drawing = false;
 
-    // Set the new image.
-    this->image = new_image;
+    // Save the new image, which is kept for resetting, and
+    // then render the view of it which is actually displayed.
+    this->image_cache = new_image;
+    this->update_display_transform();
 
-    // Save a copy of the image for resetting.
-    this->image_cache = this->image.clone();
-
-    // Clear the list of buttons.
-    this->buttons.clear();
-
-    // Clear the list of bounding boxes.
-    this->bounding_boxes.clear();
+    // Clear the list of bounding boxes (and any refinements of them),
+    // releasing the memory used by the previous image.
+    this->reset_image_arena();
+    this->pending_refinements.clear();
 
     // Get the image shape, its values, and then create a set
     // of buttons which correspond to the different class choices.
@@ -152,10 +471,15 @@ void AnnotationHandler::update_bounding_boxes() {
     std::vector<int> box = std::vector<int>
             {this->ix, this->iy, this->fx, this->fy};
 
-    // Create a tuple with the label and bounding box
-    // and add it to the list of bounding boxes.
-    this->bounding_boxes.emplace_back(
-            std::make_tuple(this->current_label, box));
+    // Add the label and bounding box to the list of bounding boxes.
+    this->add_bounding_box(this->current_label, box);
+
+    // Refine the box in the background, which needs the full-resolution
+    // image (so boxes drawn on a preview are kept as they are).
+    if (this->box_refiner && this->source_scale == 1) {
+        this->pending_refinements.emplace_back(
+                box, this->box_refiner(this->image_cache, box));
+    }
 
     // Reset the x/y coordinates and drawing mode.
     this->ix = -1; this->iy = -1;
@@ -163,96 +487,275 @@ void AnnotationHandler::update_bounding_boxes() {
     this->is_drawing = false;
 }
 
+void AnnotationHandler::add_bounding_box(const char* label, const std::vector<int>& box) {
+    // The coordinates are copied into the arena along with the box.
+    this->bounding_boxes.emplace_back(
+            label, std::pmr::vector<int>(box.begin(), box.end(), &this->image_arena));
+}
+
+void AnnotationHandler::reset_image_arena() {
+    // Destroy the list of boxes before releasing the memory it was in.
+    decltype(this->bounding_boxes)(&this->image_arena).swap(this->bounding_boxes);
+    this->image_arena.release();
+}
+
+std::vector<std::tuple<const char*, std::vector<int>>> AnnotationHandler::get_bounding_boxes() const {
+    std::vector<std::tuple<const char*, std::vector<int>>> boxes;
+    boxes.reserve(this->bounding_boxes.size());
+    for (const auto& bounding_box: this->bounding_boxes) {
+        const auto& box = std::get<1>(bounding_box);
+        boxes.emplace_back(std::get<0>(bounding_box), std::vector<int>(box.begin(), box.end()));
+    }
+    return boxes;
+}
+
 void AnnotationHandler::add_buttons_to_image() {
     // First, check whether there is even an image.
     if (this->image_cache.empty()) {
         const char* msg = "No image found to annotate";
-        erro_exit(msg);
+        error_exit(msg);
     }
 
-    // Get the image width.
-    int width = this->image_cache.cols;
+    // Get the width of the displayed image.
+    int width = this->display_cache.cols;
+
+    // Determine how many labels fit onto each page of the button bar,
+    // and reserve space for the page buttons if there are multiple pages.
+    int num_labels = this->labels.size();
+    this->labels_per_page = max(1, min(num_labels, width / MIN_BUTTON_WIDTH));
+    int label_width = width;
+    if (this->labels_per_page < num_labels) {
+        label_width = max(0, width - 2 * PAGE_BUTTON_WIDTH);
+        this->labels_per_page = max(1, min(num_labels, label_width / MIN_BUTTON_WIDTH));
+    }
+    this->num_pages = (num_labels + this->labels_per_page - 1) / this->labels_per_page;
+    this->current_page = min(this->current_page, this->num_pages - 1);
 
     // Determine the total width of each of the different buttons.
-    int button_width = (int)width / (int)this->label_list.size();
+    int button_width = label_width / this->labels_per_page;
 
     // Create the coordinates of the different buttons.
-    vector<vector<Point>> point_coordinates(this->label_list.size());
-    for (int i = 0; i < this->label_list.size(); ++i) {
-        point_coordinates[i].push_back(Point(i * button_width, 0));
-        point_coordinates[i].push_back(Point((i + 1) * button_width, 50));
+    this->buttons.clear();
+    for (int i = 0; i < this->labels_per_page; ++i) {
+        this->buttons.emplace_back(i * button_width, 0, button_width, BUTTON_BAR_HEIGHT);
+    }
+    this->page_buttons.clear();
+    if (this->num_pages > 1) {
+        int start = width - 2 * PAGE_BUTTON_WIDTH;
+        this->page_buttons.emplace_back(start, 0, PAGE_BUTTON_WIDTH, BUTTON_BAR_HEIGHT);
+        this->page_buttons.emplace_back(start + PAGE_BUTTON_WIDTH, 0,
+                                        PAGE_BUTTON_WIDTH, BUTTON_BAR_HEIGHT);
     }
 
     // Create the canvas.
-    Mat3b canvas(this->image_cache.rows + 50, this->image_cache.cols, Vec3b(0, 0, 0));
-
-    // Create the different buttons.
-    for (int i = 0; i < point_coordinates.size(); ++i) {
-        // Extract the set of coordinates from the current list.
-        vector<Point> coords = point_coordinates[i];
-        // Construct the button and add it to the list.
-        Rect button(coords[0], coords[1]);
-        // Add the button to the actual image.
-        canvas(button) = Vec3b(150, 150, 150);
-        // Add the label for the button.
-        vector<int> points = AnnotationHandler::calculate_text_coordinates(
-                button, this->label_list[i].c_str());
-        putText(canvas(button), this->label_list[i],
-                Point(points[0], points[1]),
-                FONT_HERSHEY_SIMPLEX, 1, AnnotationHandler::colors[i], 2);
-        // Add the button to the list.
-        this->buttons.emplace_back(button);
-    }
-
-    // Copy the image onto the canvas.
-    this->image_cache.clone().copyTo(canvas(
-            Rect(0, 50, this->image_cache.cols, this->image_cache.rows)));
+    Mat3b canvas(this->display_cache.rows + BUTTON_BAR_HEIGHT,
+                 this->display_cache.cols, Vec3b(0, 0, 0));
+
+    // Copy the displayed image onto the canvas.
+    this->display_cache.copyTo(canvas(
+            Rect(0, BUTTON_BAR_HEIGHT, this->display_cache.cols, this->display_cache.rows)));
     this->image = canvas;
+    this->needs_redraw = true;
+
+    // Add all of the buttons on the page to the canvas with a single copy.
+    this->draw_button_strip();
 }
 
-void AnnotationHandler::clear_buttons() {
-    // Iterate over the different buttons.
-    for (int i = 0; i < this->buttons.size(); ++i) {
-        // Extract the button from the current list.
-        Rect button = this->buttons[i];
-        // Add the button to the actual image.
-        this->image(button) = Vec3b(150, 150, 150);
-        // Add the label for the button.
-        vector<int> points = AnnotationHandler::calculate_text_coordinates(
-                button, this->label_list[i].c_str());
-        putText(this->image(button), this->label_list[i],
-                Point(points[0], points[1]),
-                FONT_HERSHEY_SIMPLEX, 1, AnnotationHandler::colors[i], 2);
+void AnnotationHandler::draw_button_strip() {
+    // Get the pre-rendered strip for the current page.
+    const ButtonStrip& strip = this->get_button_strip(
+            this->current_page, this->buttons[0].width);
+
+    // Copy the complete strip onto the image.
+    strip.normal.copyTo(this->image(Rect(0, 0, strip.normal.cols, BUTTON_BAR_HEIGHT)));
+    this->needs_redraw = true;
+}
+
+void AnnotationHandler::clear_button(int index) {
+    // Get the pre-rendered strip for the current page.
+    const ButtonStrip& strip = this->get_button_strip(
+            this->current_page, this->buttons[0].width);
+
+    // Copy the un-pressed tile for the button back onto the image.
+    const Rect& button = this->buttons[index - this->current_page * this->labels_per_page];
+    strip.normal(button).copyTo(this->image(button));
+    this->needs_redraw = true;
+}
+
+const ButtonStrip& AnnotationHandler::get_button_strip(int page, int button_width) {
+    // Check whether the strip has already been rendered.
+    auto key = make_tuple(page, this->labels_per_page, button_width);
+    auto cached = this->button_strips.find(key);
+    if (cached != this->button_strips.end()) {
+        return cached->second;
+    }
+
+    // Otherwise, render the strip of un-pressed buttons as well as
+    // a pressed tile for each of the buttons, and then save them.
+    ButtonStrip strip;
+    int first = page * this->labels_per_page;
+    int last = min(this->labels.size(), first + this->labels_per_page);
+    int strip_width = button_width * this->labels_per_page;
+    if (this->num_pages > 1)
+        strip_width += 2 * PAGE_BUTTON_WIDTH;
+    strip.normal = Mat3b(BUTTON_BAR_HEIGHT, strip_width, Vec3b(150, 150, 150));
+    for (int i = first; i < last; ++i) {
+        // Render the label onto the un-pressed button.
+        Rect button((i - first) * button_width, 0, button_width, BUTTON_BAR_HEIGHT);
+        this->render_button_label(strip.normal(button), this->labels.label(i), i);
+
+        // Render the pressed version of the button.
+        Mat3b pressed(BUTTON_BAR_HEIGHT, button_width, Vec3b(100, 100, 100));
+        this->render_button_label(pressed, this->labels.label(i), i);
+        strip.pressed.emplace_back(pressed);
+    }
+
+    // Add the page buttons and the page number, if there are multiple pages.
+    if (this->num_pages > 1) {
+        int start = strip_width - 2 * PAGE_BUTTON_WIDTH;
+        Mat3b previous = strip.normal(Rect(start, 0, PAGE_BUTTON_WIDTH, BUTTON_BAR_HEIGHT));
+        Mat3b next = strip.normal(Rect(start + PAGE_BUTTON_WIDTH, 0,
+                                       PAGE_BUTTON_WIDTH, BUTTON_BAR_HEIGHT));
+        previous = Vec3b(120, 120, 120); next = Vec3b(120, 120, 120);
+        Point origin = AnnotationHandler::calculate_text_coordinates(
+                Rect(0, 0, PAGE_BUTTON_WIDTH, BUTTON_BAR_HEIGHT), "<", 1);
+        putText(previous, "<", origin, FONT_HERSHEY_SIMPLEX, 1, Scalar(255, 255, 255), 2);
+        putText(next, ">", origin, FONT_HERSHEY_SIMPLEX, 1, Scalar(255, 255, 255), 2);
+        string page_number = to_string(page + 1) + "/" + to_string(this->num_pages);
+        putText(previous, page_number, Point(4, BUTTON_BAR_HEIGHT - 4),
+                FONT_HERSHEY_SIMPLEX, 0.35, Scalar(255, 255, 255), 1);
     }
+
+    // Drop the strips for the other widths if there are too many,
+    // then return the newly cached strip.
+    if (this->button_strips.size() >= MAX_BUTTON_STRIPS) {
+        for (auto it = this->button_strips.begin(); it != this->button_strips.end();) {
+            if (std::get<2>(it->first) != button_width) {
+                it = this->button_strips.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return this->button_strips.emplace(key, strip).first->second;
+}
+
+void AnnotationHandler::render_button_label(cv::Mat3b tile, const std::string& label, int index) {
+    // Shrink the text so that long labels fit onto the button.
+    int baseline = 0;
+    Size text_size = getTextSize(label, FONT_HERSHEY_SIMPLEX, 1, 2, &baseline);
+    double scale = min(1.0, max(0.35, (tile.cols - 8) / (double)text_size.width));
+
+    // Calculate where the label should be placed, and then add it.
+    Rect button(0, 0, tile.cols, tile.rows);
+    Point origin = AnnotationHandler::calculate_text_coordinates(button, label.c_str(), scale);
+    putText(tile, label, origin, FONT_HERSHEY_SIMPLEX, scale,
+            this->labels.color(index), scale < 0.6 ? 1 : 2);
 }
 
 void AnnotationHandler::dispatch_handler(int event, int x, int y, int flags, void* param) {
-    // First, check whether a button has been clicked.
-    if (((AnnotationHandler*)param)->button_click_handler(event, x, y))
+    // Send the keys to this window while the pointer is over it, and
+    // ignore the user's mouse events while a session is replayed.
+    auto* handler = (AnnotationHandler*)param;
+    pointer_window = handler;
+    if (handler->replayer)
+        return;
+    handler->handle_mouse_event(event, x, y, flags);
+}
+
+void AnnotationHandler::handle_mouse_event(int event, int x, int y, int flags) {
+    // First, check whether a button has been clicked, and record
+    // the event (mouse movements are too frequent to record).
+    bool button_clicked = this->button_click_handler(event, x, y);
+    if (this->recorder && event != EVENT_MOUSEMOVE) {
+        EventCategory category = button_clicked ? EVENT_LABEL_SWITCH :
+                                 (event == EVENT_LBUTTONDOWN ? EVENT_CLICK : EVENT_OTHER);
+        this->recorder->record(EVENT_SOURCE_MOUSE, category, event, x, y, flags);
+    }
+    if (button_clicked)
         return;
 
     // Otherwise, dispatch to the correct mode handler.
-    std::string mode_choice = std::string(((AnnotationHandler*)param)->mode);
+    std::string mode_choice = std::string(this->mode);
     if (mode_choice == "debug") {
         print_info(event, x, y);
     } else if (mode_choice == "two-click") {
-        ((AnnotationHandler*)param)->two_click_handler(event, x, y);
+        this->two_click_handler(event, x, y);
     }
 }
 
+int AnnotationHandler::next_key(bool displayed) {
+    // Capture the "WaitKey" value, which also lets the window
+    // process its events (and actually display the frame).
+    int key = waitKey(1);
+    if (!this->replayer) {
+        // Record the key, except for opening the overview
+        // (the events in the overview aren't recorded).
+        if (this->recorder && key != -1 && (key != 'g' || this->typeahead_active))
+            this->recorder->record(EVENT_SOURCE_KEY, this->classify_key(key), key);
+        return key;
+    }
+
+    // Otherwise, the replayed events which are due are handled instead
+    // (up to the next key, which the annotation loop handles).
+    this->replayer->frame_ready(displayed);
+    RecordedEvent event{};
+    while (this->replayer->take_event(event)) {
+        if (event.source == EVENT_SOURCE_KEY)
+            return event.code;
+        this->handle_mouse_event(event.code, event.x, event.y, event.flags);
+    }
+
+    // Exit once the complete session has been replayed.
+    return this->replayer->finished() ? (int)('q') : -1;
+}
+
+EventCategory AnnotationHandler::classify_key(int key) const {
+    // In the typeahead picker, only choosing a label changes anything.
+    if (this->typeahead_active)
+        return (key == '\r' || key == '\n') ? EVENT_LABEL_SWITCH : EVENT_OTHER;
+
+    switch (key) {
+        case (int) ('c'):
+            return EVENT_CLEAR;
+        case (int) ('\r'):
+        case (int) ('\n'):
+        case (int) (' '):
+        case (int) ('n'):
+        case (int) ('b'):
+        case (int) ('p'):
+            return EVENT_ADVANCE;
+        case (int) ('['):
+        case (int) (']'):
+            return EVENT_LABEL_SWITCH;
+        default:
+            break;
+    }
+    bool hotkey = (key >= '0' && key <= '9') || (key >= 'A' && key <= 'Z');
+    return hotkey ? EVENT_LABEL_SWITCH : EVENT_OTHER;
+}
+
 bool AnnotationHandler::button_click_handler(int event, int x, int y) {
     // Iterate over the buttons and check if any have been pressed.
     if (event == EVENT_LBUTTONDOWN) {
+        int first = this->current_page * this->labels_per_page;
         for (int i = 0; i < this->buttons.size(); ++i) {
             // Get the button.
             const Rect& button = this->buttons[i];
             // Check whether the button contains the point.
             if (button.contains(Point(x, y))) {
-                // If it does, then first update the current label.
-                this->current_label = this->label_list[i].c_str();
-                // Then, update the button animations.
-                this->update_button_animations(i);
-                // Finally, exit the loop.
+                // If it does, and it corresponds to a label
+                // then select that label, and exit the loop.
+                if (first + i < this->labels.size())
+                    this->select_label(first + i);
+                return true;
+            }
+        }
+
+        // Check whether either of the page buttons have been pressed.
+        for (int i = 0; i < (int)this->page_buttons.size(); ++i) {
+            if (this->page_buttons[i].contains(Point(x, y))) {
+                this->change_page(this->current_page + (i == 0 ? -1 : 1));
                 return true;
             }
         }
@@ -265,28 +768,34 @@ bool AnnotationHandler::button_click_handler(int event, int x, int y) {
 void AnnotationHandler::two_click_handler(int event, int x, int y) {
     // Check whether the mouse button is pressed.
     if (event == EVENT_LBUTTONDOWN) {
+        // The clicks are in window coordinates, but the bounding
+        // boxes are tracked in full-resolution image coordinates.
+        Point source = this->to_source(x, y);
+        Point display = this->to_display(source.x, source.y);
+
         // Check whether the annotation is in progress
         // or if this is the start of a new one.
         if (!this->is_drawing) {
             // If it is the first click, then set
             // drawing mode to true and track the position.
-            this->ix = x; this->iy = y;
+            this->ix = source.x; this->iy = source.y;
             this->is_drawing = true;
             // Create a small circle at the point to let
             // the user know where the annotation began.
-            circle(this->image, Point(this->ix, this->iy), 1,
-                   AnnotationHandler::colors[this->clicked_index], 3);
+            circle(this->image, display, 1,
+                   this->labels.color(this->clicked_index), 3);
         } else {
             // Otherwise, end the annotation and draw a
             // rectangle in the location where it should be,
             // and set the new final annotation position.
-            rectangle(this->image, Point(this->ix, this->iy),Point(x, y),
-                      AnnotationHandler::colors[this->clicked_index], 3);
-            this->fx = x; this->fy = y;
+            rectangle(this->image, this->to_display(this->ix, this->iy), display,
+                      this->labels.color(this->clicked_index), 3);
+            this->fx = source.x; this->fy = source.y;
             this->is_drawing = false;
             // Update the list of bounding boxes.
             this->update_bounding_boxes();
         }
+        this->needs_redraw = true;
     }
 }
 
@@ -299,37 +808,151 @@ void AnnotationHandler::print_info(int event, int x, int y) {
 }
 
 void AnnotationHandler::update_button_animations(int new_index) {
-    // First, clear the animation from the currently clicked button.
-    if (this->clicked_index != -1) {
-        this->clear_buttons();
-    }
-
-    // Then, add an animation to the new button.
-    Rect clicked_button = this->buttons[new_index];
-    // Add the button to the actual image.
-    this->image(clicked_button) = Vec3b(100, 100, 100);
-    // Add the label for the button.
-    vector<int> points = AnnotationHandler::calculate_text_coordinates(
-            clicked_button, this->current_label);
-    putText(this->image(clicked_button), this->current_label,
-            Point(points[0], points[1]),FONT_HERSHEY_SIMPLEX,
-            1, AnnotationHandler::colors[new_index], 2);
+    // Move to the page containing the new button if it is not
+    // visible, otherwise clear the animation from the currently
+    // clicked button (if it is on the current page).
+    int new_page = new_index / this->labels_per_page;
+    if (new_page != this->current_page) {
+        this->current_page = new_page;
+        this->draw_button_strip();
+    } else if (this->clicked_index != -1 &&
+               this->clicked_index / this->labels_per_page == this->current_page) {
+        this->clear_button(this->clicked_index);
+    }
+
+    // Then, add an animation to the new button by
+    // copying its pre-rendered pressed tile onto the image.
+    int position = new_index - this->current_page * this->labels_per_page;
+    const Rect& clicked_button = this->buttons[position];
+    const ButtonStrip& strip = this->get_button_strip(
+            this->current_page, clicked_button.width);
+    strip.pressed[position].copyTo(this->image(clicked_button));
+    this->needs_redraw = true;
 
     // Finally, update the new current clicked index.
     this->clicked_index = new_index;
 }
 
-std::vector<int> AnnotationHandler::calculate_text_coordinates(const cv::Rect& button, const char* label) {
+void AnnotationHandler::select_label(int index) {
+    // Update the current label and the button animations.
+    this->current_label = this->labels.label(index).c_str();
+    this->update_button_animations(index);
+}
+
+void AnnotationHandler::change_page(int page) {
+    // Ignore pages which do not exist.
+    if (page < 0 || page >= this->num_pages || page == this->current_page)
+        return;
+
+    // Draw the new page of buttons, and the pressed
+    // animation if the current label is on that page.
+    this->current_page = page;
+    this->draw_button_strip();
+    if (this->clicked_index / this->labels_per_page == page) {
+        int position = this->clicked_index - page * this->labels_per_page;
+        const Rect& clicked_button = this->buttons[position];
+        this->get_button_strip(page, clicked_button.width)
+                .pressed[position].copyTo(this->image(clicked_button));
+    }
+}
+
+bool AnnotationHandler::handle_label_hotkey(int key) {
+    // The number keys choose a label on the current page,
+    // with `1` being the first label and `0` the tenth.
+    if (key >= (int)('0') && key <= (int)('9')) {
+        int position = (key == (int)('0')) ? 9 : key - (int)('1');
+        int index = this->current_page * this->labels_per_page + position;
+        if (position < this->labels_per_page && index < this->labels.size())
+            this->select_label(index);
+        return true;
+    }
+
+    // The uppercase letters cycle through the labels
+    // which start with that letter (case-insensitive).
+    if (key >= (int)('A') && key <= (int)('Z')) {
+        int index = this->labels.next_with_initial((char)key, this->clicked_index);
+        if (index != -1)
+            this->select_label(index);
+        return true;
+    }
+
+    // Otherwise, the key is not a hotkey.
+    return false;
+}
+
+void AnnotationHandler::handle_typeahead_key(int key) {
+    // Ignore the case where no key has been pressed.
+    if (key == -1)
+        return;
+
+    // Find the labels matching the current query.
+    auto matches = this->labels.find_prefix(this->typeahead_query, TYPEAHEAD_MATCHES);
+
+    switch (key) {
+        case 27: // Close the picker without choosing a label.
+            this->typeahead_active = false;
+            break;
+        case (int) ('\r'): // Choose the highlighted label.
+        case (int) ('\n'):
+            if (!matches.empty())
+                this->select_label(matches[this->typeahead_choice % matches.size()]);
+            this->typeahead_active = false;
+            break;
+        case (int) ('\t'): // Move to the next match.
+            this->typeahead_choice += 1;
+            break;
+        case 8: // Remove the last character from the query.
+        case 127:
+            if (!this->typeahead_query.empty())
+                this->typeahead_query.pop_back();
+            this->typeahead_choice = 0;
+            break;
+        default: // Add printable characters to the query.
+            if (key >= 32 && key < 127) {
+                this->typeahead_query += (char)key;
+                this->typeahead_choice = 0;
+            }
+            break;
+    }
+
+    // Update the title to display the query and matches.
+    this->update_window_title();
+}
+
+void AnnotationHandler::update_window_title() {
+    // Restore the regular title if the picker is closed.
+    if (!this->typeahead_active) {
+        setWindowTitle(this->window_name, this->window_name);
+        return;
+    }
+
+    // Otherwise, show the query followed by the matching
+    // labels, with the highlighted one in brackets.
+    auto matches = this->labels.find_prefix(this->typeahead_query, TYPEAHEAD_MATCHES);
+    string title = this->window_name + " - /" + this->typeahead_query + " ->";
+    for (int i = 0; i < (int)matches.size(); ++i) {
+        const string& label = this->labels.label(matches[i]);
+        if (i == this->typeahead_choice % (int)matches.size()) {
+            title += " [" + label + "]";
+        } else {
+            title += " " + label;
+        }
+    }
+    setWindowTitle(this->window_name, title);
+}
+
+cv::Point AnnotationHandler::calculate_text_coordinates(
+        const cv::Rect& button, const char* label, double scale) {
     // Calculate the text size.
     int baseline = 0;
-    Size text_size = getTextSize(label, FONT_HERSHEY_SIMPLEX, 1, 2, &baseline);
+    Size text_size = getTextSize(label, FONT_HERSHEY_SIMPLEX, scale, 2, &baseline);
 
     // Calculate the coordinates.
-    int text_x = (button.width - text_size.width) / 2;
+    int text_x = max(0, (button.width - text_size.width) / 2);
     int text_y = (button.height + text_size.height) / 2;
 
-    // Return a vector of the coordinates.
-    return vector<int> {text_x, text_y};
-};
+    // Return the coordinates.
+    return Point(text_x, text_y);
+}
 
 
@@ -17,6 +17,11 @@
 
 #include <string>
 #include <algorithm>
+#include <map>
+#include <tuple>
+#include <future>
+#include <functional>
+#include <memory_resource>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core.hpp>
@@ -26,6 +31,50 @@
 
 #include "../system/paths.h"
 #include "../system/error.h"
+#include "../labels/labels.h"
+#include "../replay/events.h"
+
+/* The size of the inline buffer which the allocations for each
+ * image (e.g., its bounding boxes) are made from, before the
+ * arena has to fall back to the heap. */
+#define IMAGE_ARENA_BYTES 16384
+
+/* The maximum number of rendered button strips which are kept
+ * before those for other button widths are dropped. */
+#define MAX_BUTTON_STRIPS 32
+
+/* The name of the annotation window (when there is only one). */
+#define DEFAULT_WINDOW_NAME "Annotation"
+
+/**
+ * The different results of an image annotation session.
+ */
+enum AnnotationResult {
+    /* The user chose to exit the annotation session. */
+    ANNOTATION_EXIT = -1,
+    /* The annotation of the image is complete. */
+    ANNOTATION_COMPLETE = 0,
+    /* The user chose to open the overview of all the images. */
+    ANNOTATION_OVERVIEW = 1,
+    /* The user chose to move back to the previous image. */
+    ANNOTATION_PREVIOUS = 2,
+    /* The image is still being annotated (only from `handle_key`). */
+    ANNOTATION_PENDING = 3
+};
+
+/**
+ * A set of pre-rendered label buttons for a specific
+ * button width, so that the text on each of the buttons
+ * only needs to be drawn once rather than for every image.
+ */
+struct ButtonStrip {
+    /* The complete strip of un-pressed buttons, which
+     * is copied directly onto the top of each image. */
+    cv::Mat3b normal;
+
+    /* The pressed version of each individual button. */
+    std::vector<cv::Mat3b> pressed;
+};
 
 /**
  * This class handles the events which take
@@ -44,8 +93,21 @@ protected:
      * to use a two-click or drag/drop interface. */
     const char* mode;
 
+    /* The name of the window which this handler draws into, which
+     * is unique when several windows are open in one process. */
+    std::string window_name;
+
+    /* The handler whose window the mouse pointer was last over, which
+     * the keys are sent to when several windows are open (OpenCV does
+     * not report which window a key was pressed in). */
+    static AnnotationHandler* pointer_window;
+
+    /* Whether the handler's window is currently open. */
+    bool window_open = false;
+
     /* For both modes, the initial position on
-     * each set of annotations will be tracked. */
+     * each set of annotations will be tracked. These
+     * positions are in full-resolution image coordinates. */
     int ix = -1;
     int iy = -1;
 
@@ -62,15 +124,35 @@ protected:
      * button index was clicked, so that it can be cleared. */
     int clicked_index = -1;
 
-    /* At all times, a specific image should be tracked. */
+    /* At all times, a specific image should be tracked. This
+     * is the canvas which is actually displayed in the window. */
     cv::Mat image;
 
-    /* Also, save a cache of the image for resetting. */
+    /* Also, save a cache of the image for resetting. This is
+     * the loaded image (which may be a reduced-resolution preview). */
     cv::Mat image_cache;
 
-    /* The class will always contain a list of labels
-     * which it will call from when choosing a one. */
-    std::vector<std::string> label_list;
+    /* The view of the image which has been scaled to fit into the
+     * window, which is rendered once for each image that is loaded. */
+    cv::Mat display_cache;
+
+    /* The maximum size of the displayed image and button bar. */
+    cv::Size window_size = cv::Size(1600, 900);
+
+    /* The size of the full-resolution image, the number of
+     * full-resolution pixels per pixel of the loaded image, and
+     * the number of displayed pixels per full-resolution pixel. */
+    cv::Size full_size;
+    int source_scale = 1;
+    double display_scale = 1.0;
+
+    /* Whether the canvas has changed since it was last displayed. */
+    bool needs_redraw = true;
+
+    /* The class will always contain a vocabulary of labels
+     * which it will call from when choosing a one, and which
+     * also contains the color used for each of the labels. */
+    LabelVocabulary labels;
 
     /* Furthermore, the current label of the annotation
      * being drawn will also be tracked at the time. */
@@ -80,40 +162,297 @@ protected:
      * corresponding to the different labels being tracked. */
     std::vector<cv::Rect> buttons;
 
-    /* For each of the different labels, a different color will
-     * be picked out of this vector of colors. */
-    static std::vector<cv::Scalar> colors;
+    /* When there are too many labels to fit onto the image,
+     * the buttons are split into pages which can be switched
+     * between using these two buttons (previous and next). */
+    std::vector<cv::Rect> page_buttons;
+
+    /* The number of labels on each page, the number of
+     * pages, and the page which is currently displayed. */
+    int labels_per_page = 1;
+    int num_pages = 1;
+    int current_page = 0;
+
+    /* The rendered button strips, keyed by the page, the number
+     * of labels per page, and the width of each button (which
+     * all depend on the width of the image). Only the strips for
+     * the current width are kept once there are too many, since
+     * every distinct image width would otherwise keep its own. */
+    std::map<std::tuple<int, int, int>, ButtonStrip> button_strips;
+
+    /* Whether the typeahead label picker is open, the query
+     * typed into it, and which of the matches is highlighted. */
+    bool typeahead_active = false;
+    std::string typeahead_query;
+    int typeahead_choice = 0;
+
+    /* Images with a file size of at least this many bytes are
+     * first displayed using a reduced-resolution decode, while
+     * the full image is decoded in the background. */
+    uintmax_t progressive_threshold = 8 * 1024 * 1024;
+
+    /* The full-resolution image which is being decoded in
+     * the background while a preview is being displayed. */
+    std::shared_future<cv::Mat> pending_image;
+
+    /* The proposed bounding boxes for the current image,
+     * which are added to it once they are ready. */
+    std::shared_future<std::vector<std::tuple<const char*, std::vector<int>>>> pending_proposals;
+
+    /* Requests that an image be loaded in the background. When
+     * this is not set, images are decoded on a new thread. */
+    std::function<std::shared_future<cv::Mat>(const std::string&)> image_loader;
+
+    /* Requests that a drawn box be refined in the background, given
+     * the full-resolution image. When this is not set, boxes are kept
+     * exactly as they were drawn. */
+    std::function<std::shared_future<std::vector<int>>(
+            const cv::Mat&, const std::vector<int>&)> box_refiner;
+
+    /* Records the user's mouse and key events, or replays a recorded
+     * session in place of them (neither is done when these are unset). */
+    std::shared_ptr<EventRecorder> recorder;
+    std::shared_ptr<EventReplayer> replayer;
+
+    /* The boxes which are being refined, as they were drawn,
+     * and the refined boxes which will replace them. */
+    std::vector<std::tuple<std::vector<int>, std::shared_future<std::vector<int>>>> pending_refinements;
+
+    /* The arena which the allocations for the current image are made
+     * from, which starts with an inline buffer (so most images never
+     * touch the heap), and is released at once when the image changes. */
+    alignas(std::max_align_t) std::byte arena_buffer[IMAGE_ARENA_BYTES];
+    std::pmr::monotonic_buffer_resource image_arena{arena_buffer, IMAGE_ARENA_BYTES};
 
 private:
     /* During the period that each image is being annotated,
      * each individual bounding box coordinates as well as its
-     * relevant label will be stored in this vector. */
-    std::vector<std::tuple<const char*, std::vector<int>>> bounding_boxes;
+     * relevant label will be stored in this vector (which
+     * is allocated from the image's arena). */
+    std::pmr::vector<std::tuple<const char*, std::pmr::vector<int>>> bounding_boxes{&image_arena};
 
 public:
     /**
      * Initializes the class with the chosen
      * event handling mode.
      * @param mode_choice: The mode of choice.
+     * @param class_list: The labels to annotate for.
+     * @param window: The name of the window to create.
      */
     explicit AnnotationHandler(const char* mode_choice,
-                               const std::vector<std::string>& class_list);
+                               const std::vector<std::string>& class_list,
+                               const std::string& window = DEFAULT_WINDOW_NAME);
+
+    ~AnnotationHandler();
 
     /**
      * Create an annotation session involving the
      * provided image path.
+     * @param image_path: The path to the image.
+     * @param initial_boxes: Any bounding boxes which
+     * have already been drawn on the image.
+     * @param decoded_image: The image, if it has already
+     * been decoded, otherwise it is loaded from the path.
+     * @param proposals: Proposed bounding boxes (e.g., from
+     * a model), which are added to the image once ready.
+     * @return One of the `AnnotationResult` values.
+     */
+    int annotate(const char* image_path,
+                 const std::vector<std::tuple<const char*,
+                         std::vector<int>>>& initial_boxes = {},
+                 const cv::Mat& decoded_image = cv::Mat(),
+                 const std::shared_future<std::vector<std::tuple<
+                         const char*, std::vector<int>>>>& proposals = {});
+
+    /**
+     * Starts annotating an image, without waiting for any keys (so that
+     * several windows can be driven from one loop). The arguments are
+     * the same as those of `annotate`.
+     */
+    void open_image(const char* image_path,
+                    const std::vector<std::tuple<const char*,
+                            std::vector<int>>>& initial_boxes = {},
+                    const cv::Mat& decoded_image = cv::Mat(),
+                    const std::shared_future<std::vector<std::tuple<
+                            const char*, std::vector<int>>>>& proposals = {});
+
+    /**
+     * Conducts the annotation session for the image which was opened,
+     * handling the keys until the user is finished with it.
+     * @return One of the `AnnotationResult` values.
+     */
+    int wait_for_result();
+
+    /**
+     * Displays the canvas, but only if it has changed since it was
+     * last displayed (the window is updated by the next `waitKey`).
+     * @return Whether a new frame was displayed.
+     */
+    bool show_changes();
+
+    /**
+     * Applies any background work which has finished for the current
+     * image (e.g., the full-resolution decode), and then handles a key.
+     * @param key: The key which was pressed, or -1 if there is none.
+     * @return One of the `AnnotationResult` values, which is
+     * `ANNOTATION_PENDING` until the image is finished with.
+     */
+    int handle_key(int key);
+
+    /**
+     * Returns the name of the handler's window.
+     */
+    const std::string& get_window_name() const {
+        return window_name;
+    }
+
+    /**
+     * Closes the handler's window (e.g., once there are no more images
+     * for it), which is opened again if another image is opened.
      */
-    int annotate(const char* image_path);
+    void close_window();
+
+    /**
+     * Returns the handler whose window the mouse pointer was last
+     * over, or a nullptr if it has not been over any of them.
+     */
+    static AnnotationHandler* get_pointer_window() {
+        return pointer_window;
+    }
 
     /**
      * Returns the bounding box annotation positions
      * from the image annotation session.
      */
-    std::vector<std::tuple<const char*, std::vector<int>>> get_bounding_boxes() {
-        return bounding_boxes;
+    std::vector<std::tuple<const char*, std::vector<int>>> get_bounding_boxes() const;
+
+    /**
+     * Returns the full-resolution image which was annotated, or an
+     * empty image if only a preview of it was ever decoded.
+     */
+    cv::Mat get_image() const {
+        return (source_scale == 1) ? image_cache : cv::Mat();
+    }
+
+    /**
+     * Finds the label in the vocabulary matching a string.
+     * @return The label, or a nullptr if it does not exist.
+     */
+    const char* find_label(const std::string& label) const;
+
+    /**
+     * Sets the file size at which images are loaded progressively.
+     * @param threshold: The size in bytes, or zero to disable.
+     */
+    void set_progressive_threshold(uintmax_t threshold) {
+        progressive_threshold = threshold;
+    }
+
+    /**
+     * Sets the function which is used to load images in the
+     * background (e.g., through a shared loading pipeline).
+     * @param loader: Returns a future holding the decoded image.
+     */
+    void set_image_loader(std::function<std::shared_future<cv::Mat>(const std::string&)> loader) {
+        image_loader = std::move(loader);
+    }
+
+    /**
+     * Sets the function which is used to refine each
+     * drawn box in the background (e.g., edge snapping).
+     * @param refiner: Returns a future holding the refined box.
+     */
+    void set_box_refiner(std::function<std::shared_future<std::vector<int>>(
+            const cv::Mat&, const std::vector<int>&)> refiner) {
+        box_refiner = std::move(refiner);
+    }
+
+    /**
+     * Sets the recording which the session's events are written to.
+     * @param event_recorder: The recording.
+     */
+    void set_event_recorder(std::shared_ptr<EventRecorder> event_recorder) {
+        recorder = std::move(event_recorder);
+    }
+
+    /**
+     * Sets a recorded session to replay instead of the user's events.
+     * @param event_replayer: The recorded session.
+     */
+    void set_event_replayer(std::shared_ptr<EventReplayer> event_replayer) {
+        replayer = std::move(event_replayer);
+    }
+
+    /**
+     * Sets the maximum size of the window, which larger
+     * images are scaled down to fit inside of.
+     * @param size: The maximum window size.
+     */
+    void set_window_size(const cv::Size& size) {
+        window_size = size;
     }
 
 private:
+    /**
+     * Creates the window and registers this handler for its mouse events.
+     */
+    void create_window();
+
+    /**
+     * Loads an image for annotation. Large images are
+     * returned as a reduced-resolution preview, and the
+     * full image is decoded in the background.
+     */
+    cv::Mat load_image(const char* image_path);
+
+    /**
+     * Replaces the preview with the full-resolution image once it
+     * has been decoded, remapping any boxes drawn in the meantime.
+     */
+    void swap_in_full_image();
+
+    /**
+     * Computes the scale which fits the current image into the
+     * window, and renders the scaled view which is displayed.
+     */
+    void update_display_transform();
+
+    /**
+     * Maps a point in the window to full-resolution image coordinates.
+     */
+    cv::Point to_source(int x, int y) const;
+
+    /**
+     * Maps a point in full-resolution image coordinates to the window.
+     */
+    cv::Point to_display(int x, int y) const;
+
+    /**
+     * Adds the proposed bounding boxes to the image.
+     */
+    void add_proposals();
+
+    /**
+     * Replaces the drawn boxes with their refined versions once they
+     * are ready, or waits for all of them if `wait` is set.
+     */
+    void apply_refinements(bool wait);
+
+    /**
+     * Removes the most recent bounding box (or the box in progress).
+     */
+    void undo_bounding_box();
+
+    /**
+     * Rebuilds the canvas, redrawing the buttons and annotations.
+     */
+    void redraw_canvas();
+
+    /**
+     * Draws all of the current bounding boxes onto the image.
+     */
+    void draw_annotations();
+
     /**
      * Update the current image and class settings in
      * order to transition between stages.
@@ -126,6 +465,19 @@ private:
      */
     void update_bounding_boxes();
 
+    /**
+     * Adds a bounding box (allocated from the image's arena).
+     * @param label: The label of the box.
+     * @param box: The coordinates of the box.
+     */
+    void add_bounding_box(const char* label, const std::vector<int>& box);
+
+    /**
+     * Removes all of the bounding boxes, and releases everything
+     * allocated from the arena for the previous image.
+     */
+    void reset_image_arena();
+
     /**
      * Initializes the image with a set of buttons which
      * can be "clicked" to choose different labels.
@@ -135,10 +487,26 @@ private:
     /**
      * Similar to the above method `add_buttons_to_image`,
      * however this is used as an update method as opposed
-     * to an initialization method, so it retains all of
-     * the different bounding boxes when called.
+     * to an initialization method, so it only restores the
+     * un-pressed tile of a single button on the image.
+     */
+    void clear_button(int index);
+
+    /**
+     * Copies the strip of buttons for the current page onto the image.
+     */
+    void draw_button_strip();
+
+    /**
+     * Returns the pre-rendered strip of buttons for a certain
+     * page and button width, rendering it if necessary.
+     */
+    const ButtonStrip& get_button_strip(int page, int button_width);
+
+    /**
+     * Draws a label onto an individual button tile.
      */
-    void clear_buttons();
+    void render_button_label(cv::Mat3b tile, const std::string& label, int index);
 
     /**
      * A static wrapper method for the primary dispatch
@@ -148,6 +516,25 @@ private:
      */
     static void dispatch_handler(int event, int x, int y, int flags, void* param);
 
+    /**
+     * Handles a mouse event (from the user, or from a replayed
+     * session), recording it if the session is being recorded.
+     */
+    void handle_mouse_event(int event, int x, int y, int flags);
+
+    /**
+     * Waits briefly for the next key (which is recorded), or takes the
+     * next events from the replayed session (handling its mouse events).
+     * @param displayed: Whether a new frame was just displayed.
+     * @return The key, or -1 if there is none.
+     */
+    int next_key(bool displayed);
+
+    /**
+     * Returns the kind of interaction which a key is, for recording.
+     */
+    EventCategory classify_key(int key) const;
+
     /**
      * This is a method accessed by `dispatch_handler`,
      * but rather than corresponding to a certain mode,
@@ -175,10 +562,37 @@ private:
      */
     void update_button_animations(int new_index);
 
+    /**
+     * Chooses a new label, moving to its page if necessary.
+     */
+    void select_label(int index);
+
+    /**
+     * Switches the button bar to a different page of labels.
+     */
+    void change_page(int page);
+
+    /**
+     * Handles the number and letter hotkeys which choose labels.
+     * @return Whether the key was a label hotkey.
+     */
+    bool handle_label_hotkey(int key);
+
+    /**
+     * Handles a key press while the typeahead picker is open.
+     */
+    void handle_typeahead_key(int key);
+
+    /**
+     * Displays the typeahead query and its matches in the window title.
+     */
+    void update_window_title();
+
     /**
      * Calculates the text coordinates on a button.
      */
-    static std::vector<int> calculate_text_coordinates(const cv::Rect& button, const char* label);
+    static cv::Point calculate_text_coordinates(const cv::Rect& button,
+                                                const char* label, double scale);
 
 };
 
@@ -0,0 +1,134 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "labels.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+#include "../system/error.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Converts a string to lowercase for case-insensitive lookups.
+ */
+static string to_lower(const string& value) {
+    string lowered(value);
+    transform(lowered.begin(), lowered.end(), lowered.begin(),
+              [](unsigned char c) { return tolower(c); });
+    return lowered;
+}
+
+LabelVocabulary::LabelVocabulary(const std::vector<std::string>& class_list) {
+    // There must be at least one label to annotate with.
+    if (class_list.empty()) {
+        const char* msg = "At least one class label must be provided.";
+        error_exit(msg);
+    }
+    this->label_list = class_list;
+
+    // Generate the colors for each of the labels.
+    this->palette = LabelVocabulary::generate_palette((int)class_list.size());
+
+    // Build the sorted index which is used for prefix lookups.
+    this->sorted_index.reserve(class_list.size());
+    for (int i = 0; i < (int)class_list.size(); ++i) {
+        this->sorted_index.emplace_back(to_lower(class_list[i]), i);
+    }
+    sort(this->sorted_index.begin(), this->sorted_index.end());
+
+    // Map each of the labels to its index.
+    for (int i = 0; i < (int)class_list.size(); ++i) {
+        this->label_indexes.emplace(class_list[i], i);
+    }
+}
+
+int LabelVocabulary::index_of(const std::string& label) const {
+    auto it = this->label_indexes.find(label);
+    return (it == this->label_indexes.end()) ? -1 : it->second;
+}
+
+std::vector<int> LabelVocabulary::find_prefix(const std::string& prefix, int limit) const {
+    // Find the first label which is not less than the prefix,
+    // since all matches are then stored contiguously after it.
+    string lowered = to_lower(prefix);
+    auto it = lower_bound(this->sorted_index.begin(), this->sorted_index.end(),
+                          make_pair(lowered, -1));
+
+    // Collect matches until one no longer starts with the prefix.
+    vector<int> matches;
+    for (; it != this->sorted_index.end() && matches.size() < (size_t)limit; ++it) {
+        if (it->first.compare(0, lowered.size(), lowered) != 0)
+            break;
+        matches.push_back(it->second);
+    }
+
+    // Return the matching label indexes.
+    return matches;
+}
+
+int LabelVocabulary::next_with_initial(char letter, int current) const {
+    // Get the range of labels starting with the letter.
+    string prefix(1, (char)tolower(letter));
+    auto first = lower_bound(this->sorted_index.begin(), this->sorted_index.end(),
+                             make_pair(prefix, -1));
+    auto last = first;
+    while (last != this->sorted_index.end() && last->first[0] == prefix[0])
+        ++last;
+
+    // If there are no labels starting with the letter, then exit.
+    if (first == last)
+        return -1;
+
+    // Otherwise, choose the label after the current one
+    // in the range, or wrap around to the first one.
+    for (auto it = first; it != last; ++it) {
+        if (it->second == current) {
+            return (it + 1 == last) ? first->second : (it + 1)->second;
+        }
+    }
+    return first->second;
+}
+
+std::vector<cv::Scalar> LabelVocabulary::generate_palette(int num_colors) {
+    // Create a pastel color for each label, stepping through
+    // the hues by the golden ratio conjugate so that they spread.
+    vector<Scalar> colors; colors.reserve(num_colors);
+    const double saturation = 0.3, value = 1.0;
+    for (int i = 0; i < num_colors; ++i) {
+        double hue = fmod(0.58 + i * 0.618033988749895, 1.0) * 6.0;
+
+        // Convert the HSV color into a BGR color.
+        int sector = (int)hue; double f = hue - sector;
+        double p = value * (1 - saturation);
+        double q = value * (1 - saturation * f);
+        double t = value * (1 - saturation * (1 - f));
+        double r, g, b;
+        switch (sector % 6) {
+            case 0: r = value; g = t; b = p; break;
+            case 1: r = q; g = value; b = p; break;
+            case 2: r = p; g = value; b = t; break;
+            case 3: r = p; g = q; b = value; break;
+            case 4: r = t; g = p; b = value; break;
+            default: r = value; g = p; b = q; break;
+        }
+        colors.emplace_back(b * 255, g * 255, r * 255);
+    }
+
+    // Return the generated colors.
+    return colors;
+}
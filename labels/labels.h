@@ -0,0 +1,104 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_LABELS_H
+#define ANNOTATION_LABELS_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+#include <opencv2/core.hpp>
+
+/**
+ * Holds the complete set of labels which can be
+ * annotated, alongside a color for each label and
+ * a sorted index which is used to look up labels
+ * by a typed prefix (for the typeahead picker).
+ *
+ * The labels are never modified after construction,
+ * so pointers to the label strings remain valid for
+ * the lifetime of the vocabulary.
+ */
+class LabelVocabulary {
+private:
+    /* The labels, in the order that they were provided. */
+    std::vector<std::string> label_list;
+
+    /* A generated color for each of the labels. */
+    std::vector<cv::Scalar> palette;
+
+    /* The lowercase labels alongside their original index,
+     * sorted so that prefixes can be binary searched. */
+    std::vector<std::pair<std::string, int>> sorted_index;
+
+    /* A mapping from each label to its index. */
+    std::unordered_map<std::string, int> label_indexes;
+
+public:
+    /**
+     * Builds the vocabulary from a list of labels.
+     * @param class_list: The list of labels.
+     */
+    explicit LabelVocabulary(const std::vector<std::string>& class_list);
+
+    /**
+     * Returns the number of labels in the vocabulary.
+     */
+    int size() const { return (int)label_list.size(); }
+
+    /**
+     * Returns the label at a certain index.
+     */
+    const std::string& label(int index) const { return label_list[index]; }
+
+    /**
+     * Returns the color for the label at a certain index.
+     */
+    const cv::Scalar& color(int index) const { return palette[index]; }
+
+    /**
+     * Returns the index of a label, or -1 if it does not exist.
+     */
+    int index_of(const std::string& label) const;
+
+    /**
+     * Finds the labels which start with a certain prefix
+     * (case-insensitive), in alphabetical order.
+     * @param prefix: The prefix to search for.
+     * @param limit: The maximum number of matches to return.
+     * @return The indexes of the matching labels.
+     */
+    std::vector<int> find_prefix(const std::string& prefix, int limit) const;
+
+    /**
+     * Finds the next label (in alphabetical order, and
+     * wrapping around) which starts with a certain letter.
+     * @param letter: The letter to search for.
+     * @param current: The index of the current label.
+     * @return The index of the label, or -1 if none exist.
+     */
+    int next_with_initial(char letter, int current) const;
+
+private:
+    /**
+     * Generates a color for each of the labels, spacing the
+     * hues using the golden ratio so neighbouring labels
+     * stay distinguishable no matter how many there are.
+     */
+    static std::vector<cv::Scalar> generate_palette(int num_colors);
+};
+
+#endif //ANNOTATION_LABELS_H
@@ -0,0 +1,246 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "pipeline.h"
+
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../system/paths.h"
+
+using namespace std;
+using namespace cv;
+using Clock = std::chrono::steady_clock;
+
+ImageLoadPipeline::ImageLoadPipeline(int io_thread_count, int io_depth,
+                                     int decode_thread_count, int decode_depth,
+                                     std::shared_ptr<SharedImageCache> shared)
+                                     : io_queue_depth(max(1, io_depth)),
+                                       decode_queue_depth(max(1, decode_depth)),
+                                       shared_cache(std::move(shared)) {
+    // Use the number of hardware threads for decoding by default.
+    if (decode_thread_count <= 0) {
+        decode_thread_count = (int)max(1u, thread::hardware_concurrency());
+    }
+
+    // Start the threads for each of the stages.
+    for (int i = 0; i < max(1, io_thread_count); ++i) {
+        this->io_threads.emplace_back(&ImageLoadPipeline::io_loop, this);
+    }
+    for (int i = 0; i < decode_thread_count; ++i) {
+        this->decode_threads.emplace_back(&ImageLoadPipeline::decode_loop, this);
+    }
+}
+
+ImageLoadPipeline::~ImageLoadPipeline() {
+    // Tell the threads to exit.
+    {
+        lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->io_available.notify_all();
+    this->io_space.notify_all();
+    this->decode_available.notify_all();
+    this->decode_space.notify_all();
+
+    // Wait for each of the threads to exit.
+    for (auto& worker: this->io_threads) {
+        worker.join();
+    }
+    for (auto& worker: this->decode_threads) {
+        worker.join();
+    }
+}
+
+std::shared_future<cv::Mat> ImageLoadPipeline::request(const std::string& path, int flags) {
+    unique_lock<std::mutex> lock(this->mutex);
+
+    // If the image is already being loaded, then share that result.
+    string key = path + "#" + to_string(flags);
+    auto existing = this->in_flight.find(key);
+    if (existing != this->in_flight.end())
+        return existing->second;
+
+    // Wait for space in the I/O queue.
+    this->io_space.wait(lock, [this]() {
+        return this->stopping || this->io_queue.size() < this->io_queue_depth; });
+
+    // Add the request to the I/O queue.
+    auto result = make_shared<promise<Mat>>();
+    shared_future<Mat> future = result->get_future().share();
+    this->in_flight[key] = future;
+    this->io_queue.push_back(LoadRequest {path, flags, result, {}, Clock::now()});
+    this->io_available.notify_one();
+    return future;
+}
+
+void ImageLoadPipeline::io_loop() {
+    while (true) {
+        // Wait for a request, and take a buffer from the pool for it.
+        LoadRequest request;
+        {
+            unique_lock<std::mutex> lock(this->mutex);
+            this->io_available.wait(lock, [this]() {
+                return this->stopping || !this->io_queue.empty(); });
+            if (this->stopping)
+                return;
+            request = std::move(this->io_queue.front());
+            this->io_queue.pop_front();
+            if (!this->buffer_pool.empty()) {
+                request.buffer = std::move(this->buffer_pool.back());
+                this->buffer_pool.pop_back();
+            }
+        }
+        this->io_space.notify_one();
+
+        // Attach the image from the shared cache if this version of it has
+        // already been decoded (by any process), returning the unused buffer.
+        Clock::time_point started = Clock::now();
+        if (this->shared_cache) {
+            request.modified = file_mtime(request.path);
+            Mat shared = this->shared_cache->find(request.path, request.modified, request.flags);
+            if (!shared.empty()) {
+                lock_guard<std::mutex> lock(this->mutex);
+                ImageLoadPipeline::record(this->shared_stats, request.queued,
+                                          started, shared.total() * shared.elemSize());
+                if (request.buffer.capacity() > 0)
+                    this->buffer_pool.emplace_back(std::move(request.buffer));
+                this->in_flight.erase(request.path + "#" + to_string(request.flags));
+                request.result->set_value(shared);
+                continue;
+            }
+        }
+
+        // Read the raw bytes of the file into the buffer.
+        bool success = ImageLoadPipeline::read_file(request.path, request.buffer);
+
+        unique_lock<std::mutex> lock(this->mutex);
+        ImageLoadPipeline::record(this->io_stats, request.queued, started, request.buffer.size());
+
+        // If the file couldn't be read, then finish the request.
+        if (!success) {
+            request.result->set_value(Mat());
+            this->in_flight.erase(request.path + "#" + to_string(request.flags));
+            continue;
+        }
+
+        // Otherwise, wait for space in the decode queue and pass it on.
+        this->decode_space.wait(lock, [this]() {
+            return this->stopping || this->decode_queue.size() < this->decode_queue_depth; });
+        if (this->stopping)
+            return;
+        request.queued = Clock::now();
+        this->decode_queue.push_back(std::move(request));
+        this->decode_available.notify_one();
+    }
+}
+
+void ImageLoadPipeline::decode_loop() {
+    while (true) {
+        // Wait for a buffer to decode.
+        LoadRequest request;
+        {
+            unique_lock<std::mutex> lock(this->mutex);
+            this->decode_available.wait(lock, [this]() {
+                return this->stopping || !this->decode_queue.empty(); });
+            if (this->stopping)
+                return;
+            request = std::move(this->decode_queue.front());
+            this->decode_queue.pop_front();
+        }
+        this->decode_space.notify_one();
+
+        // Decode the buffer in place (the header doesn't copy the bytes).
+        Clock::time_point started = Clock::now();
+        Mat encoded(1, (int)request.buffer.size(), CV_8UC1, request.buffer.data());
+        Mat image;
+        try {
+            image = imdecode(encoded, request.flags);
+        } catch (const cv::Exception& e) {
+            image = Mat();
+        }
+
+        // Record the timing, return the buffer to the pool, and finish.
+        {
+            lock_guard<std::mutex> lock(this->mutex);
+            ImageLoadPipeline::record(this->decode_stats, request.queued,
+                                      started, request.buffer.size());
+            if (this->buffer_pool.size() < this->io_threads.size() + this->decode_queue_depth) {
+                this->buffer_pool.emplace_back(std::move(request.buffer));
+            }
+            this->in_flight.erase(request.path + "#" + to_string(request.flags));
+        }
+        request.result->set_value(image);
+
+        // Share the image with the other processes on the host.
+        if (this->shared_cache && !image.empty())
+            this->shared_cache->put(request.path, request.modified, request.flags, image);
+    }
+}
+
+bool ImageLoadPipeline::read_file(const std::string& path, std::vector<uchar>& buffer) {
+    // Open the file and get its size.
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat buf{};
+    if (fstat(fd, &buf) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // Read the complete file, reusing the buffer's existing capacity.
+    buffer.resize((size_t)buf.st_size);
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+        ssize_t count = pread(fd, buffer.data() + offset, buffer.size() - offset, (off_t)offset);
+        if (count <= 0)
+            break;
+        offset += (size_t)count;
+    }
+    close(fd);
+    buffer.resize(offset);
+    return offset > 0;
+}
+
+void ImageLoadPipeline::record(StageStats& stats, Clock::time_point queued,
+                               Clock::time_point started, size_t bytes) {
+    double work = chrono::duration<double>(Clock::now() - started).count();
+    stats.count += 1;
+    stats.queue_seconds += chrono::duration<double>(started - queued).count();
+    stats.work_seconds += work;
+    stats.max_work_seconds = max(stats.max_work_seconds, work);
+    stats.bytes += bytes;
+}
+
+void ImageLoadPipeline::print_stats() {
+    lock_guard<std::mutex> lock(this->mutex);
+    auto print_stage = [](const char* name, const StageStats& stats, size_t threads) {
+        if (stats.count == 0)
+            return;
+        printf("%-7s %zu threads, %zu images, %.1f MB: %.2f ms average (%.2f ms max), "
+               "%.2f ms average queue wait\n", name, threads, stats.count, stats.bytes / 1e6,
+               1000 * stats.work_seconds / stats.count, 1000 * stats.max_work_seconds,
+               1000 * stats.queue_seconds / stats.count);
+    };
+    print_stage("Read:", this->io_stats, this->io_threads.size());
+    print_stage("Decode:", this->decode_stats, this->decode_threads.size());
+    print_stage("Shared:", this->shared_stats, this->io_threads.size());
+    if (this->shared_cache) {
+        printf("Shared cache: %.1f MB used by all processes\n", this->shared_cache->size_bytes() / 1e6);
+    }
+}
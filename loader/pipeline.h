@@ -0,0 +1,181 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_PIPELINE_H
+#define ANNOTATION_PIPELINE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "../cache/sharedcache.h"
+
+/**
+ * Timing statistics for one stage of the pipeline.
+ */
+struct StageStats {
+    /* The number of items which the stage has processed. */
+    size_t count = 0;
+
+    /* The total time spent waiting in the stage's queue,
+     * and the total and maximum time spent processing. */
+    double queue_seconds = 0;
+    double work_seconds = 0;
+    double max_work_seconds = 0;
+
+    /* The total number of bytes processed by the stage. */
+    size_t bytes = 0;
+};
+
+/**
+ * Loads images in two separate stages, so that slow storage
+ * and decoding don't serialize each other:
+ *
+ * 1. The I/O stage reads the raw bytes of each file into
+ *    a buffer taken from a pool of reusable buffers.
+ * 2. The decode stage decodes those buffers in memory
+ *    using `cv::imdecode`, then returns them to the pool.
+ *
+ * Each stage has its own threads and bounded queue, so many
+ * reads can be kept in flight on high-latency network storage
+ * while the number of decoding threads matches the CPU cores.
+ * When the decode queue is full, the I/O threads wait, which
+ * bounds the memory held in buffers that are waiting to decode.
+ *
+ * With a shared image cache, the I/O stage first checks whether
+ * another process on the host has already decoded the image, and
+ * the decode stage adds the images it decodes to the cache.
+ */
+class ImageLoadPipeline {
+private:
+    /* An image which is moving through the pipeline. */
+    struct LoadRequest {
+        std::string path;
+        int flags;
+        std::shared_ptr<std::promise<cv::Mat>> result;
+        std::vector<uchar> buffer;
+        std::chrono::steady_clock::time_point queued;
+        int64_t modified = -1;
+    };
+
+    /* The queues for each of the stages, and their maximum depths. */
+    std::deque<LoadRequest> io_queue;
+    std::deque<LoadRequest> decode_queue;
+    size_t io_queue_depth;
+    size_t decode_queue_depth;
+
+    /* The buffers which can be reused for reading files. */
+    std::vector<std::vector<uchar>> buffer_pool;
+
+    /* The requests which are in the pipeline, so that requesting
+     * the same image twice doesn't load it twice. */
+    std::unordered_map<std::string, std::shared_future<cv::Mat>> in_flight;
+
+    /* The decoded images shared with the other processes, if enabled. */
+    std::shared_ptr<SharedImageCache> shared_cache;
+
+    /* The timing statistics for each of the stages, and
+     * for the images found in the shared cache. */
+    StageStats io_stats;
+    StageStats decode_stats;
+    StageStats shared_stats;
+
+    /* Synchronizes access to all of the above state. */
+    std::mutex mutex;
+    std::condition_variable io_available;
+    std::condition_variable io_space;
+    std::condition_variable decode_available;
+    std::condition_variable decode_space;
+
+    /* The threads for each of the stages. */
+    std::vector<std::thread> io_threads;
+    std::vector<std::thread> decode_threads;
+
+    /* Whether the pipeline is shutting down. */
+    bool stopping = false;
+
+public:
+    /**
+     * Starts the threads for each of the stages.
+     * @param io_thread_count: The number of I/O threads.
+     * @param io_depth: The maximum number of queued reads.
+     * @param decode_thread_count: The number of decoding threads,
+     * or zero to use the number of hardware threads.
+     * @param decode_depth: The maximum number of read buffers
+     * waiting to be decoded.
+     * @param shared: The image cache shared with the other
+     * processes on the host, or a nullptr to not share images.
+     */
+    ImageLoadPipeline(int io_thread_count, int io_depth,
+                      int decode_thread_count, int decode_depth,
+                      std::shared_ptr<SharedImageCache> shared = nullptr);
+
+    /**
+     * Stops the pipeline, dropping any queued requests.
+     */
+    ~ImageLoadPipeline();
+
+    ImageLoadPipeline(const ImageLoadPipeline&) = delete;
+    ImageLoadPipeline& operator=(const ImageLoadPipeline&) = delete;
+
+    /**
+     * Requests that an image be loaded. This blocks only if
+     * the I/O queue is full.
+     * @param path: The path to the image.
+     * @param flags: The `cv::imread` flags to decode with.
+     * @return A future holding the decoded image, which is
+     * empty if the image could not be read or decoded.
+     */
+    std::shared_future<cv::Mat> request(const std::string& path, int flags = cv::IMREAD_COLOR);
+
+    /**
+     * Prints the timing statistics for each of the stages.
+     */
+    void print_stats();
+
+private:
+    /**
+     * The loop which is run by each of the I/O threads.
+     */
+    void io_loop();
+
+    /**
+     * The loop which is run by each of the decoding threads.
+     */
+    void decode_loop();
+
+    /**
+     * Reads a complete file into a buffer.
+     * @return Whether the file was read successfully.
+     */
+    static bool read_file(const std::string& path, std::vector<uchar>& buffer);
+
+    /**
+     * Adds the timing of one item to a stage's statistics.
+     */
+    static void record(StageStats& stats, std::chrono::steady_clock::time_point queued,
+                       std::chrono::steady_clock::time_point started, size_t bytes);
+};
+
+#endif //ANNOTATION_PIPELINE_H
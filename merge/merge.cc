@@ -0,0 +1,211 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "merge.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+void BoxSet::add(const std::vector<int>& box) {
+    float left = (float)min(box[0], box[2]), right = (float)max(box[0], box[2]);
+    float top = (float)min(box[1], box[3]), bottom = (float)max(box[1], box[3]);
+    this->x1.push_back(left);
+    this->y1.push_back(top);
+    this->x2.push_back(right);
+    this->y2.push_back(bottom);
+    this->area.push_back((right - left + 1) * (bottom - top + 1));
+}
+
+void BoxSet::reserve(size_t count) {
+    this->x1.reserve(count);
+    this->y1.reserve(count);
+    this->x2.reserve(count);
+    this->y2.reserve(count);
+    this->area.reserve(count);
+}
+
+void iou_row_scalar(const BoxSet& boxes, size_t i, size_t begin, size_t end, float* out) {
+    const float x1 = boxes.x1[i], y1 = boxes.y1[i];
+    const float x2 = boxes.x2[i], y2 = boxes.y2[i];
+    const float area = boxes.area[i];
+    for (size_t j = begin; j < end; j++) {
+        float w = max(0.0f, min(x2, boxes.x2[j]) - max(x1, boxes.x1[j]) + 1.0f);
+        float h = max(0.0f, min(y2, boxes.y2[j]) - max(y1, boxes.y1[j]) + 1.0f);
+        float intersection = w * h;
+        out[j - begin] = intersection / (area + boxes.area[j] - intersection);
+    }
+}
+
+void iou_row(const BoxSet& boxes, size_t i, size_t begin, size_t end, float* out) {
+    size_t j = begin;
+#if defined(__SSE2__)
+    // Compare against four boxes at a time, with the same
+    // arithmetic as the scalar version (so the results match).
+    const __m128 x1 = _mm_set1_ps(boxes.x1[i]), y1 = _mm_set1_ps(boxes.y1[i]);
+    const __m128 x2 = _mm_set1_ps(boxes.x2[i]), y2 = _mm_set1_ps(boxes.y2[i]);
+    const __m128 area = _mm_set1_ps(boxes.area[i]);
+    const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    for (; j + 4 <= end; j += 4) {
+        __m128 w = _mm_add_ps(_mm_sub_ps(_mm_min_ps(x2, _mm_loadu_ps(&boxes.x2[j])),
+                                         _mm_max_ps(x1, _mm_loadu_ps(&boxes.x1[j]))), one);
+        __m128 h = _mm_add_ps(_mm_sub_ps(_mm_min_ps(y2, _mm_loadu_ps(&boxes.y2[j])),
+                                         _mm_max_ps(y1, _mm_loadu_ps(&boxes.y1[j]))), one);
+        __m128 intersection = _mm_mul_ps(_mm_max_ps(w, zero), _mm_max_ps(h, zero));
+        __m128 total = _mm_sub_ps(_mm_add_ps(area, _mm_loadu_ps(&boxes.area[j])), intersection);
+        _mm_storeu_ps(out + (j - begin), _mm_div_ps(intersection, total));
+    }
+#elif defined(__aarch64__)
+    const float32x4_t x1 = vdupq_n_f32(boxes.x1[i]), y1 = vdupq_n_f32(boxes.y1[i]);
+    const float32x4_t x2 = vdupq_n_f32(boxes.x2[i]), y2 = vdupq_n_f32(boxes.y2[i]);
+    const float32x4_t area = vdupq_n_f32(boxes.area[i]);
+    const float32x4_t one = vdupq_n_f32(1.0f), zero = vdupq_n_f32(0.0f);
+    for (; j + 4 <= end; j += 4) {
+        float32x4_t w = vaddq_f32(vsubq_f32(vminq_f32(x2, vld1q_f32(&boxes.x2[j])),
+                                            vmaxq_f32(x1, vld1q_f32(&boxes.x1[j]))), one);
+        float32x4_t h = vaddq_f32(vsubq_f32(vminq_f32(y2, vld1q_f32(&boxes.y2[j])),
+                                            vmaxq_f32(y1, vld1q_f32(&boxes.y1[j]))), one);
+        float32x4_t intersection = vmulq_f32(vmaxq_f32(w, zero), vmaxq_f32(h, zero));
+        float32x4_t total = vsubq_f32(vaddq_f32(area, vld1q_f32(&boxes.area[j])), intersection);
+        vst1q_f32(out + (j - begin), vdivq_f32(intersection, total));
+    }
+#endif
+    // Handle the remaining boxes (or all of them, without SIMD).
+    iou_row_scalar(boxes, i, j, end, out + (j - begin));
+}
+
+size_t merge_boxes(std::vector<std::tuple<const char*, std::vector<int>>>& boxes,
+                   const std::string& policy, float threshold) {
+    if (policy == "none" || boxes.size() < 2)
+        return 0;
+
+    // Group the boxes by their label, since only boxes with
+    // the same label can be duplicates of each other.
+    unordered_map<const char*, vector<size_t>> groups;
+    for (size_t i = 0; i < boxes.size(); i++) {
+        groups[std::get<0>(boxes[i])].push_back(i);
+    }
+
+    vector<char> removed(boxes.size(), 0);
+    vector<float> overlaps;
+    for (const auto& group: groups) {
+        const vector<size_t>& members = group.second;
+        size_t n = members.size();
+        if (n < 2)
+            continue;
+
+        // Store the boxes sorted by their left edge, so that the only
+        // boxes which can overlap a box are a contiguous range of them.
+        vector<pair<int, size_t>> edges(n);
+        for (size_t k = 0; k < n; k++) {
+            const std::vector<int>& box = std::get<1>(boxes[members[k]]);
+            edges[k] = make_pair(min(box[0], box[2]), k);
+        }
+        sort(edges.begin(), edges.end());
+        BoxSet set;
+        set.reserve(n);
+        vector<size_t> order(n), position(n);
+        float max_width = 0.0f;
+        for (size_t k = 0; k < n; k++) {
+            order[k] = edges[k].second;
+            position[order[k]] = k;
+            set.add(std::get<1>(boxes[members[order[k]]]));
+            max_width = max(max_width, set.x2[k] - set.x1[k]);
+        }
+
+        // Visit the boxes in their original order, where each kept
+        // box absorbs all of the later duplicates of it.
+        vector<char> absorbed(n, 0);
+        overlaps.resize(n);
+        for (size_t m = 0; m < n; m++) {
+            if (absorbed[m])
+                continue;
+            // Find the range of boxes which can overlap this one horizontally.
+            // The IoU is at most the overlapping width over the width of
+            // either box, so a duplicate can't start more than a fraction
+            // (1 - t) / t of this box's width before it, or end with less
+            // than t of its width overlapping (with a pixel to spare).
+            size_t i = position[m];
+            float first = set.x1[i] - max_width, last = set.x2[i];
+            if (threshold > 0.0f) {
+                float width = set.x2[i] - set.x1[i] + 1.0f;
+                first = max(first, set.x1[i] - width * (1.0f - threshold) / threshold - 1.0f);
+                last = min(last, set.x2[i] + 2.0f - threshold * width);
+            }
+            // The range is walked out from the box itself rather than binary
+            // searched, since it is short and the walk doesn't mispredict.
+            size_t begin = i, end = i + 1;
+            while (begin > 0 && set.x1[begin - 1] >= first)
+                begin--;
+            while (end < n && set.x1[end] <= last)
+                end++;
+            iou_row(set, i, begin, end, overlaps.data());
+            double sum[4] = {set.x1[i], set.y1[i], set.x2[i], set.y2[i]};
+            float bounds[4] = {set.x1[i], set.y1[i], set.x2[i], set.y2[i]};
+            int count = 1;
+            for (size_t j = begin; j < end; j++) {
+                if (overlaps[j - begin] <= threshold)
+                    continue;
+                size_t other = order[j];
+                if (other <= m || absorbed[other])
+                    continue;
+                absorbed[other] = 1;
+                removed[members[other]] = 1;
+                sum[0] += set.x1[j]; sum[1] += set.y1[j];
+                sum[2] += set.x2[j]; sum[3] += set.y2[j];
+                bounds[0] = min(bounds[0], set.x1[j]); bounds[1] = min(bounds[1], set.y1[j]);
+                bounds[2] = max(bounds[2], set.x2[j]); bounds[3] = max(bounds[3], set.y2[j]);
+                count++;
+            }
+            if (count == 1)
+                continue;
+
+            // Replace the kept box, depending on the policy.
+            std::vector<int>& box = std::get<1>(boxes[members[m]]);
+            if (policy == "average") {
+                for (int k = 0; k < 4; k++)
+                    box[k] = (int)lround(sum[k] / count);
+            } else if (policy == "union") {
+                for (int k = 0; k < 4; k++)
+                    box[k] = (int)bounds[k];
+            }
+        }
+    }
+
+    // Remove the boxes which were absorbed, keeping the order of the rest.
+    size_t kept = 0;
+    for (size_t i = 0; i < boxes.size(); i++) {
+        if (removed[i])
+            continue;
+        if (kept != i)
+            boxes[kept] = std::move(boxes[i]);
+        kept++;
+    }
+    size_t num_removed = boxes.size() - kept;
+    boxes.resize(kept);
+    return num_removed;
+}
+
+bool is_merge_policy(const std::string& policy) {
+    return policy == "none" || policy == "suppress" ||
+           policy == "average" || policy == "union";
+}
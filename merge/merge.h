@@ -0,0 +1,100 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_MERGE_H
+#define ANNOTATION_MERGE_H
+
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/**
+ * A set of bounding boxes stored as a structure of arrays (one
+ * array per coordinate), so that the overlap between one box and
+ * many others can be computed several boxes at a time.
+ *
+ * The coordinates are inclusive pixel positions, and each box
+ * is normalized so that its first corner is the top-left one.
+ */
+struct BoxSet {
+    std::vector<float> x1;
+    std::vector<float> y1;
+    std::vector<float> x2;
+    std::vector<float> y2;
+
+    /* The area of each box, which is computed once when it is added. */
+    std::vector<float> area;
+
+    /**
+     * Adds a box, given as [x1, y1, x2, y2] in any corner order.
+     */
+    void add(const std::vector<int>& box);
+
+    /**
+     * Reserves space for a number of boxes.
+     */
+    void reserve(size_t count);
+
+    /**
+     * Returns the number of boxes in the set.
+     */
+    size_t size() const { return area.size(); }
+};
+
+/**
+ * Computes the intersection over union between box `i` and each of
+ * the boxes in [begin, end), using SIMD instructions where available.
+ * @param boxes: The set of boxes.
+ * @param i: The index of the box to compare against.
+ * @param begin: The index of the first box to compare.
+ * @param end: The index after the last box to compare.
+ * @param out: Receives `end - begin` values.
+ */
+void iou_row(const BoxSet& boxes, size_t i, size_t begin, size_t end, float* out);
+
+/**
+ * The same as `iou_row`, but always using scalar code (which
+ * is used as the baseline that the SIMD version is checked against).
+ */
+void iou_row_scalar(const BoxSet& boxes, size_t i, size_t begin, size_t end, float* out);
+
+/**
+ * Merges the duplicate boxes in a set of annotations, where two
+ * boxes are duplicates if they have the same label and their
+ * intersection over union is above `threshold`. Boxes are visited
+ * in order, and each one which is kept absorbs all of the later
+ * duplicates of it, depending on the policy:
+ *
+ * - `none`: Keep all of the boxes.
+ * - `suppress`: Keep the first box, and remove its duplicates
+ *   (non-maximum suppression, with the order as the priority).
+ * - `average`: Replace the box with the average of it and its duplicates.
+ * - `union`: Replace the box with the bounding box of it and its duplicates.
+ *
+ * @param boxes: The labels and boxes, which are merged in place.
+ * @param policy: The name of the merge policy.
+ * @param threshold: The overlap above which boxes are duplicates.
+ * @return The number of boxes which were removed.
+ */
+size_t merge_boxes(std::vector<std::tuple<const char*, std::vector<int>>>& boxes,
+                   const std::string& policy, float threshold);
+
+/**
+ * Checks whether a merge policy is valid.
+ * @param policy: The name of the policy.
+ */
+bool is_merge_policy(const std::string& policy);
+
+#endif //ANNOTATION_MERGE_H
@@ -0,0 +1,327 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "prelabel.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <set>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "../system/error.h"
+
+using namespace std;
+using namespace cv;
+namespace fs = std::__fs::filesystem;
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Returns a percentile of a list of values (which is sorted in place).
+ */
+static double percentile(vector<double>& values, double fraction) {
+    if (values.empty())
+        return 0;
+    sort(values.begin(), values.end());
+    size_t index = min(values.size() - 1, (size_t)(fraction * (double)values.size()));
+    return values[index];
+}
+
+/**
+ * Decodes an image at the largest reduction which still covers the model
+ * input, since the image is shrunk to the input size anyway, and the JPEG
+ * codec scales while decoding (so this is many times faster for photos).
+ * @param path: The path to the image.
+ * @param input_size: The width and height of the model input.
+ * @param reduction: Receives the reduction the image was decoded at.
+ */
+static Mat decode_for_input(const string& path, int input_size, int& reduction) {
+    // Only JPEG images are scaled while decoding (others
+    // would be decoded in full and then resized anyway).
+    string extension = fs::path(path).extension().string();
+    transform(extension.begin(), extension.end(), extension.begin(),
+              [](unsigned char c) { return tolower(c); });
+    reduction = 1;
+    if (extension != ".jpg" && extension != ".jpeg")
+        return imread(path, IMREAD_COLOR);
+
+    // Try the largest reduction first, which covers the input for large photos.
+    Mat image = imread(path, IMREAD_REDUCED_COLOR_8);
+    if (image.empty() || max(image.cols, image.rows) >= input_size) {
+        reduction = 8;
+        return image;
+    }
+
+    // Otherwise, estimate the full size from it, and decode again
+    // at the largest reduction which still covers the input.
+    int full_length = max(image.cols, image.rows) * 8;
+    if (full_length / 4 >= input_size) {
+        reduction = 4;
+        return imread(path, IMREAD_REDUCED_COLOR_4);
+    }
+    if (full_length / 2 >= input_size) {
+        reduction = 2;
+        return imread(path, IMREAD_REDUCED_COLOR_2);
+    }
+    return imread(path, IMREAD_COLOR);
+}
+
+PreLabeler::PreLabeler(const std::string& model, std::vector<const char*> labels,
+                       int threads, int upcoming, int batch, int size, float threshold)
+                       : class_labels(std::move(labels)), model_path(model),
+                         input_size(size), score_threshold(threshold), nms_threshold(0.45f),
+                         batch_size(max(1, batch)), lookahead(max(1, upcoming)) {
+    // Check that the model can be loaded before starting the workers.
+    if (dnn::readNetFromONNX(this->model_path).empty()) {
+        string msg = "Could not load the pre-labeling model \'" + this->model_path + "\'";
+        error_exit(msg.c_str());
+    }
+
+    // Start each of the worker threads.
+    for (int i = 0; i < max(1, threads); ++i) {
+        this->workers.emplace_back(&PreLabeler::worker_loop, this);
+    }
+}
+
+PreLabeler::~PreLabeler() {
+    // Tell the workers to exit, then wait for them.
+    {
+        lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->work_available.notify_all();
+    for (auto& worker: this->workers) {
+        worker.join();
+    }
+
+    // Finish any requests which were never started.
+    for (auto& pending: this->promises) {
+        pending.second->set_value(Proposals());
+    }
+}
+
+void PreLabeler::schedule(const std::vector<std::string>& paths, int index) {
+    lock_guard<std::mutex> lock(this->mutex);
+
+    // Determine which images are near the current one.
+    int first = max(0, index - 1);
+    int last = min((int)paths.size(), index + this->lookahead);
+    set<string> window(paths.begin() + first, paths.begin() + last);
+
+    // Remove any queued images which are no longer upcoming (e.g.,
+    // after jumping to a different image), and any old results.
+    for (auto it = this->queue.begin(); it != this->queue.end();) {
+        if (window.count(*it) == 0) {
+            this->promises[*it]->set_value(Proposals());
+            this->promises.erase(*it);
+            this->results.erase(*it);
+            it = this->queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = this->results.begin(); it != this->results.end();) {
+        if (window.count(it->first) == 0 && this->promises.count(it->first) == 0) {
+            this->finished_at.erase(it->first);
+            it = this->results.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Queue the upcoming images, in order.
+    for (int i = index; i < last; ++i) {
+        this->enqueue(paths[i]);
+    }
+}
+
+std::shared_future<PreLabeler::Proposals> PreLabeler::request(const std::string& path) {
+    lock_guard<std::mutex> lock(this->mutex);
+
+    // Record how far ahead of the user the result was ready.
+    auto finished = this->finished_at.find(path);
+    if (finished != this->finished_at.end()) {
+        this->lead_ms.push_back(chrono::duration<double, milli>(
+                Clock::now() - finished->second).count());
+    } else {
+        this->lead_ms.push_back(0);
+    }
+    return this->enqueue(path);
+}
+
+std::shared_future<PreLabeler::Proposals> PreLabeler::enqueue(const std::string& path) {
+    // Return the existing result if the image was already queued.
+    auto existing = this->results.find(path);
+    if (existing != this->results.end())
+        return existing->second;
+
+    // Otherwise, add it to the queue.
+    auto result = make_shared<promise<Proposals>>();
+    shared_future<Proposals> future = result->get_future().share();
+    this->promises[path] = result;
+    this->results[path] = future;
+    this->queue.push_back(path);
+    this->work_available.notify_one();
+    return future;
+}
+
+void PreLabeler::worker_loop() {
+    // Each worker has its own copy of the network.
+    dnn::Net net = dnn::readNetFromONNX(this->model_path);
+    net.setPreferableBackend(dnn::DNN_BACKEND_OPENCV);
+    net.setPreferableTarget(dnn::DNN_TARGET_CPU);
+
+    while (true) {
+        // Wait for a batch of images to label.
+        vector<string> batch;
+        {
+            unique_lock<std::mutex> lock(this->mutex);
+            this->work_available.wait(lock, [this]() {
+                return this->stopping || !this->queue.empty(); });
+            if (this->stopping)
+                return;
+            while (!this->queue.empty() && batch.size() < (size_t)this->batch_size) {
+                batch.push_back(this->queue.front());
+                this->queue.pop_front();
+            }
+        }
+
+        // Decode each image (reduced, where the codec allows)
+        // and letterbox it into the model input size.
+        vector<Mat> inputs;
+        vector<double> scales;
+        vector<Size> sizes;
+        vector<string> decoded_paths;
+        vector<double> decode_times;
+        for (const auto& path: batch) {
+            Clock::time_point started = Clock::now();
+            int reduction;
+            Mat image = decode_for_input(path, this->input_size, reduction);
+            decode_times.push_back(chrono::duration<double, milli>(Clock::now() - started).count());
+            if (image.empty())
+                continue;
+            double scale = this->input_size / (double)max(image.cols, image.rows);
+            Mat resized, input(this->input_size, this->input_size, CV_8UC3, Scalar(114, 114, 114));
+            resize(image, resized, Size(max(1, (int)(image.cols * scale)),
+                                        max(1, (int)(image.rows * scale))), 0, 0, INTER_AREA);
+            resized.copyTo(input(Rect(0, 0, resized.cols, resized.rows)));
+            inputs.push_back(input);
+
+            // The boxes are mapped back to the (estimated) full image.
+            scales.push_back(scale / reduction);
+            sizes.push_back(Size(image.cols * reduction, image.rows * reduction));
+            decoded_paths.push_back(path);
+        }
+
+        // Run the network on the complete batch.
+        vector<Proposals> proposals(decoded_paths.size());
+        Clock::time_point started = Clock::now();
+        if (!inputs.empty()) {
+            try {
+                Mat blob = dnn::blobFromImages(inputs, 1.0 / 255.0,
+                                               Size(this->input_size, this->input_size),
+                                               Scalar(), true, false);
+                net.setInput(blob);
+                Mat output = net.forward();
+
+                // Split the output into the rows for each image.
+                bool transposed = output.size[1] < output.size[2];
+                for (int i = 0; i < (int)decoded_paths.size() && i < output.size[0]; ++i) {
+                    Mat rows(output.size[1], output.size[2], CV_32F, output.ptr<float>(i));
+                    proposals[i] = this->parse_output(rows, transposed, scales[i], sizes[i]);
+                }
+            } catch (const cv::Exception& e) {
+                cerr << "Pre-labeling failed: " << e.what() << endl;
+            }
+        }
+        double inference = chrono::duration<double, milli>(Clock::now() - started).count();
+
+        // Record the timing and deliver the results.
+        lock_guard<std::mutex> lock(this->mutex);
+        this->decode_ms.insert(this->decode_ms.end(), decode_times.begin(), decode_times.end());
+        if (!inputs.empty())
+            this->inference_ms.push_back(inference / (double)inputs.size());
+        for (const auto& path: batch) {
+            auto pending = this->promises.find(path);
+            if (pending == this->promises.end())
+                continue;
+            auto decoded = find(decoded_paths.begin(), decoded_paths.end(), path);
+            pending->second->set_value((decoded == decoded_paths.end())
+                                       ? Proposals() : proposals[decoded - decoded_paths.begin()]);
+            this->promises.erase(pending);
+            this->finished_at[path] = Clock::now();
+        }
+    }
+}
+
+PreLabeler::Proposals PreLabeler::parse_output(const cv::Mat& output, bool transposed,
+                                               double scale, const cv::Size& image_size) const {
+    // Arrange the output so that there is one row per box.
+    Mat rows = transposed ? output.t() : output;
+    int offset = transposed ? 4 : 5;
+    int num_classes = rows.cols - offset;
+
+    // Collect the boxes which score above the threshold, grouped by class.
+    map<int, pair<vector<Rect>, vector<float>>> candidates;
+    for (int i = 0; i < rows.rows; ++i) {
+        const float* row = rows.ptr<float>(i);
+        const float* scores = row + offset;
+        int best = (int)(max_element(scores, scores + num_classes) - scores);
+        float score = transposed ? scores[best] : row[4] * scores[best];
+        if (score < this->score_threshold || best >= (int)this->class_labels.size() ||
+            this->class_labels[best] == nullptr) {
+            continue;
+        }
+
+        // Convert the box from the model input to the original image.
+        int x0 = max(0, (int)((row[0] - row[2] / 2) / scale));
+        int y0 = max(0, (int)((row[1] - row[3] / 2) / scale));
+        int x1 = min(image_size.width - 1, (int)((row[0] + row[2] / 2) / scale));
+        int y1 = min(image_size.height - 1, (int)((row[1] + row[3] / 2) / scale));
+        candidates[best].first.emplace_back(x0, y0, x1 - x0, y1 - y0);
+        candidates[best].second.push_back(score);
+    }
+
+    // Suppress overlapping boxes within each class.
+    Proposals proposals;
+    for (const auto& candidate: candidates) {
+        vector<int> kept;
+        dnn::NMSBoxes(candidate.second.first, candidate.second.second,
+                      this->score_threshold, this->nms_threshold, kept);
+        for (int k: kept) {
+            const Rect& box = candidate.second.first[k];
+            proposals.emplace_back(this->class_labels[candidate.first], vector<int> {
+                    box.x, box.y, box.x + box.width, box.y + box.height });
+        }
+    }
+    return proposals;
+}
+
+void PreLabeler::print_stats() {
+    lock_guard<std::mutex> lock(this->mutex);
+    if (this->inference_ms.empty())
+        return;
+    size_t late = count(this->lead_ms.begin(), this->lead_ms.end(), 0.0);
+    printf("Pre-label: %zu images, decode p50 %.1f ms / p95 %.1f ms, "
+           "inference p50 %.1f ms / p95 %.1f ms per image\n",
+           this->decode_ms.size(), percentile(this->decode_ms, 0.5),
+           percentile(this->decode_ms, 0.95), percentile(this->inference_ms, 0.5),
+           percentile(this->inference_ms, 0.95));
+    printf("Pre-label: ready ahead of the user for %zu of %zu images (p50 lead %.0f ms)\n",
+           this->lead_ms.size() - late, this->lead_ms.size(), percentile(this->lead_ms, 0.5));
+}
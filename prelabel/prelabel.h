@@ -0,0 +1,155 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_PRELABEL_H
+#define ANNOTATION_PRELABEL_H
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+
+/**
+ * Runs an ONNX object detection model over the upcoming
+ * images, so that each image starts with a set of proposed
+ * bounding boxes which the user can accept or correct.
+ *
+ * The model is expected to produce YOLO-style output, either
+ * as [batch, boxes, 5 + classes] (center x, center y, width,
+ * height, objectness, class scores) or as the transposed
+ * [batch, 4 + classes, boxes] without an objectness score.
+ * Class `i` of the model corresponds to the `i`th label.
+ *
+ * Each worker thread owns its own network (since networks
+ * can't be shared between threads), and runs it on batches
+ * of images. Only a bounded number of upcoming images are
+ * queued at a time, so the workers stay just ahead of the user.
+ */
+class PreLabeler {
+public:
+    /* The proposed boxes for an image, in the same format as the handler. */
+    typedef std::vector<std::tuple<const char*, std::vector<int>>> Proposals;
+
+private:
+    /* The labels corresponding to each of the model's classes. */
+    std::vector<const char*> class_labels;
+
+    /* The path to the model, and its input size. */
+    std::string model_path;
+    int input_size;
+
+    /* The minimum score for a proposal to be kept, and the overlap
+     * above which lower-scoring proposals are suppressed. */
+    float score_threshold;
+    float nms_threshold;
+
+    /* The maximum number of images in each batch, and the
+     * number of upcoming images which are queued at a time. */
+    int batch_size;
+    int lookahead;
+
+    /* The images waiting to be labeled, and the promised
+     * results for all of the images which have been requested. */
+    std::deque<std::string> queue;
+    std::unordered_map<std::string, std::shared_ptr<std::promise<Proposals>>> promises;
+    std::unordered_map<std::string, std::shared_future<Proposals>> results;
+
+    /* The time taken to decode and run inference on each image,
+     * and how long each result was ready before it was needed. */
+    std::vector<double> decode_ms;
+    std::vector<double> inference_ms;
+    std::vector<double> lead_ms;
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> finished_at;
+
+    /* Synchronizes access to the queue and results. */
+    std::mutex mutex;
+    std::condition_variable work_available;
+
+    /* The worker threads, and whether they are shutting down. */
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+public:
+    /**
+     * Loads the model and starts the worker threads.
+     * @param model: The path to the ONNX model.
+     * @param labels: The label for each of the model's classes.
+     * @param threads: The number of worker threads.
+     * @param upcoming: The number of upcoming images to label.
+     * @param batch: The maximum number of images per batch.
+     * @param size: The width and height of the model input.
+     * @param threshold: The minimum score for proposals.
+     */
+    PreLabeler(const std::string& model, std::vector<const char*> labels,
+               int threads, int upcoming, int batch, int size, float threshold);
+
+    /**
+     * Stops the worker threads.
+     */
+    ~PreLabeler();
+
+    PreLabeler(const PreLabeler&) = delete;
+    PreLabeler& operator=(const PreLabeler&) = delete;
+
+    /**
+     * Queues the images after the current one for labeling,
+     * and drops the results for images which are far behind it.
+     * @param paths: The paths to all of the images.
+     * @param index: The index of the current image.
+     */
+    void schedule(const std::vector<std::string>& paths, int index);
+
+    /**
+     * Returns the proposals for an image, queueing it first if necessary.
+     * @param path: The path to the image.
+     */
+    std::shared_future<Proposals> request(const std::string& path);
+
+    /**
+     * Prints the latency percentiles of the pre-labeling stage.
+     */
+    void print_stats();
+
+private:
+    /**
+     * Queues an image, assuming that the lock is held.
+     */
+    std::shared_future<Proposals> enqueue(const std::string& path);
+
+    /**
+     * The loop which is run by each of the worker threads.
+     */
+    void worker_loop();
+
+    /**
+     * Converts the raw output of the model for one image into proposals.
+     * @param output: The output rows for the image.
+     * @param transposed: Whether the output is [4 + classes, boxes].
+     * @param scale: The scale from the input to the original image.
+     * @param image_size: The size of the original image.
+     */
+    Proposals parse_output(const cv::Mat& output, bool transposed,
+                           double scale, const cv::Size& image_size) const;
+};
+
+#endif //ANNOTATION_PRELABEL_H
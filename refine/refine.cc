@@ -0,0 +1,171 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "refine.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+#define MIN_REFINED_SIZE 4
+#define EDGE_STRENGTH_RATIO 1.5
+#define GRABCUT_ITERATIONS 3
+#define GRABCUT_MAX_SIZE 320
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Finds the position in a gradient profile (between `low` and `high`)
+ * which has the strongest gradient, if it is sufficiently stronger
+ * than the average gradient in that range, otherwise returns `current`.
+ */
+static int strongest_edge(const float* profile, int low, int high, int current) {
+    if (high <= low)
+        return current;
+    int best = current;
+    float best_value = 0.0f, total = 0.0f;
+    for (int i = low; i <= high; i++) {
+        total += profile[i];
+        if (profile[i] > best_value) {
+            best_value = profile[i];
+            best = i;
+        }
+    }
+    float mean = total / (float)(high - low + 1);
+    return (best_value > EDGE_STRENGTH_RATIO * mean) ? best : current;
+}
+
+/**
+ * Moves each of the edges of the box to a nearby strong gradient.
+ */
+static Rect refine_with_edges(const Mat& roi, const Rect& box, int padding) {
+    // Compute the horizontal and vertical gradient magnitudes
+    // (after smoothing, so that noise isn't mistaken for an edge).
+    Mat gray, dx, dy;
+    if (roi.channels() == 1) {
+        gray = roi;
+    } else {
+        cvtColor(roi, gray, COLOR_BGR2GRAY);
+    }
+    GaussianBlur(gray, gray, Size(3, 3), 0);
+    Sobel(gray, dx, CV_32F, 1, 0);
+    Sobel(gray, dy, CV_32F, 0, 1);
+    dx = abs(dx);
+    dy = abs(dy);
+
+    // Vertical edges are found by averaging the horizontal gradient
+    // over the height of the box (and likewise for horizontal edges),
+    // so that a boundary along the whole side outweighs a small detail.
+    Mat columns, rows;
+    reduce(dx.rowRange(box.y, box.y + box.height), columns, 0, REDUCE_AVG, CV_32F);
+    reduce(dy.colRange(box.x, box.x + box.width), rows, 1, REDUCE_AVG, CV_32F);
+    const float* column_profile = columns.ptr<float>(0);
+    vector<float> row_profile(rows.rows);
+    for (int i = 0; i < rows.rows; i++) {
+        row_profile[i] = rows.at<float>(i, 0);
+    }
+
+    // Search for each edge within the padding, without letting
+    // the opposite edges cross (or come too close to) each other.
+    int x1 = box.x, x2 = box.x + box.width - 1;
+    int y1 = box.y, y2 = box.y + box.height - 1;
+    int left = strongest_edge(column_profile, max(0, x1 - padding),
+                              min(x1 + padding, x2 - MIN_REFINED_SIZE), x1);
+    int right = strongest_edge(column_profile, max(left + MIN_REFINED_SIZE, x2 - padding),
+                               min(roi.cols - 1, x2 + padding), x2);
+    int top = strongest_edge(row_profile.data(), max(0, y1 - padding),
+                             min(y1 + padding, y2 - MIN_REFINED_SIZE), y1);
+    int bottom = strongest_edge(row_profile.data(), max(top + MIN_REFINED_SIZE, y2 - padding),
+                                min(roi.rows - 1, y2 + padding), y2);
+    return Rect(Point(left, top), Point(right + 1, bottom + 1));
+}
+
+/**
+ * Replaces the box with the bounding box of a GrabCut segmentation.
+ */
+static Rect refine_with_grabcut(const Mat& roi, const Rect& box) {
+    // GrabCut is slow on large regions, and its result only needs to
+    // be as precise as the boundary, so run it on a downscaled region.
+    double scale = min(1.0, GRABCUT_MAX_SIZE / (double)max(roi.cols, roi.rows));
+    Mat small;
+    if (scale < 1.0) {
+        resize(roi, small, Size(), scale, scale, INTER_AREA);
+    } else {
+        small = roi;
+    }
+    if (small.channels() == 1)
+        cvtColor(small, small, COLOR_GRAY2BGR);
+
+    // Segment the region, with everything outside of the box as background.
+    Rect initial(Point((int)floor(box.x * scale), (int)floor(box.y * scale)),
+                 Point((int)ceil((box.x + box.width) * scale),
+                       (int)ceil((box.y + box.height) * scale)));
+    initial &= Rect(0, 0, small.cols, small.rows);
+    if (initial.width < MIN_REFINED_SIZE || initial.height < MIN_REFINED_SIZE)
+        return box;
+    Mat mask, background_model, foreground_model;
+    grabCut(small, mask, initial, background_model, foreground_model,
+            GRABCUT_ITERATIONS, GC_INIT_WITH_RECT);
+
+    // Take the bounding box of the (probable) foreground.
+    Mat foreground = (mask == GC_FGD) | (mask == GC_PR_FGD);
+    if (countNonZero(foreground) == 0)
+        return box;
+    Rect found = boundingRect(foreground);
+    Rect refined(Point((int)floor(found.x / scale), (int)floor(found.y / scale)),
+                 Point((int)ceil((found.x + found.width) / scale),
+                       (int)ceil((found.y + found.height) / scale)));
+    refined &= Rect(0, 0, roi.cols, roi.rows);
+    if (refined.width < MIN_REFINED_SIZE || refined.height < MIN_REFINED_SIZE)
+        return box;
+    return refined;
+}
+
+std::vector<int> refine_box(const cv::Mat& image, const std::vector<int>& box,
+                            const std::string& method, int padding) {
+    // Normalize the box, since it may have been drawn in any direction.
+    Rect bounds(0, 0, image.cols, image.rows);
+    Rect rect = Rect(Point(min(box[0], box[2]), min(box[1], box[3])),
+                     Point(max(box[0], box[2]) + 1, max(box[1], box[3]) + 1)) & bounds;
+    if (image.empty() || rect.width < MIN_REFINED_SIZE || rect.height < MIN_REFINED_SIZE)
+        return box;
+
+    // Only process the region around the box.
+    Rect region = Rect(rect.x - padding, rect.y - padding,
+                       rect.width + 2 * padding, rect.height + 2 * padding) & bounds;
+    Mat roi = image(region);
+    Rect local = rect - region.tl();
+
+    // Refine the box within the region.
+    Rect refined;
+    if (method == "edges") {
+        refined = refine_with_edges(roi, local, padding);
+    } else if (method == "grabcut") {
+        refined = refine_with_grabcut(roi, local);
+    } else {
+        return box;
+    }
+
+    // Convert the box back to image coordinates.
+    refined += region.tl();
+    return std::vector<int>{refined.x, refined.y,
+                            refined.x + refined.width - 1,
+                            refined.y + refined.height - 1};
+}
+
+bool is_refine_method(const std::string& method) {
+    return method == "none" || method == "edges" || method == "grabcut";
+}
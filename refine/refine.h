@@ -0,0 +1,54 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_REFINE_H
+#define ANNOTATION_REFINE_H
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/**
+ * Refines a drawn bounding box so that its edges lie on the
+ * object, using one of the following methods:
+ *
+ * - `edges`: Each edge is moved to the strongest image gradient
+ *   within `padding` pixels of it, if that gradient is strong
+ *   enough to be an object boundary rather than texture.
+ * - `grabcut`: The box is used to initialize a GrabCut
+ *   segmentation, and is replaced by the bounding box of the
+ *   foreground mask.
+ *
+ * Only a region of the image around the box (padded by
+ * `padding` pixels) is processed, so the cost depends on the
+ * size of the box rather than the size of the image. If the
+ * box can't be refined, then it is returned unchanged.
+ *
+ * @param image: The full-resolution image.
+ * @param box: The box, as [x1, y1, x2, y2] in image coordinates.
+ * @param method: The name of the refinement method.
+ * @param padding: The maximum distance that each edge can move.
+ * @return The refined box, as [x1, y1, x2, y2].
+ */
+std::vector<int> refine_box(const cv::Mat& image, const std::vector<int>& box,
+                            const std::string& method, int padding);
+
+/**
+ * Checks whether a refinement method is valid.
+ * @param method: The name of the method, or `none`.
+ */
+bool is_refine_method(const std::string& method);
+
+#endif //ANNOTATION_REFINE_H
@@ -0,0 +1,142 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "events.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "../system/error.h"
+
+/* Identifies an event recording. */
+#define EVENTS_MAGIC "ANNEVT01"
+
+using namespace std;
+using Clock = std::chrono::steady_clock;
+
+/* The header at the start of a recording. */
+struct RecordingHeader {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+/**
+ * Returns a percentile of a list of values (which is sorted in place).
+ */
+static double percentile(vector<double>& values, double fraction) {
+    if (values.empty())
+        return 0;
+    sort(values.begin(), values.end());
+    size_t index = min(values.size() - 1, (size_t)(fraction * (double)values.size()));
+    return values[index];
+}
+
+EventRecorder::EventRecorder(const std::string& path)
+        : out(path, ios::binary | ios::trunc), start(Clock::now()) {
+    if (!this->out.is_open()) {
+        string msg = "Could not create the event recording \'" + path + "\'";
+        error_exit(msg.c_str());
+    }
+
+    // Write the header, which also records the size of the records.
+    RecordingHeader header{};
+    memcpy(header.magic, EVENTS_MAGIC, 8);
+    header.record_size = sizeof(RecordedEvent);
+    this->out.write((const char*)&header, sizeof(header));
+    this->out.flush();
+}
+
+void EventRecorder::record(EventSource source, EventCategory category, int code,
+                           int x, int y, int flags) {
+    RecordedEvent event{};
+    event.time_us = (uint64_t)chrono::duration_cast<chrono::microseconds>(Clock::now() - this->start).count();
+    event.code = code;
+    event.flags = flags;
+    event.x = (int16_t)max(-32768, min(32767, x));
+    event.y = (int16_t)max(-32768, min(32767, y));
+    event.source = source;
+    event.category = category;
+
+    // Flush each event, so that a session which crashes can still be replayed.
+    this->out.write((const char*)&event, sizeof(event));
+    this->out.flush();
+}
+
+EventReplayer::EventReplayer(const std::string& path, bool replay_max_speed)
+        : max_speed(replay_max_speed), previous_time(Clock::now()) {
+    // Read and validate the header.
+    ifstream in(path, ios::binary);
+    RecordingHeader header{};
+    if (!in.read((char*)&header, sizeof(header)) || memcmp(header.magic, EVENTS_MAGIC, 8) != 0 ||
+        header.record_size != sizeof(RecordedEvent)) {
+        string msg = "The event recording \'" + path + "\' could not be read";
+        error_exit(msg.c_str());
+    }
+
+    // Read all of the events (a partially written one is dropped).
+    RecordedEvent event{};
+    while (in.read((char*)&event, sizeof(event))) {
+        this->events.push_back(event);
+    }
+}
+
+bool EventReplayer::take_event(RecordedEvent& event) {
+    if (this->next == this->events.size())
+        return false;
+
+    // At full speed, each event is replayed once the previous one has been
+    // handled. Otherwise, the recorded gap since the previous event is kept.
+    Clock::time_point now = Clock::now();
+    if (this->max_speed) {
+        if (!this->waiting.empty())
+            return false;
+    } else {
+        uint64_t gap = this->events[this->next].time_us -
+                       (this->next == 0 ? 0 : this->events[this->next - 1].time_us);
+        if (now - this->previous_time < chrono::microseconds(gap))
+            return false;
+    }
+
+    event = this->events[this->next++];
+    this->previous_time = now;
+    this->waiting.emplace_back((EventCategory)min<int>(event.category, EVENT_OTHER), now);
+    return true;
+}
+
+void EventReplayer::frame_ready(bool displayed) {
+    if (displayed) {
+        Clock::time_point now = Clock::now();
+        for (const auto& event: this->waiting) {
+            this->latencies[event.first].push_back(
+                    chrono::duration<double, milli>(now - event.second).count());
+        }
+    }
+    this->waiting.clear();
+}
+
+void EventReplayer::print_report() {
+    static const char* names[EVENT_CATEGORIES] = {"Click:", "Label:", "Clear:", "Advance:", "Other:"};
+    printf("Replay: %zu of %zu events replayed (%s)\n", this->next, this->events.size(),
+           this->max_speed ? "max speed" : "recorded speed");
+    for (int i = 0; i < EVENT_CATEGORIES; i++) {
+        vector<double>& values = this->latencies[i];
+        if (values.empty())
+            continue;
+        printf("%-8s %zu events to frame: p50 %.1f ms, p95 %.1f ms, p99 %.1f ms (%.1f ms max)\n",
+               names[i], values.size(), percentile(values, 0.5), percentile(values, 0.95),
+               percentile(values, 0.99), values.back());
+    }
+}
@@ -0,0 +1,162 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_EVENTS_H
+#define ANNOTATION_EVENTS_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * Where a recorded event came from.
+ */
+enum EventSource : uint8_t {
+    EVENT_SOURCE_MOUSE = 0,
+    EVENT_SOURCE_KEY = 1
+};
+
+/**
+ * The kinds of interaction which latencies are reported for.
+ */
+enum EventCategory : uint8_t {
+    /* A click on the image (e.g., a corner of a box). */
+    EVENT_CLICK = 0,
+    /* A change of the label (with a button or a hotkey). */
+    EVENT_LABEL_SWITCH,
+    /* Clearing the boxes on the image. */
+    EVENT_CLEAR,
+    /* Moving to the next (or previous) image. */
+    EVENT_ADVANCE,
+    /* Anything else (e.g., undo, or typing into the picker). */
+    EVENT_OTHER,
+    EVENT_CATEGORIES
+};
+
+/**
+ * A mouse or key event, as it is stored in a recording.
+ */
+struct RecordedEvent {
+    /* The time of the event since the recording started. */
+    uint64_t time_us;
+
+    /* The OpenCV mouse event or key code, and the mouse flags. */
+    int32_t code;
+    int32_t flags;
+
+    /* The position of the mouse in the window. */
+    int16_t x;
+    int16_t y;
+
+    /* The `EventSource` and `EventCategory` of the event. */
+    uint8_t source;
+    uint8_t category;
+    uint16_t reserved;
+};
+
+/**
+ * Records the mouse and key events of an annotation session to a
+ * compact binary file (a header followed by fixed size records),
+ * so that the session can be replayed later.
+ */
+class EventRecorder {
+private:
+    /* The recording, and when it started. */
+    std::ofstream out;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    /**
+     * Starts a new recording, replacing any existing one.
+     * @param path: The path to the recording.
+     */
+    explicit EventRecorder(const std::string& path);
+
+    /**
+     * Appends an event to the recording.
+     * @param source: Whether it is a mouse or key event.
+     * @param category: The kind of interaction.
+     * @param code: The mouse event or key code.
+     * @param x: The x-coordinate of the mouse.
+     * @param y: The y-coordinate of the mouse.
+     * @param flags: The mouse flags.
+     */
+    void record(EventSource source, EventCategory category, int code,
+                int x = 0, int y = 0, int flags = 0);
+};
+
+/**
+ * Replays a recorded session, handing the events back to the
+ * annotation handler either with their recorded timing, or as fast
+ * as possible (as soon as the previous event's frame is ready). The
+ * latency from each event to the next frame being displayed is
+ * measured, so recorded sessions can be used as a repeatable
+ * benchmark of how responsive the annotation window is.
+ */
+class EventReplayer {
+private:
+    /* The recorded events, and the next one to replay. */
+    std::vector<RecordedEvent> events;
+    size_t next = 0;
+
+    /* Whether to ignore the recorded timing, and when the
+     * previous event was replayed. */
+    bool max_speed;
+    std::chrono::steady_clock::time_point previous_time;
+
+    /* The events which have been replayed, and are waiting
+     * for a frame to be displayed. */
+    std::vector<std::pair<EventCategory, std::chrono::steady_clock::time_point>> waiting;
+
+    /* The latency (in milliseconds) of each event, for each category. */
+    std::vector<double> latencies[EVENT_CATEGORIES];
+
+public:
+    /**
+     * Loads a recording.
+     * @param path: The path to the recording.
+     * @param replay_max_speed: Whether to replay the events as fast as
+     * possible, rather than with the recorded gaps between them.
+     */
+    EventReplayer(const std::string& path, bool replay_max_speed);
+
+    /**
+     * Takes the next event, if it is due to be replayed.
+     * @param event: Receives the event.
+     * @return Whether there was an event to replay.
+     */
+    bool take_event(RecordedEvent& event);
+
+    /**
+     * Returns whether every event has been replayed (and displayed).
+     */
+    bool finished() const { return next == events.size() && waiting.empty(); }
+
+    /**
+     * Marks that the events replayed since this was last called have
+     * been handled, completing them if they changed the window (events
+     * which didn't change anything have no latency to measure).
+     * @param displayed: Whether a new frame has been displayed.
+     */
+    void frame_ready(bool displayed);
+
+    /**
+     * Prints the latency percentiles for each category of event.
+     */
+    void print_report();
+};
+
+#endif //ANNOTATION_EVENTS_H
@@ -0,0 +1,336 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <limits>
+
+#include "../stats/parser.h"
+#include "../system/paths.h"
+
+#define INDEX_MAGIC "ANNINDX1"
+#define INDEX_IMAGES_PER_TASK 1024
+
+using namespace std;
+
+/**
+ * Computes a checksum of the index, so that an index which
+ * was only partially written can be detected and discarded.
+ */
+static uint64_t checksum(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Appends a value to (or reads a value from) the serialized index.
+ */
+template <typename T>
+static void write_value(std::string& out, const T& value) {
+    out.append((const char*)&value, sizeof(T));
+}
+template <typename T>
+static bool read_value(const char*& p, const char* end, T& value) {
+    if ((size_t)(end - p) < sizeof(T))
+        return false;
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+static void write_string(std::string& out, const std::string& value) {
+    write_value(out, (uint32_t)value.size());
+    out.append(value);
+}
+static bool read_string(const char*& p, const char* end, std::string& value) {
+    uint32_t length;
+    if (!read_value(p, end, length) || (size_t)(end - p) < length)
+        return false;
+    value.assign(p, length);
+    p += length;
+    return true;
+}
+
+AnnotationIndex::AnnotationIndex(const std::string& path, const FileWriter& file_writer,
+                                 const std::vector<int>& mode_choice)
+        : index_path(path), writer(file_writer), mode(mode_choice) {
+    // Read the existing index, if there is one.
+    this->load();
+}
+
+int AnnotationIndex::size_bucket(double size) {
+    if (size < 1.0)
+        return 0;
+    return min(INDEX_SIZE_BUCKETS - 1, 1 + (int)floor(log2(size)));
+}
+
+void AnnotationIndex::load() {
+    ifstream in(this->index_path, ios::binary);
+    if (!in.is_open())
+        return;
+    string contents((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    // Validate the header and the checksum of the contents.
+    const char* p = contents.data();
+    const char* end = p + contents.size();
+    char magic[8];
+    uint64_t label_count = 0, entry_count = 0, expected_checksum = 0;
+    bool valid = read_value(p, end, magic) && memcmp(magic, INDEX_MAGIC, 8) == 0 &&
+                 read_value(p, end, label_count) && read_value(p, end, entry_count) &&
+                 read_value(p, end, expected_checksum) &&
+                 checksum(p, end - p) == expected_checksum;
+
+    // Read the labels, then the entry of each image.
+    vector<string> loaded_labels;
+    unordered_map<string, Entry> loaded_entries;
+    for (uint64_t i = 0; valid && i < label_count; i++) {
+        string label;
+        valid = read_string(p, end, label);
+        loaded_labels.push_back(std::move(label));
+    }
+    for (uint64_t i = 0; valid && i < entry_count; i++) {
+        string image_path;
+        Entry entry;
+        uint32_t key_count = 0;
+        valid = read_string(p, end, image_path) && read_value(p, end, entry.mtime) &&
+                read_value(p, end, key_count) && (size_t)(end - p) >= key_count * sizeof(uint32_t);
+        if (valid) {
+            entry.keys.resize(key_count);
+            memcpy(entry.keys.data(), p, key_count * sizeof(uint32_t));
+            p += key_count * sizeof(uint32_t);
+            loaded_entries.emplace(std::move(image_path), std::move(entry));
+        }
+    }
+    if (!valid) {
+        cerr << "The annotation index is invalid, so it will be rebuilt." << endl;
+        return;
+    }
+
+    this->labels = std::move(loaded_labels);
+    for (uint32_t i = 0; i < this->labels.size(); i++)
+        this->label_ids[this->labels[i]] = i;
+    this->entries = std::move(loaded_entries);
+}
+
+void AnnotationIndex::save() const {
+    // Serialize the labels and entries, in the order of the images.
+    string body;
+    for (const auto& label: this->labels)
+        write_string(body, label);
+    for (const auto& image_path: this->image_paths) {
+        const Entry& entry = this->entries.at(image_path);
+        write_string(body, image_path);
+        write_value(body, entry.mtime);
+        write_value(body, (uint32_t)entry.keys.size());
+        body.append((const char*)entry.keys.data(), entry.keys.size() * sizeof(uint32_t));
+    }
+    string header(INDEX_MAGIC, 8);
+    write_value(header, (uint64_t)this->labels.size());
+    write_value(header, (uint64_t)this->image_paths.size());
+    write_value(header, checksum(body.data(), body.size()));
+
+    // Write the index to a temporary file, and then move it over the
+    // old one, so that an interrupted save never loses the old index.
+    string temporary_path = this->index_path + ".tmp";
+    ofstream out(temporary_path, ios::binary | ios::trunc);
+    out.write(header.data(), (streamsize)header.size());
+    out.write(body.data(), (streamsize)body.size());
+    out.close();
+    if (!out || rename(temporary_path.c_str(), this->index_path.c_str()) != 0) {
+        cerr << "Could not write the annotation index to \'" << this->index_path << "\'." << endl;
+        remove(temporary_path.c_str());
+    }
+}
+
+bool AnnotationIndex::read_pairs(const std::string& annotation_path,
+                                 std::vector<std::pair<std::string, int>>& pairs) const {
+    MappedFile file(annotation_path);
+    if (!file.is_open())
+        return false;
+
+    // Collect the label and size bucket of each box, where the label
+    // is only copied for the first box with each label and bucket.
+    AnnotationParser parser(file.view(), this->mode);
+    ParsedBox box{};
+    ParseResult result;
+    vector<pair<std::string_view, int>> views;
+    while ((result = parser.next(box)) != PARSE_END) {
+        if (result != PARSE_BOX)
+            continue;
+        const double* c = box.coordinates;
+        int bucket = size_bucket(max(fabs(c[2] - c[0]), fabs(c[3] - c[1])));
+        views.emplace_back(box.label, bucket);
+    }
+    sort(views.begin(), views.end());
+    views.erase(unique(views.begin(), views.end()), views.end());
+    for (const auto& view: views)
+        pairs.emplace_back(string(view.first), view.second);
+    return true;
+}
+
+void AnnotationIndex::update(const std::vector<std::string>& paths, ThreadPool& pool) {
+    // The contents of an annotation file which has changed.
+    struct Update {
+        size_t position;
+        int64_t mtime;
+        vector<pair<string, int>> pairs;
+    };
+
+    // Check each annotation file for changes (and read the ones which
+    // have changed) in parallel, since there can be millions of them.
+    vector<future<vector<Update>>> chunks;
+    for (size_t begin = 0; begin < paths.size(); begin += INDEX_IMAGES_PER_TASK) {
+        size_t end = min(paths.size(), begin + INDEX_IMAGES_PER_TASK);
+        chunks.push_back(pool.submit([this, &paths, begin, end]() {
+            vector<Update> updates;
+            for (size_t i = begin; i < end; i++) {
+                string annotation_path = this->writer.annotation_path(paths[i].c_str());
+                int64_t mtime = file_mtime(annotation_path);
+                auto existing = this->entries.find(paths[i]);
+                if (existing != this->entries.end() && existing->second.mtime == mtime)
+                    continue;
+                Update update {i, mtime, {}};
+                if (mtime != -1 && !this->read_pairs(annotation_path, update.pairs))
+                    update.mtime = -1;
+                updates.push_back(std::move(update));
+            }
+            return updates;
+        }));
+    }
+
+    // Wait for all of the workers (which read the existing entries)
+    // before applying the changes, assigning identifiers to new labels.
+    vector<vector<Update>> results;
+    for (auto& chunk: chunks)
+        results.push_back(chunk.get());
+    size_t changed = 0;
+    for (auto& updates: results) {
+        for (auto& update: updates) {
+            Entry entry;
+            entry.mtime = update.mtime;
+            for (const auto& pair: update.pairs) {
+                auto label = this->label_ids.find(pair.first);
+                if (label == this->label_ids.end()) {
+                    label = this->label_ids.emplace(pair.first, (uint32_t)this->labels.size()).first;
+                    this->labels.push_back(pair.first);
+                }
+                entry.keys.push_back(label->second * INDEX_SIZE_BUCKETS + pair.second);
+            }
+            this->entries[paths[update.position]] = std::move(entry);
+            changed++;
+        }
+    }
+
+    // Only keep the entries of the current images, and invert them.
+    bool removed = this->entries.size() > paths.size();
+    if (removed) {
+        unordered_map<string, Entry> current;
+        current.reserve(paths.size());
+        for (const auto& path: paths)
+            current.emplace(path, std::move(this->entries[path]));
+        this->entries = std::move(current);
+    }
+    this->image_paths = paths;
+    this->postings.clear();
+    for (uint32_t i = 0; i < this->image_paths.size(); i++) {
+        for (uint32_t key: this->entries[this->image_paths[i]].keys)
+            this->postings[key].push_back(i);
+    }
+
+    // Persist the index for the next session.
+    if (changed > 0 || removed) {
+        cout << "Indexed " << changed << " changed annotation files." << endl;
+        this->save();
+    }
+}
+
+bool AnnotationIndex::matches_exactly(const std::string& image_path, const std::string& label,
+                                      int max_box_size) const {
+    MappedFile file(this->writer.annotation_path(image_path.c_str()));
+    if (!file.is_open())
+        return false;
+    AnnotationParser parser(file.view(), this->mode);
+    ParsedBox box{};
+    ParseResult result;
+    while ((result = parser.next(box)) != PARSE_END) {
+        if (result != PARSE_BOX || (!label.empty() && box.label != label))
+            continue;
+        const double* c = box.coordinates;
+        if (max(fabs(c[2] - c[0]), fabs(c[3] - c[1])) < max_box_size)
+            return true;
+    }
+    return false;
+}
+
+std::vector<std::string> AnnotationIndex::query(const std::string& label, int max_box_size) const {
+    // Get the labels to search for.
+    vector<uint32_t> ids;
+    if (label.empty()) {
+        for (uint32_t i = 0; i < this->labels.size(); i++)
+            ids.push_back(i);
+    } else {
+        auto id = this->label_ids.find(label);
+        if (id == this->label_ids.end())
+            return {};
+        ids.push_back(id->second);
+    }
+
+    // Mark the images in the buckets which are entirely smaller than
+    // the maximum size as matches, and those in the bucket which is
+    // only partly smaller than it as candidates (which are checked).
+    const char MATCH = 1, CANDIDATE = 2;
+    vector<char> marks(this->image_paths.size(), 0);
+    for (int bucket = 0; bucket < INDEX_SIZE_BUCKETS; bucket++) {
+        double lower = (bucket == 0) ? 0.0 : ldexp(1.0, bucket - 1);
+        double upper = (bucket == 0) ? 1.0 : (bucket == INDEX_SIZE_BUCKETS - 1)
+                ? numeric_limits<double>::infinity() : ldexp(1.0, bucket);
+        char mark;
+        if (max_box_size <= 0 || upper <= max_box_size) {
+            mark = MATCH;
+        } else if (lower < max_box_size) {
+            mark = CANDIDATE;
+        } else {
+            continue;
+        }
+        for (uint32_t id: ids) {
+            auto posting = this->postings.find(id * INDEX_SIZE_BUCKETS + bucket);
+            if (posting == this->postings.end())
+                continue;
+            for (uint32_t position: posting->second) {
+                if (marks[position] != MATCH)
+                    marks[position] = mark;
+            }
+        }
+    }
+
+    // Return the matches in their original order.
+    vector<string> matches;
+    for (size_t i = 0; i < marks.size(); i++) {
+        if (marks[i] == MATCH ||
+            (marks[i] == CANDIDATE && this->matches_exactly(this->image_paths[i], label, max_box_size))) {
+            matches.push_back(this->image_paths[i]);
+        }
+    }
+    return matches;
+}
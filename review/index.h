@@ -0,0 +1,136 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_INDEX_H
+#define ANNOTATION_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../system/threadpool.h"
+#include "../writer/textwriter.h"
+
+#define INDEX_SIZE_BUCKETS 16
+
+/**
+ * An index of the existing annotations of a dataset, which is
+ * used to find the images containing a certain label, or boxes
+ * of a certain size, without reading every annotation file.
+ *
+ * For each image, the index stores the distinct (label, size
+ * bucket) pairs of its boxes, where the size bucket is the power
+ * of two of the longest side of a box. These are inverted into a
+ * posting list of images for each label and bucket when loaded.
+ *
+ * The index is persisted to a file, along with the modification
+ * time of each annotation file, so later sessions only re-read
+ * the annotation files which have changed since it was built.
+ */
+class AnnotationIndex {
+private:
+    /* The indexed contents of a single annotation file. */
+    struct Entry {
+        /* The modification time of the annotation file (or -1 if
+         * the image has no annotation file). */
+        int64_t mtime = -1;
+
+        /* The distinct label and size bucket pairs, each packed
+         * as `label_id * INDEX_SIZE_BUCKETS + bucket`. */
+        std::vector<uint32_t> keys;
+    };
+
+    /* The path to the index file. */
+    std::string index_path;
+
+    /* Finds the annotation file of each image, and the
+     * column order of the coordinates in the files. */
+    const FileWriter& writer;
+    std::vector<int> mode;
+
+    /* The labels which have been seen, and their identifiers. */
+    std::vector<std::string> labels;
+    std::unordered_map<std::string, uint32_t> label_ids;
+
+    /* The images which have been indexed, and their entries. */
+    std::vector<std::string> image_paths;
+    std::unordered_map<std::string, Entry> entries;
+
+    /* The positions (in `image_paths`) of the images which
+     * contain each label and size bucket pair. */
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+
+public:
+    /**
+     * Opens the index, reading it if it exists.
+     * @param path: The path to the index file.
+     * @param file_writer: Finds the annotation file of each image.
+     * @param mode_choice: The column order of the coordinates.
+     */
+    AnnotationIndex(const std::string& path, const FileWriter& file_writer,
+                    const std::vector<int>& mode_choice);
+
+    /**
+     * Brings the index up to date with a list of images, re-reading
+     * the annotation files which have changed (in parallel), and
+     * saves the index if anything changed.
+     * @param paths: The images in the dataset.
+     * @param pool: The workers which read the annotation files.
+     */
+    void update(const std::vector<std::string>& paths, ThreadPool& pool);
+
+    /**
+     * Finds the images with at least one box matching the filter.
+     * @param label: The label of the box, or empty for any label.
+     * @param max_box_size: The longest side of the box must be smaller
+     * than this many pixels, or zero for boxes of any size.
+     * @return The matching images, in the order given to `update`.
+     */
+    std::vector<std::string> query(const std::string& label, int max_box_size) const;
+
+private:
+    /**
+     * Reads an existing index file.
+     */
+    void load();
+
+    /**
+     * Writes the index file.
+     */
+    void save() const;
+
+    /**
+     * Reads the (label, size bucket) pairs of an annotation file.
+     * @param annotation_path: The path to the annotation file.
+     * @param pairs: Receives the distinct label and bucket pairs.
+     * @return Whether the file could be read.
+     */
+    bool read_pairs(const std::string& annotation_path,
+                    std::vector<std::pair<std::string, int>>& pairs) const;
+
+    /**
+     * Checks the boxes in an annotation file against the filter
+     * exactly (for images in a bucket which is only partly matched).
+     */
+    bool matches_exactly(const std::string& image_path, const std::string& label,
+                         int max_box_size) const;
+
+    /**
+     * Returns the size bucket of a box with this longest side.
+     */
+    static int size_bucket(double size);
+};
+
+#endif //ANNOTATION_INDEX_H
@@ -0,0 +1,93 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_PROTOCOL_H
+#define ANNOTATION_PROTOCOL_H
+
+#include <cstdint>
+
+/*
+ * The binary protocol spoken by `annotator-serve` over its Unix socket.
+ * Since the socket is local, every integer is in the host byte order.
+ *
+ * Each request is a frame made up of:
+ *     uint32  length      The number of bytes which follow this field.
+ *     uint32  request_id  Any value, which is echoed in the response.
+ *     uint8   op          One of the `ServeOp` values.
+ *     ...     payload     The rest of the frame (see below).
+ *
+ * Each response is a frame made up of:
+ *     uint32  length      The number of bytes which follow this field.
+ *     uint32  request_id  The ID of the request.
+ *     uint8   status      One of the `ServeStatus` values.
+ *     ...     payload     The rest of the frame (only when successful).
+ *
+ * Clients can send any number of requests without waiting for their
+ * responses (pipelining), and the responses are sent in the same order.
+ *
+ * Images are returned as records made up of:
+ *     uint32  image_id    The index of the image (see `SERVE_LIST_IMAGES`).
+ *     uint32  box_count   The number of boxes which follow.
+ * followed by each box:
+ *     uint16  label_id    The index of the label (see `SERVE_LIST_LABELS`).
+ *     int32   x1, y1, x2, y2
+ */
+
+/* The size of the fixed part of each frame (after the length field). */
+#define SERVE_HEADER_BYTES 5
+
+/* The size of an image record (without its boxes), and of each box. */
+#define SERVE_RECORD_BYTES 8
+#define SERVE_BOX_BYTES 18
+
+/* The largest request which is accepted. */
+#define SERVE_MAX_REQUEST_BYTES (1 << 20)
+
+/**
+ * The different requests.
+ */
+enum ServeOp : uint8_t {
+    /* Lists the labels. There is no payload, and the response is a
+     * uint32 count followed by each label (a uint16 length and its bytes). */
+    SERVE_LIST_LABELS = 1,
+    /* Lists the images. There is no payload, and the response is a
+     * uint32 count followed by each path (a uint16 length and its bytes),
+     * in the order of their IDs. */
+    SERVE_LIST_IMAGES = 2,
+    /* Looks up an image by its path, which is the payload. The
+     * response is its record. */
+    SERVE_BY_PATH = 3,
+    /* Looks up a batch of images, where the payload is a uint32 count
+     * followed by each uint32 image ID. The response is a record for
+     * each of the images, in the same order. */
+    SERVE_BY_IDS = 4,
+    /* Finds the boxes with a label, whose name is the payload. The
+     * response is a uint32 count followed by a record for each image
+     * with the label (which only holds the boxes with the label). */
+    SERVE_BY_LABEL = 5
+};
+
+/**
+ * The different results of a request.
+ */
+enum ServeStatus : uint8_t {
+    /* The request succeeded. */
+    SERVE_OK = 0,
+    /* The image (or label) does not exist. */
+    SERVE_NOT_FOUND = 1,
+    /* The request could not be parsed. */
+    SERVE_BAD_REQUEST = 2
+};
+
+#endif //ANNOTATION_PROTOCOL_H
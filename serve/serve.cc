@@ -0,0 +1,109 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "server.h"
+#include "../config/config.h"
+#include "../system/paths.h"
+#include "../writer/textwriter.h"
+
+#define DEFAULT_SOCKET_PATH "/tmp/annotator.sock"
+
+using namespace std;
+namespace fs = std::__fs::filesystem;
+
+/* Set by the signal handlers to stop serving. */
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+    stop_requested = 1;
+}
+
+int main(int argc, char** argv) {
+    // Parse the socket path, and whether to keep up with changes to the files.
+    string socket_path = DEFAULT_SOCKET_PATH;
+    bool watch = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--no-watch") == 0) {
+            watch = false;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--socket PATH] [--no-watch]" << endl;
+            return 1;
+        }
+    }
+    auto start = chrono::steady_clock::now();
+
+    // Load the same configuration as the annotator, which
+    // determines where the annotation files are and their format.
+    UserConfig config;
+    config.load_config();
+    if (!path_exists(config.image_directory.c_str())) {
+        const char* msg = "The provided image directory does not exist";
+        error_exit(msg);
+    }
+    vector<string> image_paths = get_image_paths(config.image_directory.c_str(), config.recurse);
+    TextFileWriter writer(config.mode_order);
+
+    // Start watching the annotation files before they are read, so
+    // that none of the files written in the meantime are missed.
+    AnnotationStore store(image_paths, config.labels, writer);
+    unique_ptr<DirectoryWatcher> watcher;
+    if (watch) {
+#ifdef __linux__
+        // Create any of the annotation directories which don't exist yet
+        // (as the annotator would when it writes the first file), since
+        // only existing directories can be watched.
+        vector<string> directories = store.annotation_directories();
+        for (const auto& directory: directories) {
+            std::error_code error;
+            fs::create_directories(fs::path(directory), error);
+            if (error) {
+                cerr << "Could not create \'" << directory << "\', so the annotation "
+                     << "files written to it will not be picked up" << endl;
+            }
+        }
+        watcher.reset(new DirectoryWatcher(directories, false,
+                                           [](const std::string& path) {
+            return fs::path(path).extension() == ".txt";
+        }));
+#else
+        cerr << "Changes to the annotation files are only picked up on Linux" << endl;
+#endif
+    }
+
+    // Read all of the annotation files into memory.
+    ThreadPool pool;
+    store.load(pool);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Loaded " << store.box_count() << " boxes for " << image_paths.size()
+         << " images in " << seconds << " seconds" << endl;
+
+    // Serve the annotations until interrupted.
+    signal(SIGINT, request_stop);
+    signal(SIGTERM, request_stop);
+    signal(SIGPIPE, SIG_IGN);
+    AnnotationServer server(socket_path, store, watcher.get());
+    cout << "Serving on " << socket_path << endl;
+    server.run(stop_requested);
+    return 0;
+}
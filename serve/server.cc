@@ -0,0 +1,323 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../system/error.h"
+
+using namespace std;
+
+/**
+ * Appends an integer to a buffer, in the host byte order.
+ */
+template <typename T>
+static void append_value(std::string& buffer, T value) {
+    buffer.append((const char*)&value, sizeof(T));
+}
+
+/**
+ * Reads an integer from a buffer, in the host byte order.
+ */
+template <typename T>
+static T read_value(const char* buffer) {
+    T value;
+    memcpy(&value, buffer, sizeof(T));
+    return value;
+}
+
+AnnotationServer::AnnotationServer(const std::string& path, AnnotationStore& annotation_store,
+                                   DirectoryWatcher* file_watcher)
+        : store(annotation_store), watcher(file_watcher), socket_path(path) {
+    // Check that the path fits into a socket address.
+    struct sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        string msg = "The socket path \'" + path + "\' is too long";
+        error_exit(msg.c_str());
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    // Replace any socket left behind by a previous server, and listen.
+    unlink(path.c_str());
+    this->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->listen_fd == -1 || ::bind(this->listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(this->listen_fd, SOMAXCONN) != 0) {
+        string msg = "Could not listen on the socket \'" + path + "\'";
+        error_exit(msg.c_str());
+    }
+    fcntl(this->listen_fd, F_SETFL, fcntl(this->listen_fd, F_GETFL) | O_NONBLOCK);
+}
+
+AnnotationServer::~AnnotationServer() {
+    for (const auto& client: this->clients) {
+        close(client.fd);
+    }
+    if (this->listen_fd != -1) {
+        close(this->listen_fd);
+        unlink(this->socket_path.c_str());
+    }
+}
+
+void AnnotationServer::run(const volatile sig_atomic_t& stop) {
+    vector<struct pollfd> descriptors;
+    while (!stop) {
+        // Wait for new clients, requests, or space to send responses in
+        // (clients with too many responses waiting aren't read from).
+        descriptors.clear();
+        descriptors.push_back({this->listen_fd, POLLIN, 0});
+        for (const auto& client: this->clients) {
+            short events = 0;
+            if (client.output.size() - client.sent < SERVE_MAX_PENDING_BYTES)
+                events |= POLLIN;
+            if (client.sent < client.output.size())
+                events |= POLLOUT;
+            descriptors.push_back({client.fd, events, 0});
+        }
+        int ready = poll(descriptors.data(), descriptors.size(), SERVE_POLL_MS);
+        if (ready == -1 && errno != EINTR) {
+            const char* msg = "Could not wait for the clients";
+            error_exit(msg);
+        }
+
+        // Handle each of the clients, removing those which disconnected.
+        if (ready > 0) {
+            size_t kept = 0;
+            for (size_t i = 0; i < this->clients.size(); i++) {
+                Client& client = this->clients[i];
+                short events = descriptors[i + 1].revents;
+                bool connected = true;
+                if (events & POLLIN)
+                    connected = this->read_requests(client);
+                if (connected && (events & (POLLOUT | POLLIN)))
+                    connected = this->send_responses(client);
+                if (connected && (events & (POLLERR | POLLNVAL)))
+                    connected = false;
+                if (!connected) {
+                    close(client.fd);
+                    continue;
+                }
+                if (kept != i)
+                    this->clients[kept] = std::move(client);
+                kept += 1;
+            }
+            this->clients.resize(kept);
+            if (descriptors[0].revents & POLLIN)
+                this->accept_clients();
+        }
+
+        // Pick up the annotation files which have changed in the meantime.
+        this->apply_changes();
+    }
+}
+
+void AnnotationServer::accept_clients() {
+    int fd;
+    while ((fd = accept(this->listen_fd, nullptr, nullptr)) != -1) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        Client client;
+        client.fd = fd;
+        this->clients.push_back(std::move(client));
+    }
+}
+
+bool AnnotationServer::read_requests(Client& client) {
+    // Read everything which is available.
+    char buffer[65536];
+    while (true) {
+        ssize_t length = read(client.fd, buffer, sizeof(buffer));
+        if (length > 0) {
+            client.input.append(buffer, (size_t)length);
+        } else if (length == 0) {
+            return false;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return false;
+        }
+    }
+
+    // Handle every complete request, leaving any partial one for later.
+    size_t position = 0;
+    while (client.input.size() - position >= sizeof(uint32_t)) {
+        uint32_t length = read_value<uint32_t>(client.input.data() + position);
+        if (length < SERVE_HEADER_BYTES || length > SERVE_MAX_REQUEST_BYTES)
+            return false;
+        if (client.input.size() - position - sizeof(uint32_t) < length)
+            break;
+        this->handle_request(client.input.data() + position + sizeof(uint32_t), length, client.output);
+        position += sizeof(uint32_t) + length;
+    }
+    client.input.erase(0, position);
+    return true;
+}
+
+bool AnnotationServer::send_responses(Client& client) {
+    while (client.sent < client.output.size()) {
+        ssize_t length = write(client.fd, client.output.data() + client.sent,
+                               client.output.size() - client.sent);
+        if (length > 0) {
+            client.sent += (size_t)length;
+        } else if (length == -1 && errno == EINTR) {
+            continue;
+        } else if (length == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+    }
+
+    // Drop the responses which have been sent.
+    if (client.sent == client.output.size()) {
+        client.output.clear();
+        client.sent = 0;
+    }
+    return true;
+}
+
+void AnnotationServer::handle_request(const char* request, size_t length, std::string& response) {
+    // Write the header of the response, whose length is filled in at the end.
+    uint32_t request_id = read_value<uint32_t>(request);
+    uint8_t op = (uint8_t)request[4];
+    const char* payload = request + SERVE_HEADER_BYTES;
+    size_t payload_length = length - SERVE_HEADER_BYTES;
+    size_t start = response.size();
+    append_value<uint32_t>(response, 0);
+    append_value<uint32_t>(response, request_id);
+    append_value<uint8_t>(response, SERVE_OK);
+    ServeStatus status = SERVE_OK;
+
+    switch (op) {
+        case SERVE_LIST_LABELS:
+        case SERVE_LIST_IMAGES: {
+            const vector<string>& names = (op == SERVE_LIST_LABELS)
+                    ? this->store.get_labels() : this->store.get_image_paths();
+            append_value<uint32_t>(response, (uint32_t)names.size());
+            for (const auto& name: names) {
+                append_value<uint16_t>(response, (uint16_t)name.size());
+                response.append(name);
+            }
+            break;
+        }
+        case SERVE_BY_PATH: {
+            int64_t image = this->store.find_image(string(payload, payload_length));
+            if (image == -1) {
+                status = SERVE_NOT_FOUND;
+                break;
+            }
+            this->append_record((uint32_t)image, -1, response);
+            break;
+        }
+        case SERVE_BY_IDS: {
+            // Check the whole batch before writing any of it.
+            if (payload_length < sizeof(uint32_t)) {
+                status = SERVE_BAD_REQUEST;
+                break;
+            }
+            uint32_t count = read_value<uint32_t>(payload);
+            if (payload_length != sizeof(uint32_t) * (1 + (size_t)count)) {
+                status = SERVE_BAD_REQUEST;
+                break;
+            }
+            size_t images = this->store.get_image_paths().size();
+            for (uint32_t i = 0; i < count && status == SERVE_OK; i++) {
+                if (read_value<uint32_t>(payload + sizeof(uint32_t) * (1 + i)) >= images)
+                    status = SERVE_NOT_FOUND;
+            }
+            for (uint32_t i = 0; i < count && status == SERVE_OK; i++) {
+                this->append_record(read_value<uint32_t>(payload + sizeof(uint32_t) * (1 + i)),
+                                    -1, response);
+            }
+            break;
+        }
+        case SERVE_BY_LABEL: {
+            int label = this->store.find_label(string_view(payload, payload_length));
+            if (label == -1) {
+                status = SERVE_NOT_FOUND;
+                break;
+            }
+            const vector<uint32_t>& images = this->store.images_with_label(label);
+            append_value<uint32_t>(response, (uint32_t)images.size());
+            for (uint32_t image: images) {
+                this->append_record(image, label, response);
+            }
+            break;
+        }
+        default:
+            status = SERVE_BAD_REQUEST;
+            break;
+    }
+
+    // Drop the payload of failed requests, then fill in the status and length.
+    if (status != SERVE_OK) {
+        response.resize(start + sizeof(uint32_t) + SERVE_HEADER_BYTES);
+        response[start + sizeof(uint32_t) + 4] = (char)status;
+    }
+    uint32_t response_length = (uint32_t)(response.size() - start - sizeof(uint32_t));
+    memcpy(&response[start], &response_length, sizeof(uint32_t));
+}
+
+void AnnotationServer::append_record(uint32_t image, int label, std::string& response) const {
+    uint32_t count;
+    const StoredBox* boxes = this->store.image_boxes(image, count);
+
+    // Write the image and the number of boxes, which is only
+    // known once the boxes with the label have been written.
+    append_value<uint32_t>(response, image);
+    size_t count_position = response.size();
+    append_value<uint32_t>(response, 0);
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (label != -1 && boxes[i].label != label)
+            continue;
+        append_value<uint16_t>(response, boxes[i].label);
+        for (int32_t coordinate: boxes[i].coordinates) {
+            append_value<int32_t>(response, coordinate);
+        }
+        written += 1;
+    }
+    memcpy(&response[count_position], &written, sizeof(uint32_t));
+}
+
+void AnnotationServer::apply_changes() {
+    if (this->watcher == nullptr)
+        return;
+
+    // Reload the files which were written, and clear those which were
+    // removed (or reload everything if any of the events were lost).
+    vector<string> written, removed;
+    if (this->watcher->take_changes(written, removed)) {
+        ThreadPool pool;
+        this->store.load(pool);
+        cout << "Reloaded all of the annotations after missing changes" << endl;
+        return;
+    }
+    for (const auto& path: removed) {
+        this->store.remove(path);
+    }
+    for (const auto& path: written) {
+        this->store.reload(path);
+    }
+}
@@ -0,0 +1,128 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_SERVER_H
+#define ANNOTATION_SERVER_H
+
+#include <csignal>
+#include <string>
+#include <vector>
+
+#include "store.h"
+#include "protocol.h"
+#include "../system/watcher.h"
+
+/* How often (in milliseconds) the changed annotation files are picked up. */
+#define SERVE_POLL_MS 100
+
+/* Once this many bytes of responses are waiting to be sent to a client,
+ * no more of its requests are read until the client catches up. */
+#define SERVE_MAX_PENDING_BYTES (16 * 1024 * 1024)
+
+/**
+ * Serves lookups of the annotations in a store over a Unix domain
+ * socket (see `protocol.h`), so that many readers (e.g., the data
+ * loaders of a training job) can share a single in-memory copy of
+ * the annotations instead of each parsing the files.
+ *
+ * Every client is handled on a single thread with `poll`, which
+ * also applies the changes to the annotation files between requests,
+ * so the store never has to be locked.
+ */
+class AnnotationServer {
+private:
+    /* A connected client, with the bytes of its requests which
+     * haven't been handled yet, and of its responses which
+     * haven't been sent yet. */
+    struct Client {
+        int fd;
+        std::string input;
+        std::string output;
+        size_t sent = 0;
+    };
+
+    /* The annotations which are served, and the watcher which
+     * reports the annotation files that change (if any). */
+    AnnotationStore& store;
+    DirectoryWatcher* watcher;
+
+    /* The path of the socket, the listening socket, and the clients. */
+    std::string socket_path;
+    int listen_fd = -1;
+    std::vector<Client> clients;
+
+public:
+    /**
+     * Starts listening on a socket.
+     * @param path: The path of the socket.
+     * @param annotation_store: The annotations to serve.
+     * @param file_watcher: Reports the changed annotation files, or a nullptr.
+     */
+    AnnotationServer(const std::string& path, AnnotationStore& annotation_store,
+                     DirectoryWatcher* file_watcher);
+
+    /**
+     * Closes the socket and all of the clients.
+     */
+    ~AnnotationServer();
+
+    AnnotationServer(const AnnotationServer&) = delete;
+    AnnotationServer& operator=(const AnnotationServer&) = delete;
+
+    /**
+     * Serves the clients until `stop` is set (e.g., by a signal handler).
+     */
+    void run(const volatile sig_atomic_t& stop);
+
+private:
+    /**
+     * Accepts any new clients.
+     */
+    void accept_clients();
+
+    /**
+     * Reads and handles the requests of a client.
+     * @return Whether the client is still connected.
+     */
+    bool read_requests(Client& client);
+
+    /**
+     * Sends as much of the responses to a client as possible.
+     * @return Whether the client is still connected.
+     */
+    bool send_responses(Client& client);
+
+    /**
+     * Handles a single request, appending its response.
+     * @param request: The request (after its length).
+     * @param length: The length of the request.
+     * @param response: The responses to append to.
+     */
+    void handle_request(const char* request, size_t length, std::string& response);
+
+    /**
+     * Appends the record of an image.
+     * @param image: The ID of the image.
+     * @param label: Only include the boxes with this label, or -1 for all.
+     * @param response: The response to append to.
+     */
+    void append_record(uint32_t image, int label, std::string& response) const;
+
+    /**
+     * Applies the changes to the annotation files to the store.
+     */
+    void apply_changes();
+};
+
+#endif //ANNOTATION_SERVER_H
@@ -0,0 +1,259 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "store.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <future>
+
+#include "../stats/parser.h"
+
+#define STORE_IMAGES_PER_TASK 512
+
+/* The number of unused boxes below which the store isn't compacted. */
+#define STORE_MIN_COMPACT_BOXES 4096
+
+using namespace std;
+namespace fs = std::__fs::filesystem;
+
+AnnotationStore::AnnotationStore(const std::vector<std::string>& image_list,
+                                 const std::vector<std::string>& label_list,
+                                 const FileWriter& writer)
+        : mode(writer.get_mode()), image_paths(image_list) {
+    // The labels from the configuration always have the same IDs.
+    for (const auto& label: label_list) {
+        if (this->label_ids.count(label) == 0) {
+            this->label_ids[label] = (uint16_t)this->labels.size();
+            this->labels.push_back(label);
+        }
+    }
+    this->label_images.resize(this->labels.size());
+
+    // Find the annotation file of each of the images.
+    size_t count = this->image_paths.size();
+    this->annotation_paths.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        this->annotation_paths.push_back(writer.annotation_path(this->image_paths[i].c_str()));
+        this->image_ids[this->image_paths[i]] = i;
+        this->annotation_ids[this->annotation_paths[i]] = i;
+    }
+    this->offsets.assign(count, 0);
+    this->counts.assign(count, 0);
+    this->capacities.assign(count, 0);
+}
+
+void AnnotationStore::load(ThreadPool& pool) {
+    // Parse the files in chunks on the workers.
+    typedef vector<pair<vector<StoredBox>, vector<string>>> Chunk;
+    vector<future<Chunk>> chunks;
+    size_t count = this->image_paths.size();
+    for (size_t begin = 0; begin < count; begin += STORE_IMAGES_PER_TASK) {
+        size_t end = min(count, begin + STORE_IMAGES_PER_TASK);
+        chunks.push_back(pool.submit([this, begin, end]() {
+            Chunk chunk(end - begin);
+            for (size_t i = begin; i < end; i++) {
+                this->parse_file(this->annotation_paths[i], chunk[i - begin].first,
+                                 chunk[i - begin].second);
+            }
+            return chunk;
+        }));
+    }
+
+    // Lay out the boxes of all of the images in order.
+    this->boxes.clear();
+    this->unused = 0;
+    uint32_t image = 0;
+    for (auto& future: chunks) {
+        Chunk chunk = future.get();
+        for (auto& parsed: chunk) {
+            this->assign_labels(parsed.first, parsed.second);
+            this->offsets[image] = (uint32_t)this->boxes.size();
+            this->counts[image] = this->capacities[image] = (uint32_t)parsed.first.size();
+            this->boxes.insert(this->boxes.end(), parsed.first.begin(), parsed.first.end());
+            image += 1;
+        }
+    }
+
+    // Build the list of images containing each label, which
+    // are already sorted since the images are visited in order.
+    for (auto& images: this->label_images) {
+        images.clear();
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const StoredBox* first = this->boxes.data() + this->offsets[i];
+        for (uint32_t j = 0; j < this->counts[i]; j++) {
+            vector<uint32_t>& images = this->label_images[first[j].label];
+            if (images.empty() || images.back() != i)
+                images.push_back(i);
+        }
+    }
+}
+
+bool AnnotationStore::reload(const std::string& annotation_path) {
+    auto found = this->annotation_ids.find(annotation_path);
+    if (found == this->annotation_ids.end())
+        return false;
+    vector<StoredBox> parsed;
+    vector<string> new_labels;
+    this->parse_file(annotation_path, parsed, new_labels);
+    this->assign_labels(parsed, new_labels);
+    this->set_boxes(found->second, parsed);
+    return true;
+}
+
+void AnnotationStore::remove(const std::string& path) {
+    // Clear a single file, or every file in a directory.
+    if (path.back() != '/') {
+        auto found = this->annotation_ids.find(path);
+        if (found != this->annotation_ids.end())
+            this->set_boxes(found->second, {});
+        return;
+    }
+    for (uint32_t i = 0; i < this->annotation_paths.size(); i++) {
+        if (this->annotation_paths[i].compare(0, path.size(), path) == 0)
+            this->set_boxes(i, {});
+    }
+}
+
+std::vector<std::string> AnnotationStore::annotation_directories() const {
+    vector<string> directories;
+    for (const auto& path: this->annotation_paths) {
+        directories.push_back(fs::path(path).parent_path().string());
+    }
+    sort(directories.begin(), directories.end());
+    directories.erase(unique(directories.begin(), directories.end()), directories.end());
+    return directories;
+}
+
+int64_t AnnotationStore::find_image(const std::string& path) const {
+    auto found = this->image_ids.find(path);
+    return (found == this->image_ids.end()) ? -1 : found->second;
+}
+
+int AnnotationStore::find_label(std::string_view label) const {
+    auto found = this->label_ids.find(string(label));
+    return (found == this->label_ids.end()) ? -1 : found->second;
+}
+
+void AnnotationStore::parse_file(const std::string& path, std::vector<StoredBox>& parsed,
+                                 std::vector<std::string>& new_labels) const {
+    MappedFile file(path);
+    if (!file.is_open())
+        return;
+
+    // Parse each of the boxes, where the labels are only
+    // copied the first time they are seen in the file.
+    AnnotationParser parser(file.view(), this->mode);
+    ParsedBox box{};
+    ParseResult result;
+    while ((result = parser.next(box)) != PARSE_END) {
+        if (result != PARSE_BOX)
+            continue;
+        size_t label = 0;
+        while (label < new_labels.size() && new_labels[label] != box.label)
+            label++;
+        if (label == new_labels.size())
+            new_labels.emplace_back(box.label);
+
+        StoredBox stored{(uint16_t)label, {}};
+        for (int i = 0; i < 4; i++) {
+            stored.coordinates[i] = (int32_t)lround(box.coordinates[i]);
+        }
+        parsed.push_back(stored);
+    }
+}
+
+void AnnotationStore::assign_labels(std::vector<StoredBox>& parsed,
+                                    const std::vector<std::string>& new_labels) {
+    // Find (or add) the ID of each of the labels in the file.
+    vector<uint16_t> ids;
+    for (const auto& label: new_labels) {
+        auto found = this->label_ids.find(label);
+        if (found != this->label_ids.end()) {
+            ids.push_back(found->second);
+            continue;
+        }
+        uint16_t id = (uint16_t)this->labels.size();
+        this->label_ids[label] = id;
+        this->labels.push_back(label);
+        this->label_images.emplace_back();
+        ids.push_back(id);
+    }
+    for (auto& box: parsed) {
+        box.label = ids[box.label];
+    }
+}
+
+void AnnotationStore::set_boxes(uint32_t image, const std::vector<StoredBox>& parsed) {
+    // Find the labels which the image contained before and after.
+    auto distinct_labels = [](const StoredBox* first, size_t count) {
+        vector<uint16_t> found;
+        for (size_t i = 0; i < count; i++) {
+            found.push_back(first[i].label);
+        }
+        sort(found.begin(), found.end());
+        found.erase(unique(found.begin(), found.end()), found.end());
+        return found;
+    };
+    vector<uint16_t> before = distinct_labels(this->boxes.data() + this->offsets[image], this->counts[image]);
+    vector<uint16_t> after = distinct_labels(parsed.data(), parsed.size());
+
+    // Update the images of the labels which were removed or added.
+    for (uint16_t label: before) {
+        if (binary_search(after.begin(), after.end(), label))
+            continue;
+        vector<uint32_t>& images = this->label_images[label];
+        auto position = lower_bound(images.begin(), images.end(), image);
+        if (position != images.end() && *position == image)
+            images.erase(position);
+    }
+    for (uint16_t label: after) {
+        if (binary_search(before.begin(), before.end(), label))
+            continue;
+        vector<uint32_t>& images = this->label_images[label];
+        images.insert(lower_bound(images.begin(), images.end(), image), image);
+    }
+
+    // Overwrite the boxes in place if they fit, otherwise move them to
+    // the end (where `unused` counts every box which isn't in a range).
+    this->unused += this->counts[image];
+    if (parsed.size() <= this->capacities[image]) {
+        copy(parsed.begin(), parsed.end(), this->boxes.begin() + this->offsets[image]);
+        this->unused -= parsed.size();
+    } else {
+        this->offsets[image] = (uint32_t)this->boxes.size();
+        this->capacities[image] = (uint32_t)parsed.size();
+        this->boxes.insert(this->boxes.end(), parsed.begin(), parsed.end());
+    }
+    this->counts[image] = (uint32_t)parsed.size();
+
+    // Compact the boxes once most of them are unused.
+    if (this->unused > STORE_MIN_COMPACT_BOXES && this->unused > this->boxes.size() / 2)
+        this->compact();
+}
+
+void AnnotationStore::compact() {
+    vector<StoredBox> compacted;
+    compacted.reserve(this->boxes.size() - this->unused);
+    for (size_t i = 0; i < this->offsets.size(); i++) {
+        auto first = this->boxes.begin() + this->offsets[i];
+        this->offsets[i] = (uint32_t)compacted.size();
+        this->capacities[i] = this->counts[i];
+        compacted.insert(compacted.end(), first, first + this->counts[i]);
+    }
+    this->boxes = std::move(compacted);
+    this->unused = 0;
+}
@@ -0,0 +1,180 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_STORE_H
+#define ANNOTATION_STORE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../system/threadpool.h"
+#include "../writer/writer.h"
+
+/**
+ * A single box in the store, with its coordinates in the order
+ * [x1, y1, x2, y2] (regardless of the column order of the files).
+ */
+struct StoredBox {
+    uint16_t label;
+    int32_t coordinates[4];
+};
+
+/**
+ * An in-memory copy of all of the annotations of a dataset, which
+ * is loaded once and then kept up to date as files change, so that
+ * the annotations can be looked up without touching the filesystem.
+ *
+ * The boxes of every image are stored in a single array, where each
+ * image has a range. When an image gets more boxes than fit in its
+ * range, they are moved to the end of the array, and the array is
+ * compacted once enough of it is unused. For each label, the store
+ * also keeps the (sorted) images which contain it.
+ */
+class AnnotationStore {
+private:
+    /* The column order of the coordinates in the files. */
+    std::vector<int> mode;
+
+    /* The labels, in the order of their IDs (the labels from the
+     * configuration come first, followed by any others in the files). */
+    std::vector<std::string> labels;
+    std::unordered_map<std::string, uint16_t> label_ids;
+
+    /* The path of each image (in the order of their IDs), and the
+     * image which each image path and annotation file belongs to. */
+    std::vector<std::string> image_paths;
+    std::vector<std::string> annotation_paths;
+    std::unordered_map<std::string, uint32_t> image_ids;
+    std::unordered_map<std::string, uint32_t> annotation_ids;
+
+    /* The boxes of all of the images, the range of each image in
+     * them, and the number of boxes which are no longer used. */
+    std::vector<StoredBox> boxes;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> capacities;
+    size_t unused = 0;
+
+    /* The images containing each label, sorted by their IDs. */
+    std::vector<std::vector<uint32_t>> label_images;
+
+public:
+    /**
+     * Creates a store for a set of images.
+     * @param image_list: The paths to the images.
+     * @param label_list: The labels from the configuration.
+     * @param writer: Finds the annotation file of each image.
+     */
+    AnnotationStore(const std::vector<std::string>& image_list,
+                    const std::vector<std::string>& label_list,
+                    const FileWriter& writer);
+
+    /**
+     * Reads all of the annotation files (in parallel), replacing
+     * anything which was already loaded.
+     * @param pool: The workers to read the files on.
+     */
+    void load(ThreadPool& pool);
+
+    /**
+     * Reads an annotation file again after it has changed.
+     * @param annotation_path: The path to the annotation file.
+     * @return Whether the file belongs to one of the images.
+     */
+    bool reload(const std::string& annotation_path);
+
+    /**
+     * Removes the boxes of the images whose annotation files were deleted.
+     * @param path: The annotation file, or a directory ending with `/`.
+     */
+    void remove(const std::string& path);
+
+    /**
+     * Returns the directories which contain the annotation files.
+     */
+    std::vector<std::string> annotation_directories() const;
+
+    /**
+     * Finds an image by its path.
+     * @return The ID of the image, or -1 if it does not exist.
+     */
+    int64_t find_image(const std::string& path) const;
+
+    /**
+     * Finds a label by its name.
+     * @return The ID of the label, or -1 if it does not exist.
+     */
+    int find_label(std::string_view label) const;
+
+    /**
+     * Returns the boxes of an image, and sets `count` to their number.
+     */
+    const StoredBox* image_boxes(uint32_t image, uint32_t& count) const {
+        count = counts[image];
+        return boxes.data() + offsets[image];
+    }
+
+    /**
+     * Returns the images which contain a label.
+     */
+    const std::vector<uint32_t>& images_with_label(int label) const { return label_images[label]; }
+
+    /**
+     * Returns the labels, in the order of their IDs.
+     */
+    const std::vector<std::string>& get_labels() const { return labels; }
+
+    /**
+     * Returns the image paths, in the order of their IDs.
+     */
+    const std::vector<std::string>& get_image_paths() const { return image_paths; }
+
+    /**
+     * Returns the total number of boxes.
+     */
+    size_t box_count() const { return boxes.size() - unused; }
+
+private:
+    /**
+     * Parses an annotation file.
+     * @param path: The path to the annotation file.
+     * @param parsed: Receives the boxes, where each label is an index
+     * into `new_labels` (which collects the labels that were seen).
+     */
+    void parse_file(const std::string& path, std::vector<StoredBox>& parsed,
+                    std::vector<std::string>& new_labels) const;
+
+    /**
+     * Maps the labels found by `parse_file` to label IDs, adding
+     * any labels which haven't been seen before.
+     */
+    void assign_labels(std::vector<StoredBox>& parsed, const std::vector<std::string>& new_labels);
+
+    /**
+     * Replaces the boxes of an image.
+     * @param image: The ID of the image.
+     * @param parsed: The new boxes.
+     */
+    void set_boxes(uint32_t image, const std::vector<StoredBox>& parsed);
+
+    /**
+     * Moves the boxes of every image to the start of the array, in order.
+     */
+    void compact();
+};
+
+#endif //ANNOTATION_STORE_H
@@ -0,0 +1,276 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "audit.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <unordered_set>
+
+#include "../system/imageinfo.h"
+
+using namespace std;
+namespace fs = std::__fs::filesystem;
+
+static const char* issue_names[NUM_ISSUES] = {
+        "Images without annotations", "Annotation files without images",
+        "Images with unreadable headers", "Malformed lines", "Unknown labels",
+        "Out of bounds boxes", "Degenerate boxes", "Inverted boxes"};
+
+/**
+ * Returns the power of two bucket of a box dimension.
+ */
+static int size_bucket(double size) {
+    if (size < 1.0)
+        return 0;
+    return min(SIZE_BUCKETS - 1, 1 + (int)floor(log2(size)));
+}
+
+DatasetStats::DatasetStats(size_t num_labels, bool keep_all)
+        : label_counts(num_labels, 0), keep_all_examples(keep_all) {}
+
+void DatasetStats::add_issue(DatasetIssue issue, const std::string& description) {
+    this->issue_counts[issue]++;
+    if (this->wants_example(issue))
+        this->issue_examples[issue].push_back(description);
+}
+
+void DatasetStats::merge(const DatasetStats& other) {
+    this->images += other.images;
+    this->annotation_files += other.annotation_files;
+    this->boxes += other.boxes;
+    for (size_t i = 0; i < this->label_counts.size(); i++)
+        this->label_counts[i] += other.label_counts[i];
+    for (const auto& label: other.unknown_labels)
+        this->unknown_labels[label.first] += label.second;
+    for (int i = 0; i < SIZE_BUCKETS; i++) {
+        this->width_histogram[i] += other.width_histogram[i];
+        this->height_histogram[i] += other.height_histogram[i];
+    }
+    for (int i = 0; i < ASPECT_BUCKETS; i++)
+        this->aspect_histogram[i] += other.aspect_histogram[i];
+    for (int i = 0; i < NUM_ISSUES; i++) {
+        this->issue_counts[i] += other.issue_counts[i];
+        for (const auto& example: other.issue_examples[i]) {
+            if (!this->wants_example((DatasetIssue)i))
+                break;
+            this->issue_examples[i].push_back(example);
+        }
+    }
+}
+
+/**
+ * Prints a histogram, with a bar showing the share of each bucket.
+ */
+static void print_histogram(std::ostream& out, const char* title, const uint64_t* counts,
+                            const std::vector<std::string>& names) {
+    uint64_t total = 0, largest = 1;
+    for (size_t i = 0; i < names.size(); i++) {
+        total += counts[i];
+        largest = max(largest, counts[i]);
+    }
+    out << "\n" << title << "\n";
+    for (size_t i = 0; i < names.size(); i++) {
+        char share[16];
+        snprintf(share, sizeof(share), "%6.2f%%", total ? 100.0 * counts[i] / total : 0.0);
+        out << "  " << setw(12) << left << names[i] << right << setw(12) << counts[i] << "  "
+            << share << "  " << string((size_t)lround(40.0 * counts[i] / largest), '#') << "\n";
+    }
+}
+
+void DatasetStats::print(std::ostream& out, const std::vector<std::string>& labels) const {
+    // Print the overall counts.
+    out << "Images: " << this->images << "\n"
+        << "Annotation files: " << this->annotation_files << "\n"
+        << "Boxes: " << this->boxes << "\n";
+
+    // Print the number of boxes with each label.
+    out << "\nLabels\n";
+    for (size_t i = 0; i < labels.size(); i++) {
+        out << "  " << setw(24) << left << labels[i] << right << setw(12)
+            << this->label_counts[i] << "\n";
+    }
+    for (const auto& label: this->unknown_labels) {
+        out << "  " << setw(24) << left << (label.first + " (unknown)") << right
+            << setw(12) << label.second << "\n";
+    }
+
+    // Print the histograms of the box sizes and aspect ratios.
+    vector<string> size_names = {"0"};
+    for (int i = 1; i < SIZE_BUCKETS; i++) {
+        string low = to_string(1 << (i - 1)), high = to_string((1 << i) - 1);
+        if (i == SIZE_BUCKETS - 1) {
+            size_names.push_back(low + "+");
+        } else {
+            size_names.push_back((low == high) ? low : low + "-" + high);
+        }
+    }
+    vector<string> aspect_names;
+    for (int i = 0; i < ASPECT_BUCKETS; i++) {
+        int exponent = i - ASPECT_BUCKETS / 2;
+        string name = (exponent < 0) ? "1:" + to_string(1 << -exponent)
+                                     : to_string(1 << exponent) + ":1";
+        if (i == 0) name = "<=" + name;
+        if (i == ASPECT_BUCKETS - 1) name = ">=" + name;
+        aspect_names.push_back(name);
+    }
+    print_histogram(out, "Box widths (pixels)", this->width_histogram, size_names);
+    print_histogram(out, "Box heights (pixels)", this->height_histogram, size_names);
+    print_histogram(out, "Box aspect ratios (width:height)", this->aspect_histogram, aspect_names);
+
+    // Print each kind of issue, along with the examples of it.
+    out << "\nIssues\n";
+    for (int i = 0; i < NUM_ISSUES; i++) {
+        out << "  " << setw(36) << left << issue_names[i] << right
+            << setw(12) << this->issue_counts[i] << "\n";
+        for (const auto& example: this->issue_examples[i]) {
+            out << "      " << example << "\n";
+        }
+        if (this->issue_counts[i] > this->issue_examples[i].size()) {
+            out << "      ... and " << (this->issue_counts[i] - this->issue_examples[i].size())
+                << " more\n";
+        }
+    }
+}
+
+DatasetAuditor::DatasetAuditor(const std::vector<std::string>& label_list,
+                               const std::vector<int>& mode_choice, bool keep_all)
+        : labels(label_list), mode(mode_choice), writer(mode_choice),
+          keep_all_examples(keep_all) {
+    // The index refers to the strings owned by the auditor.
+    for (size_t i = 0; i < this->labels.size(); i++) {
+        this->label_index.emplace(std::string_view(this->labels[i]), (int)i);
+    }
+}
+
+DatasetStats DatasetAuditor::audit_images(const std::vector<std::string>& image_paths,
+                                          size_t begin, size_t end) const {
+    DatasetStats stats = this->empty_stats();
+    for (size_t i = begin; i < end; i++) {
+        const string& image_path = image_paths[i];
+        stats.images++;
+
+        // Map the annotation file, if there is one.
+        string annotation_path = this->writer.annotation_path(image_path.c_str());
+        MappedFile file(annotation_path);
+        if (!file.is_open()) {
+            stats.add_issue(ISSUE_MISSING, image_path);
+            continue;
+        }
+        stats.annotation_files++;
+
+        // Read the dimensions of the image from its header.
+        int width = 0, height = 0;
+        bool has_size = read_image_size(image_path, width, height);
+        if (!has_size)
+            stats.add_issue(ISSUE_UNREADABLE_IMAGE, image_path);
+
+        // Check each of the boxes in the file.
+        this->audit_file(annotation_path, file.view(), has_size, width, height, stats);
+    }
+    return stats;
+}
+
+void DatasetAuditor::audit_file(const std::string& path, std::string_view contents,
+                                bool has_size, int width, int height, DatasetStats& stats) const {
+    AnnotationParser parser(contents, this->mode);
+    ParsedBox box{};
+
+    // Counts an issue with the current box, and only describes
+    // it for the examples (since most issues aren't printed).
+    auto report = [&](DatasetIssue issue, const std::string& detail) {
+        if (!stats.wants_example(issue)) {
+            stats.issue_counts[issue]++;
+            return;
+        }
+        char buffer[160];
+        snprintf(buffer, sizeof(buffer), ":%zu: %.*s (%g, %g, %g, %g)", parser.line(),
+                 (int)min<size_t>(box.label.size(), 48), box.label.data(),
+                 box.coordinates[0], box.coordinates[1], box.coordinates[2], box.coordinates[3]);
+        stats.add_issue(issue, path + buffer + detail);
+    };
+
+    ParseResult result;
+    while ((result = parser.next(box)) != PARSE_END) {
+        if (result == PARSE_MALFORMED) {
+            stats.add_issue(ISSUE_MALFORMED, path + ":" + to_string(parser.line()));
+            continue;
+        }
+        stats.boxes++;
+
+        // Count the label.
+        auto label = this->label_index.find(box.label);
+        if (label != this->label_index.end()) {
+            stats.label_counts[label->second]++;
+        } else {
+            stats.unknown_labels[string(box.label)]++;
+            report(ISSUE_UNKNOWN_LABEL, "");
+        }
+
+        // Check the orientation and size of the box (the two-click
+        // interface can produce boxes in either corner order).
+        const double* c = box.coordinates;
+        if (c[2] < c[0] || c[3] < c[1]) {
+            report(ISSUE_INVERTED, "");
+        }
+        double box_width = fabs(c[2] - c[0]), box_height = fabs(c[3] - c[1]);
+        if (box_width == 0.0 || box_height == 0.0) {
+            report(ISSUE_DEGENERATE, "");
+        }
+
+        // Check the box against the edges of the image.
+        if (has_size && (min(c[0], c[2]) < 0 || min(c[1], c[3]) < 0 ||
+                         max(c[0], c[2]) >= width || max(c[1], c[3]) >= height)) {
+            report(ISSUE_OUT_OF_BOUNDS, " outside of " + to_string(width) + "x" + to_string(height));
+        }
+
+        // Add the box to the histograms.
+        stats.width_histogram[size_bucket(box_width)]++;
+        stats.height_histogram[size_bucket(box_height)]++;
+        if (box_width > 0.0 && box_height > 0.0) {
+            int bucket = (int)lround(log2(box_width / box_height)) + ASPECT_BUCKETS / 2;
+            stats.aspect_histogram[max(0, min(ASPECT_BUCKETS - 1, bucket))]++;
+        }
+    }
+}
+
+void DatasetAuditor::find_orphans(const std::vector<std::string>& image_paths,
+                                  DatasetStats& stats) const {
+    // Get the annotation file of each image, and the directories they are in.
+    unordered_set<string> expected;
+    unordered_set<string> directories;
+    for (const auto& image_path: image_paths) {
+        string annotation_path = this->writer.annotation_path(image_path.c_str());
+        directories.insert(fs::path(annotation_path).parent_path().string());
+        expected.insert(std::move(annotation_path));
+    }
+
+    // Any other annotation files in those directories are orphans.
+    vector<string> orphans;
+    for (const auto& directory: directories) {
+        error_code error;
+        for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+            const fs::path& path = it->path();
+            if (path.extension() == ".txt" && expected.find(path.string()) == expected.end())
+                orphans.push_back(path.string());
+        }
+    }
+    sort(orphans.begin(), orphans.end());
+    for (const auto& orphan: orphans) {
+        stats.add_issue(ISSUE_ORPHAN, orphan);
+    }
+}
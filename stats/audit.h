@@ -0,0 +1,176 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_AUDIT_H
+#define ANNOTATION_AUDIT_H
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "parser.h"
+#include "../writer/textwriter.h"
+
+#define SIZE_BUCKETS 14
+#define ASPECT_BUCKETS 11
+#define MAX_ISSUE_EXAMPLES 10
+
+/**
+ * The different problems which can be found in a dataset.
+ */
+enum DatasetIssue {
+    /* An image which doesn't have an annotation file. */
+    ISSUE_MISSING = 0,
+    /* An annotation file which doesn't have an image. */
+    ISSUE_ORPHAN,
+    /* An image whose dimensions couldn't be read from its header. */
+    ISSUE_UNREADABLE_IMAGE,
+    /* A line of an annotation file which couldn't be parsed. */
+    ISSUE_MALFORMED,
+    /* A box with a label which isn't in the configuration. */
+    ISSUE_UNKNOWN_LABEL,
+    /* A box which extends past the edges of the image. */
+    ISSUE_OUT_OF_BOUNDS,
+    /* A box with a width or height of zero. */
+    ISSUE_DEGENERATE,
+    /* A box whose second corner is above or left of its first. */
+    ISSUE_INVERTED,
+    NUM_ISSUES
+};
+
+/**
+ * The statistics of (part of) a dataset, which are collected
+ * separately for each chunk of images and then merged together.
+ */
+struct DatasetStats {
+    /* The number of images, annotation files, and boxes. */
+    uint64_t images = 0;
+    uint64_t annotation_files = 0;
+    uint64_t boxes = 0;
+
+    /* The number of boxes with each of the configured labels,
+     * and with each of the labels which aren't configured. */
+    std::vector<uint64_t> label_counts;
+    std::map<std::string, uint64_t> unknown_labels;
+
+    /* Histograms of the box widths and heights (in power of two
+     * buckets), and of their aspect ratios (from 1:32 to 32:1). */
+    uint64_t width_histogram[SIZE_BUCKETS] = {};
+    uint64_t height_histogram[SIZE_BUCKETS] = {};
+    uint64_t aspect_histogram[ASPECT_BUCKETS] = {};
+
+    /* The number of each kind of issue, and a description
+     * of the first few of them (or all of them). */
+    uint64_t issue_counts[NUM_ISSUES] = {};
+    std::vector<std::string> issue_examples[NUM_ISSUES];
+    bool keep_all_examples = false;
+
+    /**
+     * Creates an empty set of statistics.
+     * @param num_labels: The number of configured labels.
+     * @param keep_all: Whether to describe every issue.
+     */
+    DatasetStats(size_t num_labels, bool keep_all);
+
+    /**
+     * Returns whether the next issue of a kind should be described,
+     * so that the description is only built when it is needed.
+     */
+    bool wants_example(DatasetIssue issue) const {
+        return keep_all_examples || issue_examples[issue].size() < MAX_ISSUE_EXAMPLES;
+    }
+
+    /**
+     * Counts an issue, keeping its description if it is wanted.
+     */
+    void add_issue(DatasetIssue issue, const std::string& description);
+
+    /**
+     * Adds the statistics of another part of the dataset.
+     */
+    void merge(const DatasetStats& other);
+
+    /**
+     * Prints a report of the statistics.
+     * @param out: The stream to print to.
+     * @param labels: The names of the configured labels.
+     */
+    void print(std::ostream& out, const std::vector<std::string>& labels) const;
+};
+
+/**
+ * Audits the annotation files of a dataset, cross-checking
+ * each box against the dimensions of its image (which are
+ * read from the image header, without decoding the image).
+ */
+class DatasetAuditor {
+private:
+    /* The configured labels, and an index of them. */
+    std::vector<std::string> labels;
+    std::unordered_map<std::string_view, int> label_index;
+
+    /* The column order of the coordinates in the files. */
+    std::vector<int> mode;
+
+    /* Finds the annotation file of each image. */
+    TextFileWriter writer;
+
+    /* Whether to describe every issue, rather than the first few. */
+    bool keep_all_examples;
+
+public:
+    /**
+     * Creates an auditor for the files written with a certain configuration.
+     * @param label_list: The configured labels.
+     * @param mode_choice: The column order of the coordinates.
+     * @param keep_all: Whether to describe every issue.
+     */
+    DatasetAuditor(const std::vector<std::string>& label_list,
+                   const std::vector<int>& mode_choice, bool keep_all);
+
+    /**
+     * Audits the annotation files of a range of images.
+     * @param image_paths: All of the image paths.
+     * @param begin: The index of the first image to audit.
+     * @param end: The index after the last image to audit.
+     */
+    DatasetStats audit_images(const std::vector<std::string>& image_paths,
+                              size_t begin, size_t end) const;
+
+    /**
+     * Finds the annotation files which don't belong to any of the
+     * images, in the directories that the annotation files are in.
+     * @param image_paths: All of the image paths.
+     * @param stats: Receives the orphaned files.
+     */
+    void find_orphans(const std::vector<std::string>& image_paths, DatasetStats& stats) const;
+
+    /**
+     * Creates an empty set of statistics for this dataset.
+     */
+    DatasetStats empty_stats() const { return DatasetStats(labels.size(), keep_all_examples); }
+
+private:
+    /**
+     * Audits each of the boxes in an annotation file.
+     */
+    void audit_file(const std::string& path, std::string_view contents,
+                    bool has_size, int width, int height, DatasetStats& stats) const;
+};
+
+#endif //ANNOTATION_AUDIT_H
@@ -0,0 +1,125 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "parser.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    this->opened = true;
+
+    // Map the file, which is then kept open by the mapping itself.
+    struct stat buf{};
+    if (fstat(fd, &buf) == 0 && buf.st_size > 0) {
+        void* mapped = mmap(nullptr, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            this->contents = static_cast<const char*>(mapped);
+            this->length = buf.st_size;
+            madvise(mapped, buf.st_size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (this->contents != nullptr)
+        munmap(const_cast<char*>(this->contents), this->length);
+}
+
+/**
+ * Parses a decimal number (as written by `std::to_string`, e.g.
+ * `-12.500000`), advancing the cursor past it.
+ * @return Whether a number was found.
+ */
+static bool parse_number(const char*& p, const char* end, double& value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    // Read the integer part, then the fractional part.
+    const char* start = p;
+    double result = 0.0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        result = result * 10.0 + (*p - '0');
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        double scale = 0.1;
+        while (p < end && *p >= '0' && *p <= '9') {
+            result += (*p - '0') * scale;
+            scale *= 0.1;
+            p++;
+        }
+    }
+    if (p == start)
+        return false;
+    value = negative ? -result : result;
+    return true;
+}
+
+AnnotationParser::AnnotationParser(std::string_view buffer, const std::vector<int>& mode_choice)
+        : cursor(buffer.data()), end(buffer.data() + buffer.size()), mode(mode_choice) {}
+
+ParseResult AnnotationParser::next(ParsedBox& box) {
+    auto is_space = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+    while (this->cursor < this->end) {
+        // Find the end of the line.
+        const char* p = this->cursor;
+        const char* line_end = static_cast<const char*>(
+                memchr(p, '\n', this->end - p));
+        if (line_end == nullptr)
+            line_end = this->end;
+        this->cursor = (line_end < this->end) ? line_end + 1 : this->end;
+        this->line_number++;
+
+        // Skip empty lines.
+        while (p < line_end && is_space(*p))
+            p++;
+        if (p == line_end)
+            continue;
+
+        // Read the label, which is everything up to the first space.
+        const char* label_start = p;
+        while (p < line_end && !is_space(*p))
+            p++;
+        box.label = std::string_view(label_start, p - label_start);
+
+        // Read each of the coordinates into its position.
+        for (int position: this->mode) {
+            while (p < line_end && is_space(*p))
+                p++;
+            if (position < 0 || position > 3 || !parse_number(p, line_end, box.coordinates[position]))
+                return PARSE_MALFORMED;
+        }
+
+        // There shouldn't be anything else on the line.
+        while (p < line_end && is_space(*p))
+            p++;
+        return (p == line_end) ? PARSE_BOX : PARSE_MALFORMED;
+    }
+    return PARSE_END;
+}
@@ -0,0 +1,122 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_PARSER_H
+#define ANNOTATION_PARSER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * A read-only memory mapping of a file, so that it can
+ * be parsed in place without copying it into a buffer.
+ */
+class MappedFile {
+private:
+    /* The mapped contents, and their size in bytes. */
+    const char* contents = nullptr;
+    size_t length = 0;
+
+    /* Whether the file was opened (empty files aren't mapped). */
+    bool opened = false;
+
+public:
+    /**
+     * Maps a file into memory.
+     * @param path: The path to the file.
+     */
+    explicit MappedFile(const std::string& path);
+
+    /**
+     * Unmaps the file.
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * Returns whether the file could be opened.
+     */
+    bool is_open() const { return opened; }
+
+    /**
+     * Returns the contents of the file.
+     */
+    std::string_view view() const { return std::string_view(contents, length); }
+};
+
+/**
+ * A single line of an annotation file, where the label points
+ * into the parsed buffer, and the coordinates are in the order
+ * [x1, y1, x2, y2] (with the column order of the mode undone).
+ */
+struct ParsedBox {
+    std::string_view label;
+    double coordinates[4];
+};
+
+/**
+ * The different results of parsing a line of an annotation file.
+ */
+enum ParseResult {
+    /* The line contained a label and all four coordinates. */
+    PARSE_BOX = 0,
+    /* The line was not empty, but it could not be parsed. */
+    PARSE_MALFORMED = 1,
+    /* There are no more lines in the buffer. */
+    PARSE_END = 2
+};
+
+/**
+ * Parses the lines written by `TextFileWriter` directly
+ * from a buffer, without copying or allocating anything
+ * for each line (so that large datasets can be audited).
+ */
+class AnnotationParser {
+private:
+    /* The current position in the buffer, and its end. */
+    const char* cursor;
+    const char* end;
+
+    /* The column which each coordinate is written to. */
+    std::vector<int> mode;
+
+    /* The number of the line which was last parsed. */
+    size_t line_number = 0;
+
+public:
+    /**
+     * Starts parsing a buffer.
+     * @param buffer: The contents of an annotation file.
+     * @param mode_choice: The column order of the coordinates.
+     */
+    AnnotationParser(std::string_view buffer, const std::vector<int>& mode_choice);
+
+    /**
+     * Parses the next non-empty line of the buffer.
+     * @param box: Receives the label and coordinates.
+     * @return One of the `ParseResult` values.
+     */
+    ParseResult next(ParsedBox& box);
+
+    /**
+     * Returns the (one-based) number of the line which was last parsed.
+     */
+    size_t line() const { return line_number; }
+};
+
+#endif //ANNOTATION_PARSER_H
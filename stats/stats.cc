@@ -0,0 +1,79 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <vector>
+
+#include "audit.h"
+#include "../config/config.h"
+#include "../system/paths.h"
+#include "../system/threadpool.h"
+
+#define IMAGES_PER_TASK 512
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    // Check whether every issue should be listed, rather than the first few.
+    bool list_all = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--all") == 0) {
+            list_all = true;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--all]" << endl;
+            return 1;
+        }
+    }
+    auto start = chrono::steady_clock::now();
+
+    // Load the same configuration as the annotator, which
+    // determines where the annotation files are and their format.
+    UserConfig config;
+    config.load_config();
+    if (!path_exists(config.image_directory.c_str())) {
+        const char* msg = "The provided image directory does not exist";
+        error_exit(msg);
+    }
+    vector<string> image_paths = get_image_paths(config.image_directory.c_str(), config.recurse);
+    DatasetAuditor auditor(config.labels, config.mode_order, list_all);
+
+    // Audit the images in chunks on all of the cores, each of which
+    // collects its own statistics (so they don't contend with each other).
+    ThreadPool pool;
+    vector<future<DatasetStats>> chunks;
+    for (size_t begin = 0; begin < image_paths.size(); begin += IMAGES_PER_TASK) {
+        size_t end = min(image_paths.size(), begin + IMAGES_PER_TASK);
+        chunks.push_back(pool.submit([&auditor, &image_paths, begin, end]() {
+            return auditor.audit_images(image_paths, begin, end);
+        }));
+    }
+
+    // Look for orphaned annotation files in the meantime.
+    DatasetStats stats = auditor.empty_stats();
+    auditor.find_orphans(image_paths, stats);
+
+    // Merge the statistics in order, so the examples are deterministic.
+    for (auto& chunk: chunks) {
+        stats.merge(chunk.get());
+    }
+    stats.print(cout, config.labels);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "\nAudited " << stats.images << " images and " << stats.boxes
+         << " boxes in " << seconds << " seconds" << endl;
+    return 0;
+}
@@ -0,0 +1,323 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "imageinfo.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <opencv2/imgcodecs.hpp>
+
+/* The number of bytes which are read from the start of each image. */
+#define HEADER_PROBE_BYTES 4096
+
+/* The number of bytes of the EXIF segment which are searched for the
+ * orientation (which is near its start, before any thumbnail). */
+#define EXIF_PROBE_BYTES 1024
+
+using namespace std;
+
+/**
+ * Reads big- and little-endian integers from a byte buffer.
+ */
+static uint32_t read_be16(const unsigned char* p) { return (p[0] << 8) | p[1]; }
+static uint32_t read_be32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+static uint32_t read_le16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+static uint32_t read_le24(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16); }
+static uint32_t read_le32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Reads ranges of a file, which are served from the first few KB of
+ * it (which are read at once) where possible, and otherwise with `pread`.
+ */
+class HeaderReader {
+private:
+    /* The file, and the bytes at its start. */
+    int fd;
+    unsigned char buffer[HEADER_PROBE_BYTES];
+    size_t buffered = 0;
+
+public:
+    explicit HeaderReader(const std::string& path) : fd(open(path.c_str(), O_RDONLY)) {
+        if (this->fd == -1)
+            return;
+        ssize_t count = pread(this->fd, this->buffer, sizeof(this->buffer), 0);
+        this->buffered = (count > 0) ? (size_t)count : 0;
+    }
+
+    ~HeaderReader() {
+        if (this->fd != -1)
+            close(this->fd);
+    }
+
+    HeaderReader(const HeaderReader&) = delete;
+    HeaderReader& operator=(const HeaderReader&) = delete;
+
+    /**
+     * Returns whether the file could be opened.
+     */
+    bool is_open() const {
+        return this->fd != -1;
+    }
+
+    /**
+     * Returns the bytes at the start of the file, and how many there are.
+     */
+    const unsigned char* header() const {
+        return this->buffer;
+    }
+    size_t header_size() const {
+        return this->buffered;
+    }
+
+    /**
+     * Reads exactly `size` bytes at an offset in the file.
+     * @return Whether all of the bytes could be read.
+     */
+    bool read(uint64_t offset, void* out, size_t size) {
+        if (offset + size <= this->buffered) {
+            memcpy(out, this->buffer + offset, size);
+            return true;
+        }
+        auto* bytes = (unsigned char*)out;
+        while (size > 0) {
+            ssize_t count = pread(this->fd, bytes, size, (off_t)offset);
+            if (count <= 0)
+                return false;
+            bytes += count; offset += (uint64_t)count; size -= (size_t)count;
+        }
+        return true;
+    }
+};
+
+/**
+ * Finds the orientation in the contents of an EXIF segment, which is a
+ * TIFF structure whose first directory holds the orientation tag.
+ * @return The orientation, or 1 (upright) if there is none.
+ */
+static int read_exif_orientation(const unsigned char* exif, size_t size) {
+    // Check the identifier and the byte order of the TIFF header.
+    if (size < 14 || memcmp(exif, "Exif\0\0", 6) != 0)
+        return 1;
+    const unsigned char* tiff = exif + 6;
+    size_t tiff_size = size - 6;
+    bool little_endian = memcmp(tiff, "II", 2) == 0;
+    if (!little_endian && memcmp(tiff, "MM", 2) != 0)
+        return 1;
+    auto read16 = [little_endian](const unsigned char* p) {
+        return little_endian ? read_le16(p) : read_be16(p);
+    };
+    auto read32 = [little_endian](const unsigned char* p) {
+        return little_endian ? read_le32(p) : read_be32(p);
+    };
+
+    // Search the entries of the first directory for the orientation
+    // (tag 0x0112), which is a short stored within the entry itself.
+    uint32_t directory = read32(tiff + 4);
+    if (directory > tiff_size - 2)
+        return 1;
+    uint32_t entries = read16(tiff + directory);
+    for (uint32_t i = 0; i < entries; i++) {
+        size_t entry = directory + 2 + (size_t)i * 12;
+        if (entry + 12 > tiff_size)
+            break;
+        if (read16(tiff + entry) == 0x0112) {
+            uint32_t orientation = read16(tiff + entry + 8);
+            return (orientation >= 1 && orientation <= 8) ? (int)orientation : 1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Walks through the segments of a JPEG file until the start of frame
+ * segment (which holds the dimensions), skipping over the contents of
+ * the other segments (e.g., large EXIF thumbnails) without reading them,
+ * other than the start of the EXIF segment (for the orientation).
+ */
+static bool read_jpeg_size(HeaderReader& reader, ImageSize& size) {
+    // Start after the start of image marker.
+    uint64_t offset = 2;
+    unsigned char segment[7];
+    while (true) {
+        // Find the next marker, skipping any fill bytes.
+        if (!reader.read(offset++, segment, 1) || segment[0] != 0xFF)
+            return false;
+        do {
+            if (!reader.read(offset++, segment, 1))
+                return false;
+        } while (segment[0] == 0xFF);
+        int marker = segment[0];
+
+        // Markers without a length (restart markers and the like).
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+            continue;
+
+        // The image data has started, without a frame header.
+        if (marker == 0xD9 || marker == 0xDA)
+            return false;
+
+        if (!reader.read(offset, segment, 2))
+            return false;
+        uint32_t length = read_be16(segment);
+        if (length < 2)
+            return false;
+
+        // The EXIF segment comes before the frame header.
+        if (marker == 0xE1 && size.orientation == 1) {
+            unsigned char exif[EXIF_PROBE_BYTES];
+            size_t count = min<size_t>(length - 2, sizeof(exif));
+            if (reader.read(offset + 2, exif, count))
+                size.orientation = read_exif_orientation(exif, count);
+        }
+
+        // The start of frame markers are 0xC0 to 0xCF, except for
+        // 0xC4 (Huffman tables), 0xC8 (reserved), and 0xCC (arithmetic).
+        if (marker >= 0xC0 && marker <= 0xCF &&
+            marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (length < 7 || !reader.read(offset + 2, segment + 2, 5))
+                return false;
+            size.height = (int)read_be16(segment + 3);
+            size.width = (int)read_be16(segment + 5);
+            return size.width > 0 && size.height > 0;
+        }
+
+        // Skip over the rest of the segment.
+        offset += length;
+    }
+}
+
+/**
+ * Reads the dimensions from the header of one of the supported formats.
+ * @param recognized: Set when the file is one of the supported formats.
+ * @return Whether the dimensions could be read.
+ */
+static bool read_header_size(HeaderReader& reader, ImageSize& size, bool& recognized) {
+    const unsigned char* header = reader.header();
+    size_t count = reader.header_size();
+    recognized = true;
+
+    // JPEG, which needs to find the frame header.
+    if (count >= 4 && header[0] == 0xFF && header[1] == 0xD8) {
+        return read_jpeg_size(reader, size);
+    }
+
+    // PNG, where the first chunk is always the image header.
+    if (count >= 24 && memcmp(header, "\x89PNG\r\n\x1a\n", 8) == 0 &&
+        memcmp(header + 12, "IHDR", 4) == 0) {
+        size.width = (int)read_be32(header + 16);
+        size.height = (int)read_be32(header + 20);
+        return size.width > 0 && size.height > 0;
+    }
+
+    // GIF, with the dimensions in the logical screen descriptor.
+    if (count >= 10 && memcmp(header, "GIF8", 4) == 0) {
+        size.width = (int)read_le16(header + 6);
+        size.height = (int)read_le16(header + 8);
+        return size.width > 0 && size.height > 0;
+    }
+
+    // BMP, where the height is negative for top-down images.
+    if (count >= 26 && header[0] == 'B' && header[1] == 'M') {
+        size.width = (int)read_le32(header + 18);
+        size.height = abs((int)read_le32(header + 22));
+        return size.width > 0 && size.height > 0;
+    }
+
+    // WebP, which has a different header for each encoding.
+    if (count >= 30 && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WEBP", 4) == 0) {
+        if (memcmp(header + 12, "VP8 ", 4) == 0) {
+            size.width = (int)(read_le16(header + 26) & 0x3FFF);
+            size.height = (int)(read_le16(header + 28) & 0x3FFF);
+        } else if (memcmp(header + 12, "VP8L", 4) == 0) {
+            uint32_t bits = read_le32(header + 21);
+            size.width = (int)(bits & 0x3FFF) + 1;
+            size.height = (int)((bits >> 14) & 0x3FFF) + 1;
+        } else if (memcmp(header + 12, "VP8X", 4) == 0) {
+            size.width = (int)read_le24(header + 24) + 1;
+            size.height = (int)read_le24(header + 27) + 1;
+        } else {
+            return false;
+        }
+        return size.width > 0 && size.height > 0;
+    }
+    recognized = false;
+    return false;
+}
+
+ImageSize probe_image(const std::string& path) {
+    ImageSize size;
+    bool recognized;
+    {
+        HeaderReader reader(path);
+        if (!reader.is_open())
+            return size;
+        size.valid = read_header_size(reader, size, recognized);
+    }
+
+    // Decode the formats which aren't supported (e.g., TIFF) with OpenCV,
+    // which applies the orientation itself (a damaged header of one of
+    // the supported formats won't decode either, so it isn't tried).
+    if (!recognized) {
+        cv::Mat image = cv::imread(path);
+        if (image.empty())
+            return size;
+        size.width = image.cols;
+        size.height = image.rows;
+        size.valid = true;
+        return size;
+    }
+
+    // The orientations from 5 to 8 are rotated by a quarter turn.
+    if (size.valid && size.orientation >= 5)
+        swap(size.width, size.height);
+    return size;
+}
+
+std::vector<ImageSize> probe_images(const std::vector<std::string>& paths, ThreadPool& workers) {
+    // Each chunk writes to its own range of the results.
+    vector<ImageSize> sizes(paths.size());
+    vector<future<void>> chunks;
+    for (size_t begin = 0; begin < paths.size(); begin += PROBE_CHUNK) {
+        size_t end = min(paths.size(), begin + PROBE_CHUNK);
+        chunks.push_back(workers.submit([&paths, &sizes, begin, end]() {
+            for (size_t i = begin; i < end; i++) {
+                sizes[i] = probe_image(paths[i]);
+            }
+        }));
+    }
+    for (auto& chunk: chunks) {
+        chunk.get();
+    }
+    return sizes;
+}
+
+bool read_image_size(const std::string& path, int& width, int& height) {
+    ImageSize size = probe_image(path);
+    if (!size.valid)
+        return false;
+    width = size.width;
+    height = size.height;
+    return true;
+}
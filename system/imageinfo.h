@@ -0,0 +1,81 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_IMAGEINFO_H
+#define ANNOTATION_IMAGEINFO_H
+
+#include <string>
+#include <vector>
+
+#include "threadpool.h"
+
+/* The number of paths which are probed by each task, when
+ * a batch of images is probed across the workers. */
+#define PROBE_CHUNK 256
+
+/**
+ * The dimensions of an image, as read from its header.
+ */
+struct ImageSize {
+    /* The dimensions of the image as it is displayed, which is after
+     * the EXIF orientation is applied (as it is by `cv::imread`), so
+     * they match the coordinates of the boxes drawn on the image. */
+    int width = 0;
+    int height = 0;
+
+    /* The EXIF orientation of the image (from 1 to 8, where 1 is
+     * upright), where 5 to 8 swap the stored width and height. */
+    int orientation = 1;
+
+    /* Whether the dimensions could be read. */
+    bool valid = false;
+};
+
+/**
+ * Reads the dimensions of an image from its header, without decoding
+ * the image. The first few KB of the file are read with a single
+ * `pread`, which holds the header of most images (JPEG files with large
+ * metadata segments take one more read for each segment past it).
+ *
+ * JPEG (with the EXIF orientation), PNG, GIF, BMP, and WebP files
+ * are supported. Other formats are decoded with OpenCV instead,
+ * which is much slower (but rare).
+ *
+ * @param path: The path to the image.
+ * @return The dimensions of the image (which are not valid if
+ * it could not be read).
+ */
+ImageSize probe_image(const std::string& path);
+
+/**
+ * Reads the dimensions of many images from their headers, split
+ * into chunks across the workers (since most of the time is spent
+ * waiting for the files to be opened and read).
+ * @param paths: The paths to the images.
+ * @param workers: The pool to probe the images on.
+ * @return The dimensions of each of the images.
+ */
+std::vector<ImageSize> probe_images(const std::vector<std::string>& paths, ThreadPool& workers);
+
+/**
+ * Reads the dimensions of an image from its header,
+ * without decoding the image (see `probe_image`).
+ * @param path: The path to the image.
+ * @param width: Receives the (displayed) width of the image.
+ * @param height: Receives the (displayed) height of the image.
+ * @return Whether the dimensions could be read.
+ */
+bool read_image_size(const std::string& path, int& width, int& height);
+
+#endif //ANNOTATION_IMAGEINFO_H
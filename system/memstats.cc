@@ -0,0 +1,130 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "memstats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <malloc.h>
+#include <unistd.h>
+#define usable_size(p) malloc_usable_size(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define usable_size(p) malloc_size(p)
+#endif
+
+using namespace std;
+
+/* The heap counters, which are updated by every allocation. */
+static atomic<size_t> allocation_count(0);
+static atomic<size_t> live_bytes(0);
+static atomic<size_t> peak_live_bytes(0);
+
+void* operator new(size_t size) {
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw bad_alloc();
+    allocation_count.fetch_add(1, memory_order_relaxed);
+#ifdef usable_size
+    // Track the live bytes using the size the allocator actually
+    // reserved, so that the same size is subtracted when it is freed.
+    size_t live = live_bytes.fetch_add(usable_size(p), memory_order_relaxed) + usable_size(p);
+    size_t peak = peak_live_bytes.load(memory_order_relaxed);
+    while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live, memory_order_relaxed)) {}
+#endif
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (p == nullptr)
+        return;
+#ifdef usable_size
+    live_bytes.fetch_sub(usable_size(p), memory_order_relaxed);
+#endif
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    ::operator delete(p);
+}
+
+MemoryUsage get_memory_usage() {
+    MemoryUsage usage;
+    usage.allocations = allocation_count.load(memory_order_relaxed);
+    usage.bytes_live = live_bytes.load(memory_order_relaxed);
+    usage.peak_bytes_live = peak_live_bytes.load(memory_order_relaxed);
+#ifdef usable_size
+    usage.bytes_tracked = true;
+#endif
+
+    // The peak resident size is in kilobytes on Linux, and in bytes on macOS.
+    struct rusage resources{};
+    if (getrusage(RUSAGE_SELF, &resources) == 0) {
+#ifdef __APPLE__
+        usage.peak_rss = (size_t)resources.ru_maxrss;
+#else
+        usage.peak_rss = (size_t)resources.ru_maxrss * 1024;
+#endif
+    }
+
+#ifdef __linux__
+    // The current resident size is the second field of `statm`, in pages.
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm != nullptr) {
+        size_t pages, resident;
+        if (fscanf(statm, "%zu %zu", &pages, &resident) == 2)
+            usage.rss = resident * (size_t)sysconf(_SC_PAGESIZE);
+        fclose(statm);
+    }
+#endif
+    return usage;
+}
+
+void SessionMemoryStats::begin_image() {
+    this->image_start = get_memory_usage();
+}
+
+void SessionMemoryStats::end_image() {
+    MemoryUsage usage = get_memory_usage();
+    size_t allocations = usage.allocations - this->image_start.allocations;
+    this->total_allocations += allocations;
+    this->max_allocations = max(this->max_allocations, allocations);
+    if (this->images == 0)
+        this->first_bytes_live = usage.bytes_live;
+    this->images += 1;
+}
+
+void SessionMemoryStats::print() const {
+    MemoryUsage usage = get_memory_usage();
+    if (this->images > 0) {
+        printf("Memory: %zu images, %.0f allocations per image (%zu max)\n", this->images,
+               (double)this->total_allocations / (double)this->images, this->max_allocations);
+    }
+    if (usage.bytes_tracked) {
+        printf("Heap:   %.1f MB live (%.1f MB peak), %+.1f MB since the first image\n",
+               usage.bytes_live / 1e6, usage.peak_bytes_live / 1e6,
+               this->images > 0 ? ((double)usage.bytes_live - (double)this->first_bytes_live) / 1e6 : 0.0);
+    }
+    if (usage.rss > 0) {
+        printf("RSS:    %.1f MB (%.1f MB peak)\n", usage.rss / 1e6, usage.peak_rss / 1e6);
+    } else {
+        printf("RSS:    %.1f MB peak\n", usage.peak_rss / 1e6);
+    }
+}
@@ -0,0 +1,81 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_MEMSTATS_H
+#define ANNOTATION_MEMSTATS_H
+
+#include <cstddef>
+
+/**
+ * A snapshot of the memory used by the process.
+ */
+struct MemoryUsage {
+    /* The number of heap allocations made since the process started. */
+    size_t allocations = 0;
+
+    /* The number of heap bytes which are currently allocated, and the
+     * most that have ever been (only when `bytes_tracked` is set). */
+    size_t bytes_live = 0;
+    size_t peak_bytes_live = 0;
+    bool bytes_tracked = false;
+
+    /* The current and peak resident set size in bytes (the current
+     * size is only known on Linux, and is zero otherwise). */
+    size_t rss = 0;
+    size_t peak_rss = 0;
+};
+
+/**
+ * Returns the memory currently used by the process. The heap is
+ * tracked by replacing the global `operator new` and `operator delete`.
+ */
+MemoryUsage get_memory_usage();
+
+/**
+ * Tracks the heap allocations made while each image is annotated, and
+ * how the heap grows over a session, so that memory which creeps up
+ * over long sessions can be noticed (and narrowed down).
+ */
+class SessionMemoryStats {
+private:
+    /* The usage when the current image started. */
+    MemoryUsage image_start;
+
+    /* The number of images, and the allocations made for them. */
+    size_t images = 0;
+    size_t total_allocations = 0;
+    size_t max_allocations = 0;
+
+    /* The live heap bytes after the first image, which the
+     * growth over the rest of the session is measured from. */
+    size_t first_bytes_live = 0;
+
+public:
+    /**
+     * Marks the start of the annotation of an image.
+     */
+    void begin_image();
+
+    /**
+     * Marks the end of the annotation of an image.
+     */
+    void end_image();
+
+    /**
+     * Prints the allocations per image, the heap and the resident size.
+     */
+    void print() const;
+};
+
+#endif //ANNOTATION_MEMSTATS_H
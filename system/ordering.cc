@@ -0,0 +1,153 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "ordering.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+#include "error.h"
+
+using namespace std;
+
+/**
+ * Returns the inode number of a file, or zero if it doesn't exist.
+ */
+static uint64_t inode_key(const string& path) {
+    struct stat buf{};
+    if (stat(path.c_str(), &buf) != 0)
+        return 0;
+    return (uint64_t)buf.st_ino;
+}
+
+/**
+ * Returns the physical byte offset of the first extent of a
+ * file, or falls back to the inode number where unsupported.
+ */
+static uint64_t extent_key(const string& path) {
+#ifdef __linux__
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd != -1) {
+        // Request only the first extent of the file.
+        alignas(struct fiemap) char buffer[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+        memset(buffer, 0, sizeof(buffer));
+        auto* map = (struct fiemap*)buffer;
+        map->fm_start = 0;
+        map->fm_length = FIEMAP_MAX_OFFSET;
+        map->fm_extent_count = 1;
+        int res = ioctl(fd, FS_IOC_FIEMAP, map);
+        close(fd);
+        if (res == 0 && map->fm_mapped_extents > 0)
+            return map->fm_extents[0].fe_physical;
+    }
+#endif
+    return inode_key(path);
+}
+
+/**
+ * Sorts the paths by a numeric key which is computed once per path.
+ */
+static void sort_by_key(vector<string>& paths, uint64_t (*key_function)(const string&)) {
+    // Compute each of the keys.
+    vector<pair<uint64_t, size_t>> keys(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        keys[i] = make_pair(key_function(paths[i]), i);
+    }
+
+    // Sort the keys, and then reorder the paths to match.
+    sort(keys.begin(), keys.end());
+    vector<string> sorted; sorted.reserve(paths.size());
+    for (const auto& key: keys) {
+        sorted.emplace_back(std::move(paths[key.second]));
+    }
+    paths = std::move(sorted);
+}
+
+void order_image_paths(std::vector<std::string>& paths, const std::string& policy) {
+    if (policy == "none") {
+        return;
+    } else if (policy == "name") {
+        sort(paths.begin(), paths.end(), natural_less);
+    } else if (policy == "inode") {
+        sort_by_key(paths, inode_key);
+    } else if (policy == "extent") {
+        sort_by_key(paths, extent_key);
+    } else {
+        string msg = "Invalid image order \'" + policy + "\' received.";
+        error_exit(msg.c_str());
+    }
+}
+
+bool natural_less(const std::string& a, const std::string& b) {
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (isdigit((unsigned char)a[i]) && isdigit((unsigned char)b[j])) {
+            // Skip any leading zeros in both of the numbers.
+            size_t start_a = i, start_b = j;
+            while (i < a.size() && a[i] == '0') ++i;
+            while (j < b.size() && b[j] == '0') ++j;
+
+            // Find the end of both of the numbers.
+            size_t digits_a = i, digits_b = j;
+            while (digits_a < a.size() && isdigit((unsigned char)a[digits_a])) ++digits_a;
+            while (digits_b < b.size() && isdigit((unsigned char)b[digits_b])) ++digits_b;
+
+            // A longer number is larger, otherwise compare the digits.
+            size_t length_a = digits_a - i, length_b = digits_b - j;
+            if (length_a != length_b)
+                return length_a < length_b;
+            int order = a.compare(i, length_a, b, j, length_b);
+            if (order != 0)
+                return order < 0;
+
+            // Equal numbers with fewer leading zeros come first.
+            if (i - start_a != j - start_b)
+                return (i - start_a) < (j - start_b);
+            i = digits_a; j = digits_b;
+        } else {
+            if (a[i] != b[j])
+                return a[i] < b[j];
+            ++i; ++j;
+        }
+    }
+    return (a.size() - i) < (b.size() - j);
+}
+
+void advise_willneed(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+#ifdef __APPLE__
+    // macOS has no `posix_fadvise`, but supports read advice.
+    struct radvisory advice{};
+    advice.ra_offset = 0;
+    advice.ra_count = INT32_MAX;
+    fcntl(fd, F_RDADVISE, &advice);
+#else
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+    close(fd);
+}
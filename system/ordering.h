@@ -0,0 +1,53 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_ORDERING_H
+#define ANNOTATION_ORDERING_H
+
+#include <string>
+#include <vector>
+
+/**
+ * Reorders a list of image paths using one of the
+ * following policies, which control the order that
+ * the images are read from storage in:
+ *
+ * - `none`: Keep the order returned by the directory scan.
+ * - `name`: Natural filename order (e.g., `img2` before `img10`).
+ * - `inode`: Inode order, which approximates the on-disk
+ *   layout on many filesystems without any extra I/O.
+ * - `extent`: The physical location of each file's first
+ *   extent, which is queried from the filesystem (Linux only,
+ *   and falls back to inode order where it is unsupported).
+ *
+ * @param paths: The image paths to reorder.
+ * @param policy: The name of the ordering policy.
+ */
+void order_image_paths(std::vector<std::string>& paths, const std::string& policy);
+
+/**
+ * Compares two strings in natural order, where any runs
+ * of digits are compared by their numeric value.
+ * @return Whether `a` should come before `b`.
+ */
+bool natural_less(const std::string& a, const std::string& b);
+
+/**
+ * Tells the kernel that a file will be read soon, so that it
+ * starts reading it into the page cache in the background.
+ * @param path: The path to the file.
+ */
+void advise_willneed(const std::string& path);
+
+#endif //ANNOTATION_ORDERING_H
@@ -16,6 +16,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
 
 #include <filesystem>
 #include <dirent.h>
@@ -87,10 +88,8 @@ std::vector<std::string> get_image_paths(const char* path, bool recurse)
             }
 
             // Check whether the path is of an image.
-            for (const auto& ext : vector<string> {".jpg", ".png", ".jpeg"}) {
-                if (equal(ext.rbegin(), ext.rend(), fp.rbegin())) {
-                    image_paths.emplace_back(fp);
-                }
+            if (is_image_path(fp)) {
+                image_paths.emplace_back(fp);
             }
         }
     }
@@ -98,3 +97,39 @@ std::vector<std::string> get_image_paths(const char* path, bool recurse)
     // Return the list of image paths.
     return image_paths;
 }
+
+bool is_image_path(const std::string& path)
+{
+    for (const auto& ext : {".jpg", ".png", ".jpeg"}) {
+        size_t length = strlen(ext);
+        if (path.size() >= length && path.compare(path.size() - length, length, ext) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t hash_path(const std::string& path)
+{
+    // Compute the FNV-1a hash of the characters in the path.
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c: path) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+int64_t file_mtime(const std::string& path)
+{
+    // Get the modification time from the file status.
+    struct stat buf{};
+    if (stat(path.c_str(), &buf) != 0)
+        return -1;
+#ifdef __APPLE__
+    const struct timespec& mtime = buf.st_mtimespec;
+#else
+    const struct timespec& mtime = buf.st_mtim;
+#endif
+    return (int64_t)mtime.tv_sec * 1000000000LL + mtime.tv_nsec;
+}
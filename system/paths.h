@@ -17,6 +17,7 @@
 
 #include <string>
 #include <cassert>
+#include <cstdint>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgproc.hpp>
@@ -39,4 +40,26 @@ bool path_exists(const char* path);
  */
 std::vector<std::string> get_image_paths(const char* path, bool recurse);
 
+/**
+ * Checks whether a path has one of the supported image extensions.
+ * @param path: The path to check.
+ */
+bool is_image_path(const std::string& path);
+
+/**
+ * Computes a stable 64-bit hash of a path, which
+ * is used as the key in the on-disk caches.
+ * @param path: The path to hash.
+ * @return The FNV-1a hash of the path.
+ */
+uint64_t hash_path(const std::string& path);
+
+/**
+ * Returns the modification time of a file.
+ * @param path: The path to the file.
+ * @return The modification time in nanoseconds,
+ * or -1 if the file could not be found.
+ */
+int64_t file_mtime(const std::string& path);
+
 #endif //ANNOTATION_PATHS_H
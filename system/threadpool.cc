@@ -0,0 +1,89 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "threadpool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned int num_threads) {
+    // Use the number of hardware threads by default.
+    if (num_threads == 0) {
+        num_threads = max(1u, thread::hardware_concurrency());
+    }
+
+    // Start each of the worker threads.
+    for (unsigned int i = 0; i < num_threads; ++i) {
+        this->workers.emplace_back(&ThreadPool::worker_loop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    // Tell the workers to exit once the queue is empty.
+    {
+        lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->task_available.notify_all();
+
+    // Wait for each of the workers to exit.
+    for (auto& worker: this->workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    // Add the task to the queue.
+    {
+        lock_guard<std::mutex> lock(this->mutex);
+        this->tasks.emplace_back(std::move(task));
+        this->outstanding += 1;
+    }
+
+    // Wake up one of the workers to run it.
+    this->task_available.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+    unique_lock<std::mutex> lock(this->mutex);
+    this->task_finished.wait(lock, [this]() { return this->outstanding == 0; });
+}
+
+size_t ThreadPool::pending() {
+    lock_guard<std::mutex> lock(this->mutex);
+    return this->outstanding;
+}
+
+void ThreadPool::worker_loop() {
+    while (true) {
+        // Wait for a task to become available.
+        function<void()> task;
+        {
+            unique_lock<std::mutex> lock(this->mutex);
+            this->task_available.wait(lock, [this]() {
+                return this->stopping || !this->tasks.empty(); });
+            if (this->tasks.empty())
+                return;
+            task = std::move(this->tasks.front());
+            this->tasks.pop_front();
+        }
+
+        // Run the task, then mark it as finished.
+        task();
+        {
+            lock_guard<std::mutex> lock(this->mutex);
+            this->outstanding -= 1;
+        }
+        this->task_finished.notify_all();
+    }
+}
@@ -0,0 +1,111 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_THREADPOOL_H
+#define ANNOTATION_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed-size pool of worker threads which run
+ * tasks in the order that they were submitted.
+ *
+ * This is used by the different background stages
+ * (e.g., thumbnail generation), so that the amount
+ * of concurrent work is bounded by the pool size.
+ */
+class ThreadPool {
+private:
+    /* The worker threads. */
+    std::vector<std::thread> workers;
+
+    /* The queue of tasks which have not been started. */
+    std::deque<std::function<void()>> tasks;
+
+    /* Synchronizes access to the task queue. */
+    std::mutex mutex;
+    std::condition_variable task_available;
+    std::condition_variable task_finished;
+
+    /* The number of tasks which are queued or running. */
+    size_t outstanding = 0;
+
+    /* Whether the pool is shutting down. */
+    bool stopping = false;
+
+public:
+    /**
+     * Starts the worker threads.
+     * @param num_threads: The number of threads, or zero
+     * to use the number of hardware threads.
+     */
+    explicit ThreadPool(unsigned int num_threads = 0);
+
+    /**
+     * Finishes any remaining tasks and joins the threads.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Submits a task to the pool.
+     * @param task: The task to run.
+     * @return A future holding the result of the task.
+     */
+    template <typename F>
+    auto submit(F task) -> std::future<decltype(task())> {
+        // Wrap the task so that its result can be retrieved.
+        auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+        auto result = packaged->get_future();
+        this->enqueue([packaged]() { (*packaged)(); });
+        return result;
+    }
+
+    /**
+     * Blocks until all of the submitted tasks have finished.
+     */
+    void wait_idle();
+
+    /**
+     * Returns the number of tasks which are queued or running.
+     */
+    size_t pending();
+
+    /**
+     * Returns the number of worker threads.
+     */
+    size_t size() const { return workers.size(); }
+
+private:
+    /**
+     * Adds a task to the queue and wakes up a worker.
+     */
+    void enqueue(std::function<void()> task);
+
+    /**
+     * The loop which is run by each of the worker threads.
+     */
+    void worker_loop();
+};
+
+#endif //ANNOTATION_THREADPOOL_H
@@ -0,0 +1,195 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "watcher.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "paths.h"
+#include "error.h"
+
+#define WATCH_EVENT_BUFFER_SIZE 65536
+
+using namespace std;
+
+DirectoryWatcher::DirectoryWatcher(const std::string& path, bool recurse_search)
+        : DirectoryWatcher(vector<string>{path}, recurse_search, is_image_path) {}
+
+DirectoryWatcher::DirectoryWatcher(const std::vector<std::string>& paths, bool recurse_search,
+                                   std::function<bool(const std::string&)> file_filter)
+        : recurse(recurse_search), filter(std::move(file_filter)) {
+#ifdef __linux__
+    // Create the inotify instance, and the pipe used to stop the thread.
+    this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (this->fd == -1 || pipe(this->stop_pipe) != 0) {
+        const char* msg = "Could not start watching the image directory";
+        error_exit(msg);
+    }
+
+    // Watch the directories, then start reading the events.
+    for (const auto& path: paths) {
+        this->watch_directory(path, false);
+    }
+    this->thread = std::thread(&DirectoryWatcher::run, this);
+#else
+    const char* msg = "Watching the image directory is only supported on Linux";
+    error_exit(msg);
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+    // Wake up and stop the thread, then close the descriptors.
+    if (this->thread.joinable()) {
+        char stop = 1;
+        (void)!write(this->stop_pipe[1], &stop, 1);
+        this->thread.join();
+    }
+    for (int descriptor: {this->fd, this->stop_pipe[0], this->stop_pipe[1]}) {
+        if (descriptor != -1)
+            close(descriptor);
+    }
+}
+
+bool DirectoryWatcher::take_changes(std::vector<std::string>& new_images,
+                                    std::vector<std::string>& removed_images) {
+    lock_guard<std::mutex> lock(this->mutex);
+    new_images.swap(this->added);
+    removed_images.swap(this->removed);
+    this->added.clear();
+    this->removed.clear();
+    bool lost = this->overflowed;
+    this->overflowed = false;
+    return lost;
+}
+
+void DirectoryWatcher::watch_directory(const std::string& path, bool report) {
+#ifdef __linux__
+    // Watch for images which are finished being written, moved in or out,
+    // or deleted, as well as for new directories (to watch them as well).
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE;
+    int wd = inotify_add_watch(this->fd, path.c_str(), mask | IN_ONLYDIR);
+    if (wd == -1)
+        return;
+    this->directories[wd] = path;
+
+    // Go through the directory for its sub-directories and, for a new
+    // directory, any images which were written before it was watched.
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr)
+        return;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != nullptr) {
+        string name = ent->d_name;
+        if (name == "." || name == "..")
+            continue;
+        string child = path + "/" + name;
+        struct stat buf{};
+        if (stat(child.c_str(), &buf) != 0)
+            continue;
+        if (S_ISDIR(buf.st_mode)) { // NOLINT
+            if (this->recurse)
+                this->watch_directory(child, report);
+        } else if (report && this->filter(child)) {
+            lock_guard<std::mutex> lock(this->mutex);
+            this->added.push_back(child);
+        }
+    }
+    closedir(dir);
+#endif
+}
+
+void DirectoryWatcher::run() {
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[WATCH_EVENT_BUFFER_SIZE];
+    struct pollfd descriptors[2] = {{this->fd, POLLIN, 0}, {this->stop_pipe[0], POLLIN, 0}};
+    while (true) {
+        // Wait for events, or for the watcher to be stopped.
+        if (poll(descriptors, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        if (descriptors[1].revents != 0)
+            return;
+
+        // Read all of the available events.
+        ssize_t length;
+        while ((length = read(this->fd, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + length;) {
+                auto* event = (struct inotify_event*)p;
+                p += sizeof(struct inotify_event) + event->len;
+
+                // The kernel's queue overflowed, so events were lost.
+                if (event->mask & IN_Q_OVERFLOW) {
+                    lock_guard<std::mutex> lock(this->mutex);
+                    this->overflowed = true;
+                    continue;
+                }
+
+                // The directory was deleted (or its watch was removed).
+                auto directory = this->directories.find(event->wd);
+                if (directory == this->directories.end())
+                    continue;
+                if (event->mask & IN_IGNORED) {
+                    this->directories.erase(directory);
+                    continue;
+                }
+                if (event->len == 0)
+                    continue;
+                string path = directory->second + "/" + event->name;
+
+                if (event->mask & IN_ISDIR) {
+                    // Watch new directories (including any images already in
+                    // them), and remove the images of directories which are gone.
+                    if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && this->recurse) {
+                        this->watch_directory(path, true);
+                    } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                        string prefix = path + "/";
+                        for (auto it = this->directories.begin(); it != this->directories.end();) {
+                            if (it->second == path || it->second.compare(0, prefix.size(), prefix) == 0) {
+                                inotify_rm_watch(this->fd, it->first);
+                                it = this->directories.erase(it);
+                            } else {
+                                ++it;
+                            }
+                        }
+                        lock_guard<std::mutex> lock(this->mutex);
+                        this->removed.push_back(prefix);
+                    }
+                    continue;
+                }
+
+                // Report the files which are complete, or which are gone.
+                if (!this->filter(path))
+                    continue;
+                lock_guard<std::mutex> lock(this->mutex);
+                if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                    this->added.push_back(path);
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    this->removed.push_back(path);
+                }
+            }
+        }
+    }
+#endif
+}
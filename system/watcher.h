@@ -0,0 +1,119 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_WATCHER_H
+#define ANNOTATION_WATCHER_H
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Watches an image directory (and optionally its sub-directories)
+ * for images being added, renamed, or deleted, using inotify, so
+ * that a session can keep up with a directory that is still being
+ * written to without ever rescanning it. Other kinds of files (e.g.,
+ * annotation files) can be watched for using a different filter.
+ *
+ * Images are only reported once they have been completely written
+ * (when the writer closes them) or moved into the directory, so
+ * partially written files are never loaded. The events are drained
+ * on a background thread, so the kernel's event queue doesn't
+ * overflow while the user is busy with a single image.
+ *
+ * This is only supported on Linux.
+ */
+class DirectoryWatcher {
+private:
+    /* Whether the sub-directories of the watched directories (including
+     * any which are created later) are also watched, and which files
+     * are reported (by default, the images). */
+    bool recurse;
+    std::function<bool(const std::string&)> filter;
+
+    /* The inotify descriptor, and a pipe used to stop the thread. */
+    int fd = -1;
+    int stop_pipe[2] = {-1, -1};
+
+    /* The watched directories, keyed by their watch descriptor
+     * (this is only accessed by the watching thread). */
+    std::unordered_map<int, std::string> directories;
+
+    /* The files which have been added or removed since the changes
+     * were last taken, where a path ending with `/` means everything
+     * in that directory was removed, and whether any events were
+     * lost (in which case the directory has to be rescanned). */
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    bool overflowed = false;
+    std::mutex mutex;
+
+    /* The thread which reads the events. */
+    std::thread thread;
+
+public:
+    /**
+     * Starts watching a directory.
+     * @param path: The directory to watch.
+     * @param recurse_search: Whether to watch its sub-directories.
+     */
+    DirectoryWatcher(const std::string& path, bool recurse_search);
+
+    /**
+     * Starts watching several directories for a certain kind of file.
+     * @param paths: The directories to watch (any which don't exist are skipped).
+     * @param recurse_search: Whether to watch their sub-directories.
+     * @param file_filter: Whether a file with a certain path is reported.
+     */
+    DirectoryWatcher(const std::vector<std::string>& paths, bool recurse_search,
+                     std::function<bool(const std::string&)> file_filter);
+
+    /**
+     * Stops watching the directory.
+     */
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    /**
+     * Takes the changes since this was last called.
+     * @param new_images: Receives the images (or files) which were added.
+     * @param removed_images: Receives the images which were removed
+     * (or directories ending with `/`, which had all of their images removed).
+     * @return Whether events were lost, so the directory must be rescanned.
+     */
+    bool take_changes(std::vector<std::string>& new_images,
+                      std::vector<std::string>& removed_images);
+
+private:
+    /**
+     * Watches a directory (and its sub-directories, if recursing).
+     * @param path: The directory to watch.
+     * @param report: Whether to report the images already in it (for
+     * directories created after the watch started, whose images may
+     * have been written before they were watched).
+     */
+    void watch_directory(const std::string& path, bool report);
+
+    /**
+     * Reads and handles the events until the watcher is stopped.
+     */
+    void run();
+};
+
+#endif //ANNOTATION_WATCHER_H
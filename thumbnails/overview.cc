@@ -0,0 +1,239 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "overview.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+
+#define OVERVIEW_WINDOW_NAME "Overview"
+#define CELL_PADDING 8
+#define STATUS_BAR_HEIGHT 30
+
+/* The generation states of each thumbnail. */
+#define THUMBNAIL_MISSING 0
+#define THUMBNAIL_PENDING 1
+#define THUMBNAIL_READY 2
+#define THUMBNAIL_FAILED 3
+
+using namespace std;
+using namespace cv;
+
+OverviewGrid::OverviewGrid(const std::vector<std::string>& paths, ThumbnailCache& thumbnail_cache,
+                           ThreadPool& workers, std::function<bool(int)> annotated,
+                           const cv::Size& size)
+                           : image_paths(paths), cache(thumbnail_cache), pool(workers),
+                             is_annotated(std::move(annotated)), thumbnail_states(paths.size()),
+                             annotated_states(paths.size(), -1), window_size(size) {
+    // Determine the layout of the grid from the window size.
+    this->cell_size = this->cache.size() + 2 * CELL_PADDING;
+    this->num_columns = max(1, this->window_size.width / this->cell_size);
+    this->num_rows = max(1, (this->window_size.height - STATUS_BAR_HEIGHT) / this->cell_size);
+}
+
+int OverviewGrid::show(int current) {
+    // Scroll so that the current image is visible.
+    this->current_index = current;
+    this->selected_index = -1;
+    this->first_row = max(0, current / this->num_columns - this->num_rows / 2);
+    this->scroll(0);
+
+    // The annotation states may have changed since the grid was last shown.
+    fill(this->annotated_states.begin(), this->annotated_states.end(), -1);
+
+    // Create the window and register the mouse callback.
+    namedWindow(OVERVIEW_WINDOW_NAME);
+    setMouseCallback(OVERVIEW_WINDOW_NAME, OverviewGrid::dispatch_handler, (void*)(this));
+    this->needs_redraw = true;
+
+    // Display the grid until an image is chosen or the grid is closed.
+    bool closed = false;
+    while (this->selected_index == -1 && !closed) {
+        // Generate any missing thumbnails.
+        this->schedule_thumbnails();
+
+        // Redraw the grid if it has changed.
+        if (this->needs_redraw || this->generated.exchange(false)) {
+            imshow(OVERVIEW_WINDOW_NAME, this->render());
+            this->needs_redraw = false;
+        }
+
+        // Handle the keyboard input.
+        switch (waitKey(15)) {
+            case (int) ('g'): // Close the grid.
+            case (int) ('q'):
+            case 27:
+                closed = true;
+                break;
+            case (int) ('['): // Scroll up by a page.
+                this->scroll(-this->num_rows);
+                break;
+            case (int) (']'): // Scroll down by a page.
+                this->scroll(this->num_rows);
+                break;
+            case (int) ('w'): // Scroll up by a row.
+                this->scroll(-1);
+                break;
+            case (int) ('s'): // Scroll down by a row.
+                this->scroll(1);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Close the window and save any new thumbnails.
+    destroyWindow(OVERVIEW_WINDOW_NAME);
+    this->cache.save();
+    return this->selected_index;
+}
+
+void OverviewGrid::schedule_thumbnails() {
+    // First, generate any of the visible thumbnails.
+    int first = this->first_row * this->num_columns;
+    int last = min((int)this->image_paths.size(), first + this->num_rows * this->num_columns);
+    for (int i = first; i < last; ++i) {
+        this->generate_thumbnail(i);
+    }
+
+    // Then, keep the pool busy with the rest of the dataset,
+    // checking a bounded number of images on each call so
+    // that the grid stays responsive on very large datasets.
+    size_t limit = 2 * this->pool.size();
+    for (int checked = 0; checked < 256 && this->pool.pending() < limit &&
+                          this->generation_cursor < this->image_paths.size(); ++checked) {
+        this->generate_thumbnail((int)this->generation_cursor++);
+    }
+}
+
+void OverviewGrid::generate_thumbnail(int index) {
+    // Skip thumbnails which have already been handled.
+    if (this->thumbnail_states[index] != THUMBNAIL_MISSING)
+        return;
+
+    // Check whether the thumbnail is already cached.
+    const string& path = this->image_paths[index];
+    if (this->cache.contains(path)) {
+        this->thumbnail_states[index] = THUMBNAIL_READY;
+        return;
+    }
+
+    // Otherwise, generate it on the worker pool.
+    this->thumbnail_states[index] = THUMBNAIL_PENDING;
+    this->pool.submit([this, index, path]() {
+        vector<uchar> encoded = ThumbnailCache::render(path, this->cache.size());
+        if (encoded.empty()) {
+            this->thumbnail_states[index] = THUMBNAIL_FAILED;
+        } else {
+            this->cache.put(path, std::move(encoded));
+            this->thumbnail_states[index] = THUMBNAIL_READY;
+        }
+        this->generated = true;
+    });
+}
+
+cv::Mat OverviewGrid::render() {
+    // Create the canvas.
+    Mat3b canvas(this->num_rows * this->cell_size + STATUS_BAR_HEIGHT,
+                 this->num_columns * this->cell_size, Vec3b(40, 40, 40));
+
+    // Drop the decoded thumbnails which are far from the visible rows.
+    int first = this->first_row * this->num_columns;
+    int visible = this->num_rows * this->num_columns;
+    for (auto it = this->decoded.begin(); it != this->decoded.end();) {
+        if (it->first < first - 2 * visible || it->first >= first + 3 * visible) {
+            it = this->decoded.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Draw each of the visible cells.
+    int last = min((int)this->image_paths.size(), first + visible);
+    int thumbnail_size = this->cache.size();
+    for (int i = first; i < last; ++i) {
+        int row = (i - first) / this->num_columns;
+        int column = (i - first) % this->num_columns;
+        Rect cell(column * this->cell_size, row * this->cell_size,
+                  this->cell_size, this->cell_size);
+
+        // Get the annotation state, which colors the border of the cell.
+        if (this->annotated_states[i] == -1) {
+            this->annotated_states[i] = (signed char)this->is_annotated(i);
+        }
+        Scalar border = this->annotated_states[i] ? Scalar(90, 200, 90) : Scalar(90, 90, 90);
+        if (i == this->current_index)
+            border = Scalar(60, 220, 240);
+        rectangle(canvas, Rect(cell.x + 2, cell.y + 2, cell.width - 4, cell.height - 4),
+                  border, 3);
+
+        // Draw the thumbnail, or a placeholder if it is not ready.
+        Rect inner(cell.x + CELL_PADDING, cell.y + CELL_PADDING, thumbnail_size, thumbnail_size);
+        if (this->thumbnail_states[i] == THUMBNAIL_READY) {
+            auto cached = this->decoded.find(i);
+            if (cached == this->decoded.end()) {
+                cached = this->decoded.emplace(i, this->cache.get(this->image_paths[i])).first;
+            }
+            const Mat& thumbnail = cached->second;
+            if (!thumbnail.empty()) {
+                Rect target(inner.x + (thumbnail_size - thumbnail.cols) / 2,
+                            inner.y + (thumbnail_size - thumbnail.rows) / 2,
+                            min(thumbnail.cols, thumbnail_size), min(thumbnail.rows, thumbnail_size));
+                thumbnail(Rect(0, 0, target.width, target.height)).copyTo(canvas(target));
+            }
+        } else {
+            const char* text = (this->thumbnail_states[i] == THUMBNAIL_FAILED) ? "error" : "...";
+            putText(canvas, text, Point(inner.x + thumbnail_size / 2 - 20, inner.y + thumbnail_size / 2),
+                    FONT_HERSHEY_SIMPLEX, 0.6, Scalar(200, 200, 200), 1);
+        }
+    }
+
+    // Draw the status bar, which shows the position in the dataset.
+    string status = "Images " + to_string(first + 1) + "-" + to_string(last) + " of " +
+                    to_string(this->image_paths.size()) +
+                    "   (click to open, [ ] to page, w/s to scroll, g to close)";
+    putText(canvas, status, Point(10, canvas.rows - 10),
+            FONT_HERSHEY_SIMPLEX, 0.5, Scalar(230, 230, 230), 1);
+    return canvas;
+}
+
+void OverviewGrid::scroll(int rows) {
+    // Clamp the first row so that the grid stays within the dataset.
+    int total_rows = ((int)this->image_paths.size() + this->num_columns - 1) / this->num_columns;
+    int new_row = max(0, min(this->first_row + rows, total_rows - this->num_rows));
+    if (new_row != this->first_row) {
+        this->first_row = new_row;
+        this->needs_redraw = true;
+    }
+}
+
+void OverviewGrid::dispatch_handler(int event, int x, int y, int flags, void* param) {
+    auto* grid = (OverviewGrid*)param;
+
+    // Scroll the grid with the mouse wheel.
+    if (event == EVENT_MOUSEWHEEL) {
+        grid->scroll(getMouseWheelDelta(flags) > 0 ? -1 : 1);
+        return;
+    }
+
+    // Choose the image which was clicked on.
+    if (event == EVENT_LBUTTONDOWN) {
+        int row = y / grid->cell_size, column = x / grid->cell_size;
+        if (row >= grid->num_rows || column >= grid->num_columns)
+            return;
+        int index = (grid->first_row + row) * grid->num_columns + column;
+        if (index < (int)grid->image_paths.size())
+            grid->selected_index = index;
+    }
+}
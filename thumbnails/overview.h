@@ -0,0 +1,133 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_OVERVIEW_H
+#define ANNOTATION_OVERVIEW_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "thumbnails.h"
+#include "../system/threadpool.h"
+
+/**
+ * Displays a scrollable grid of thumbnails for each of
+ * the images in the dataset, showing which images have
+ * already been annotated, and allowing the user to jump
+ * to an image by clicking on its thumbnail.
+ *
+ * Thumbnails which are not yet cached are generated on the
+ * worker pool, starting with the visible ones and then
+ * continuing through the rest of the dataset in the
+ * background while the grid is open.
+ */
+class OverviewGrid {
+private:
+    /* The paths to each of the images. */
+    const std::vector<std::string>& image_paths;
+
+    /* The cache which holds the thumbnails. */
+    ThumbnailCache& cache;
+
+    /* The pool which generates the thumbnails. */
+    ThreadPool& pool;
+
+    /* Determines whether an image has been annotated. */
+    std::function<bool(int)> is_annotated;
+
+    /* The generation state of each of the thumbnails. */
+    std::vector<std::atomic<char>> thumbnail_states;
+
+    /* The annotation state of each image (-1 is unknown). */
+    std::vector<signed char> annotated_states;
+
+    /* The decoded thumbnails near the visible rows. */
+    std::map<int, cv::Mat> decoded;
+
+    /* The next image to generate a thumbnail for in the background. */
+    size_t generation_cursor = 0;
+
+    /* Whether a thumbnail has been generated since the last draw. */
+    std::atomic<bool> generated{false};
+
+    /* The size of the grid window, and the resulting layout. */
+    cv::Size window_size;
+    int cell_size;
+    int num_columns = 1;
+    int num_rows = 1;
+
+    /* The first visible row, and the current image. */
+    int first_row = 0;
+    int current_index = 0;
+
+    /* The image which was clicked on, or -1 if none has been. */
+    int selected_index = -1;
+
+    /* Whether the visible rows need to be redrawn. */
+    bool needs_redraw = true;
+
+public:
+    /**
+     * Creates the overview grid for a list of images.
+     * @param paths: The paths to the images.
+     * @param thumbnail_cache: The cache holding the thumbnails.
+     * @param workers: The pool used to generate the thumbnails.
+     * @param annotated: Determines whether an image is annotated.
+     * @param size: The size of the grid window.
+     */
+    OverviewGrid(const std::vector<std::string>& paths, ThumbnailCache& thumbnail_cache,
+                 ThreadPool& workers, std::function<bool(int)> annotated,
+                 const cv::Size& size);
+
+    /**
+     * Displays the grid until an image is chosen or it is closed.
+     * @param current: The index of the current image.
+     * @return The index of the chosen image, or -1 if none was chosen.
+     */
+    int show(int current);
+
+private:
+    /**
+     * Submits thumbnail generation jobs to the worker pool,
+     * first for the visible cells and then in the background.
+     */
+    void schedule_thumbnails();
+
+    /**
+     * Submits the generation job for a single thumbnail.
+     */
+    void generate_thumbnail(int index);
+
+    /**
+     * Draws the visible rows of the grid.
+     */
+    cv::Mat render();
+
+    /**
+     * Scrolls the grid by a number of rows.
+     */
+    void scroll(int rows);
+
+    /**
+     * The mouse callback for the grid window.
+     */
+    static void dispatch_handler(int event, int x, int y, int flags, void* param);
+};
+
+#endif //ANNOTATION_OVERVIEW_H
@@ -0,0 +1,217 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "thumbnails.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "../system/paths.h"
+
+#define THUMBNAIL_MAGIC "ANNTHMB1"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Computes a checksum of the index, so that an index which
+ * was only partially written can be detected and discarded.
+ */
+static uint64_t checksum(const void* data, size_t size) {
+    const auto* bytes = (const unsigned char*)data;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+ThumbnailCache::ThumbnailCache(const std::string& path, int size)
+        : cache_path(path), thumbnail_size(size) {
+    // Read the existing cache, if there is one.
+    this->load();
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    // Save the thumbnails which were generated after the
+    // overview was last closed, so they are not lost.
+    this->save();
+    if (this->fd != -1)
+        close(this->fd);
+}
+
+void ThumbnailCache::load() {
+    // Open the cache file, if it exists.
+    this->fd = open(this->cache_path.c_str(), O_RDONLY);
+    if (this->fd == -1)
+        return;
+
+    // Read and validate the header. If the file was created with
+    // a different thumbnail size, it is simply regenerated.
+    FileHeader header{};
+    if (pread(this->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, THUMBNAIL_MAGIC, 8) != 0 ||
+        header.thumbnail_size != (uint32_t)this->thumbnail_size) {
+        return;
+    }
+
+    // Read the index, and discard it if it was not completely written.
+    vector<IndexEntry> entries(header.index_count);
+    size_t index_bytes = entries.size() * sizeof(IndexEntry);
+    if (pread(this->fd, entries.data(), index_bytes, (off_t)header.index_offset)
+            != (ssize_t)index_bytes ||
+        checksum(entries.data(), index_bytes) != header.index_checksum) {
+        cerr << "The thumbnail cache index is invalid, so it will be rebuilt." << endl;
+        return;
+    }
+
+    // Add the entries to the in-memory index.
+    this->index.reserve(entries.size());
+    for (const auto& entry: entries) {
+        this->index[entry.key] = entry;
+    }
+    this->data_end = header.index_offset;
+}
+
+bool ThumbnailCache::contains(const std::string& image_path) {
+    // Get the key and the current modification time of the image.
+    uint64_t key = hash_path(image_path);
+    int64_t mtime = file_mtime(image_path);
+
+    // Check both the saved and unsaved thumbnails.
+    lock_guard<std::mutex> lock(this->mutex);
+    auto saved = this->index.find(key);
+    if (saved != this->index.end() && saved->second.mtime == mtime)
+        return true;
+    auto pending = this->unsaved.find(key);
+    return pending != this->unsaved.end() && pending->second.first == mtime;
+}
+
+cv::Mat ThumbnailCache::get(const std::string& image_path) {
+    uint64_t key = hash_path(image_path);
+    vector<uchar> encoded;
+    {
+        // Check whether the thumbnail has not been saved yet.
+        lock_guard<std::mutex> lock(this->mutex);
+        auto pending = this->unsaved.find(key);
+        if (pending != this->unsaved.end()) {
+            return imdecode(pending->second.second, IMREAD_COLOR);
+        }
+
+        // Otherwise, find where the thumbnail is in the file.
+        auto saved = this->index.find(key);
+        if (saved == this->index.end() || this->fd == -1)
+            return Mat();
+        encoded.resize(saved->second.size);
+        if (pread(this->fd, encoded.data(), encoded.size(), (off_t)saved->second.offset)
+                != (ssize_t)encoded.size()) {
+            return Mat();
+        }
+    }
+
+    // Decode the thumbnail.
+    return imdecode(encoded, IMREAD_COLOR);
+}
+
+void ThumbnailCache::put(const std::string& image_path, std::vector<uchar> encoded) {
+    int64_t mtime = file_mtime(image_path);
+    lock_guard<std::mutex> lock(this->mutex);
+    this->unsaved[hash_path(image_path)] = make_pair(mtime, std::move(encoded));
+}
+
+void ThumbnailCache::save() {
+    lock_guard<std::mutex> lock(this->mutex);
+    if (this->unsaved.empty())
+        return;
+
+    // Open the cache file for writing.
+    int out = open(this->cache_path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (out == -1) {
+        cerr << "Could not write the thumbnail cache to \'" << this->cache_path << "\'." << endl;
+        return;
+    }
+
+    // Append the new thumbnails after the existing thumbnail data,
+    // which overwrites the old index (it is rewritten afterwards).
+    uint64_t offset = this->data_end;
+    for (auto& pending: this->unsaved) {
+        const vector<uchar>& encoded = pending.second.second;
+        if (pwrite(out, encoded.data(), encoded.size(), (off_t)offset) != (ssize_t)encoded.size())
+            break;
+        this->index[pending.first] = IndexEntry {
+            pending.first, pending.second.first, offset, encoded.size() };
+        offset += encoded.size();
+    }
+    this->data_end = offset;
+    this->unsaved.clear();
+
+    // Write the new index after the thumbnail data.
+    vector<IndexEntry> entries; entries.reserve(this->index.size());
+    for (const auto& entry: this->index) {
+        entries.push_back(entry.second);
+    }
+    size_t index_bytes = entries.size() * sizeof(IndexEntry);
+    bool written = pwrite(out, entries.data(), index_bytes, (off_t)offset) == (ssize_t)index_bytes;
+    written = written && ftruncate(out, (off_t)(offset + index_bytes)) == 0;
+
+    // Finally, write the header which points to the index. This is done
+    // last so that an interrupted save is detected by the checksum.
+    FileHeader header{};
+    memcpy(header.magic, THUMBNAIL_MAGIC, 8);
+    header.thumbnail_size = this->thumbnail_size;
+    header.index_offset = offset;
+    header.index_count = entries.size();
+    header.index_checksum = checksum(entries.data(), index_bytes);
+    if (written) {
+        fsync(out);
+        written = pwrite(out, &header, sizeof(header), 0) == sizeof(header);
+    }
+    close(out);
+    if (!written) {
+        cerr << "Could not write the thumbnail cache to \'" << this->cache_path << "\'." << endl;
+    }
+
+    // Reopen the file for reading, now that it contains the new thumbnails.
+    if (this->fd != -1)
+        close(this->fd);
+    this->fd = open(this->cache_path.c_str(), O_RDONLY);
+}
+
+std::vector<uchar> ThumbnailCache::render(const std::string& image_path, int size) {
+    // Decode the image at a reduced resolution, which is much faster
+    // for JPEG images, and fall back to a full decode if necessary.
+    Mat image = imread(image_path, IMREAD_REDUCED_COLOR_8);
+    if (image.empty() || max(image.cols, image.rows) < size)
+        image = imread(image_path, IMREAD_COLOR);
+    if (image.empty())
+        return vector<uchar>();
+
+    // Resize the image to fit within the thumbnail size.
+    double scale = min(1.0, size / (double)max(image.cols, image.rows));
+    Mat thumbnail;
+    resize(image, thumbnail, Size(max(1, (int)(image.cols * scale)),
+                                  max(1, (int)(image.rows * scale))), 0, 0, INTER_AREA);
+
+    // Encode the thumbnail.
+    vector<uchar> encoded;
+    imencode(".jpg", thumbnail, encoded, vector<int> {IMWRITE_JPEG_QUALITY, 85});
+    return encoded;
+}
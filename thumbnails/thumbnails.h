@@ -0,0 +1,142 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_THUMBNAILS_H
+#define ANNOTATION_THUMBNAILS_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/**
+ * A cache of image thumbnails, which is stored on disk
+ * as a single packed file so that it can be reopened
+ * instantly, even for datasets with many images.
+ *
+ * The file consists of a header, followed by each of the
+ * JPEG-encoded thumbnails, followed by an index containing
+ * the offset of each thumbnail. The header stores where the
+ * index starts, so only the index is read when the file is
+ * opened and the thumbnails themselves are read on demand.
+ *
+ * Newly generated thumbnails are held in memory until the
+ * cache is saved (at the latest, when it is destroyed), at
+ * which point they are appended to the file and the index
+ * is rewritten after them.
+ */
+class ThumbnailCache {
+private:
+    /* An entry in the index of the cache file. */
+    struct IndexEntry {
+        uint64_t key;
+        int64_t mtime;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    /* The header at the start of the cache file. */
+    struct FileHeader {
+        char magic[8];
+        uint32_t thumbnail_size;
+        uint32_t reserved;
+        uint64_t index_offset;
+        uint64_t index_count;
+        uint64_t index_checksum;
+    };
+
+    /* The path to the cache file. */
+    std::string cache_path;
+
+    /* The maximum width and height of each thumbnail. */
+    int thumbnail_size;
+
+    /* The thumbnails stored in the cache file, keyed by path hash. */
+    std::unordered_map<uint64_t, IndexEntry> index;
+
+    /* The thumbnails which have not yet been saved to the file. */
+    std::unordered_map<uint64_t, std::pair<int64_t, std::vector<uchar>>> unsaved;
+
+    /* The end of the thumbnail data in the cache file. */
+    uint64_t data_end = sizeof(FileHeader);
+
+    /* The file descriptor used to read thumbnails. */
+    int fd = -1;
+
+    /* Synchronizes access from the generation workers. */
+    std::mutex mutex;
+
+public:
+    /**
+     * Opens the thumbnail cache, reading its index if it exists.
+     * @param path: The path to the cache file.
+     * @param size: The maximum width and height of each thumbnail.
+     */
+    ThumbnailCache(const std::string& path, int size);
+
+    /**
+     * Saves any new thumbnails and closes the cache file.
+     */
+    ~ThumbnailCache();
+
+    /**
+     * Returns the maximum width and height of each thumbnail.
+     */
+    int size() const { return thumbnail_size; }
+
+    /**
+     * Checks whether an up-to-date thumbnail exists for an image.
+     * @param image_path: The path to the image.
+     */
+    bool contains(const std::string& image_path);
+
+    /**
+     * Returns the decoded thumbnail for an image.
+     * @param image_path: The path to the image.
+     * @return The thumbnail, or an empty image if it is not cached.
+     */
+    cv::Mat get(const std::string& image_path);
+
+    /**
+     * Adds an encoded thumbnail to the cache.
+     * @param image_path: The path to the image.
+     * @param encoded: The JPEG-encoded thumbnail.
+     */
+    void put(const std::string& image_path, std::vector<uchar> encoded);
+
+    /**
+     * Appends any new thumbnails to the cache file.
+     */
+    void save();
+
+    /**
+     * Generates the encoded thumbnail for an image. This does
+     * not access the cache, so it can be run on any thread.
+     * @param image_path: The path to the image.
+     * @param size: The maximum width and height of the thumbnail.
+     * @return The JPEG-encoded thumbnail, or an empty vector.
+     */
+    static std::vector<uchar> render(const std::string& image_path, int size);
+
+private:
+    /**
+     * Reads the header and index of an existing cache file.
+     */
+    void load();
+};
+
+#endif //ANNOTATION_THUMBNAILS_H
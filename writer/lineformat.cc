@@ -0,0 +1,51 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "lineformat.h"
+
+using namespace std;
+
+char* format_box_line(char* out, const char* label, size_t label_length,
+                      const int* points, const std::vector<int>& mode) {
+    memcpy(out, label, label_length);
+    out += label_length;
+    *out++ = ' ';
+    for (int value: mode) {
+        out = append_coordinate(out, points[value]);
+    }
+    *out++ = '\n';
+    return out;
+}
+
+LineFormatter::LineFormatter(const std::vector<int>& mode_choice)
+        : mode(mode_choice) {}
+
+std::string_view LineFormatter::format_boxes(
+        const std::vector<std::tuple<const char*, std::vector<int>>>& boxes) {
+    // Make sure that the buffer can hold the longest possible lines.
+    size_t capacity = 0;
+    for (const auto& box: boxes) {
+        capacity += strlen(std::get<0>(box)) + 2 + this->mode.size() * MAX_COORDINATE_CHARS;
+    }
+    if (this->buffer.size() < capacity)
+        this->buffer.resize(capacity);
+
+    // Write each of the lines directly into the buffer.
+    char* out = this->buffer.data();
+    for (const auto& box: boxes) {
+        const char* label = std::get<0>(box);
+        out = format_box_line(out, label, strlen(label), std::get<1>(box).data(), this->mode);
+    }
+    return {this->buffer.data(), (size_t)(out - this->buffer.data())};
+}
@@ -0,0 +1,81 @@
+/* Copyright 2021 Amogh Joshi. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#ifndef ANNOTATION_LINEFORMAT_H
+#define ANNOTATION_LINEFORMAT_H
+
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+/* The most characters written for a single coordinate: an int
+ * (at most 11 characters) followed by `.000000 `. */
+#define MAX_COORDINATE_CHARS 19
+
+/**
+ * Writes one coordinate in the same format that `std::to_string` gives
+ * for it as a double (e.g., `12.000000`), followed by a space.
+ * @param out: Where to write the coordinate.
+ * @param value: The coordinate.
+ * @return The position after the written characters.
+ */
+inline char* append_coordinate(char* out, int value) {
+    out = std::to_chars(out, out + 11, value).ptr;
+    std::memcpy(out, ".000000 ", 8);
+    return out + 8;
+}
+
+/**
+ * Writes the line for one box, with a label followed by the coordinates.
+ * @param out: Where to write the line.
+ * @param label: The label of the box.
+ * @param label_length: The length of the label.
+ * @param points: The coordinates of the box.
+ * @param mode: The order of the coordinates.
+ * @return The position after the written line.
+ */
+char* format_box_line(char* out, const char* label, size_t label_length,
+                      const int* points, const std::vector<int>& mode);
+
+/**
+ * Formats the lines of annotation files into a buffer which is reused
+ * for each file, so formatting a file doesn't allocate any memory once
+ * the buffer is large enough.
+ */
+class LineFormatter {
+private:
+    /* The order of the coordinates. */
+    std::vector<int> mode;
+
+    /* The buffer which the lines are written into. */
+    std::vector<char> buffer;
+
+public:
+    /**
+     * Creates a formatter for a column order.
+     * @param mode_choice: The order of the coordinates.
+     */
+    explicit LineFormatter(const std::vector<int>& mode_choice);
+
+    /**
+     * Formats the lines for a set of boxes.
+     * @param boxes: The labels and bounding boxes.
+     * @return The formatted lines, which are valid until this is next called.
+     */
+    std::string_view format_boxes(const std::vector<std::tuple<const char*, std::vector<int>>>& boxes);
+};
+
+#endif //ANNOTATION_LINEFORMAT_H
@@ -20,13 +20,15 @@
 #include <algorithm>
 #include <numeric>
 #include <regex>
+#include <sstream>
+#include <cmath>
 
 using namespace std;
 namespace fs = std::__fs::filesystem;
 
 TextFileWriter::TextFileWriter(const std::vector<int>& mode_choice,
                                const char *output_directory)
-                               : FileWriter(mode_choice) {
+                               : FileWriter(mode_choice), formatter(mode_choice) {
     // Check whether the output directory is valid.
     if (!path_exists(output_directory)) {
         const char* msg = "The output directory provided does not exist.";
@@ -44,7 +46,7 @@ TextFileWriter::TextFileWriter(const std::vector<int>& mode_choice,
 }
 
 TextFileWriter::TextFileWriter(const char *output_directory)
-              : FileWriter(vector<int> {0, 1, 2, 3})  {
+              : FileWriter(vector<int> {0, 1, 2, 3}), formatter(vector<int> {0, 1, 2, 3})  {
     // Check whether the output directory is valid.
     if (!path_exists(output_directory)) {
         const char* msg = "The output directory provided does not exist.";
@@ -61,7 +63,8 @@ TextFileWriter::TextFileWriter(const char *output_directory)
     this->ext_mode = ".txt";
 }
 
-TextFileWriter::TextFileWriter(const std::vector<int>& mode_choice) : FileWriter(mode_choice)  {
+TextFileWriter::TextFileWriter(const std::vector<int>& mode_choice)
+        : FileWriter(mode_choice), formatter(mode_choice)  {
     // Set the directory path to a nullptr, which will
     // then be overwritten for each of the different
     // files which are created in the future.
@@ -71,7 +74,8 @@ TextFileWriter::TextFileWriter(const std::vector<int>& mode_choice) : FileWriter
     this->ext_mode = ".txt";
 }
 
-TextFileWriter::TextFileWriter() : FileWriter(vector<int> {0, 1, 2, 3}) {
+TextFileWriter::TextFileWriter()
+        : FileWriter(vector<int> {0, 1, 2, 3}), formatter(vector<int> {0, 1, 2, 3}) {
     // Set the directory path to a nullptr, which will
     // then be overwritten for each of the different
     // files which are created in the future.
@@ -81,53 +85,55 @@ TextFileWriter::TextFileWriter() : FileWriter(vector<int> {0, 1, 2, 3}) {
     this->ext_mode = ".txt";
 }
 
-std::string TextFileWriter::format_line(std::tuple<const char*, std::vector<int>>& content) {
-    // Unpack the tuple into the points and label.
-    const char* label = std::get<0>(content);
-    vector<int> points = std::get<1>(content);
-
-    // Create a string and add the label to it.
-    string complete_line = string(label) + " ";
-
-    // Add each of the points in the correct order
-    // (as determined by `mode`) into the line.
-    for (int value: this->mode) {
-        // Convert the point to a double to meet criteria.
-        complete_line += to_string((double)points[value]) + " ";
-    }
-
-    // Add a newline to the file.
-    complete_line += "\n";
-
-    // Return the complete line.
-    return complete_line;
-}
-
 void TextFileWriter::build_annotation_file(const char* image_file_name,
                                            const vector<tuple<const char*, vector<int>>>& content) {
     // Get the corresponding output filename from the image.
     const string output_file_path = this->get_output_path(image_file_name);
 
-    // Create a vector to hold the file lines.
-    vector<string> file_lines;
-
-    // Iterate over the bounding boxes in the vector, extract
-    // the content, and add the converted lines into the vector.
-    file_lines.reserve(content.size());
-    for (auto content_piece: content) {
-        file_lines.emplace_back(this->format_line(content_piece));
+    // Merge any duplicate boxes (e.g., a drawn box and a proposal
+    // for the same object) before they are written. The boxes are
+    // only copied when there is something to merge them with.
+    const vector<tuple<const char*, vector<int>>>* boxes = &content;
+    vector<tuple<const char*, vector<int>>> merged;
+    if (this->merge_policy != "none" && content.size() > 1) {
+        merged = content;
+        merge_boxes(merged, this->merge_policy, this->merge_threshold);
+        boxes = &merged;
     }
 
-    // Open the file and write the lines into it.
+    // Format all of the lines (with the label followed by the
+    // coordinates in the order determined by `mode`) into the
+    // formatter's buffer, then write them to the file at once.
+    string_view lines = this->formatter.format_boxes(*boxes);
     ofstream out_file;
     out_file.open(output_file_path);
-    for (const auto& line: file_lines) {
-        out_file << line;
-        out_file.flush();
-    }
+    out_file.write(lines.data(), (streamsize)lines.size());
     out_file.close();
 }
 
-
-
-
+bool TextFileWriter::read_annotation_file(const char* image_file_name,
+                                          vector<tuple<string, vector<int>>>& content) {
+    // Open the corresponding annotation file, if it exists.
+    ifstream in_file(this->get_output_path(image_file_name));
+    if (!in_file.is_open())
+        return false;
+
+    // Parse each of the lines, which contain a label followed
+    // by the coordinates in the order determined by `mode`.
+    string line;
+    while (getline(in_file, line)) {
+        istringstream is(line);
+        string label;
+        if (!(is >> label))
+            continue;
+        vector<int> points(4, 0);
+        double value;
+        for (int position: this->mode) {
+            if (!(is >> value))
+                break;
+            points[position] = (int)lround(value);
+        }
+        content.emplace_back(label, points);
+    }
+    return true;
+}
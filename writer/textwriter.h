@@ -19,6 +19,7 @@
 #include <filesystem>
 
 #include "writer.h"
+#include "lineformat.h"
 #include "../system/paths.h"
 #include "../system/error.h"
 
@@ -29,6 +30,10 @@
  * values based on the chosen mode.
  */
 class TextFileWriter : public FileWriter {
+private:
+    /* Formats the lines of each file into a reused buffer. */
+    LineFormatter formatter;
+
 public:
     /**
      * Initializes the FileWriter class
@@ -76,16 +81,17 @@ public:
                                const std::vector<std::tuple<const char*,
                                        std::vector<int>>>& content);
 
-private:
     /**
-     * Formats each line of the file into the
-     * correct format, to be used in the actual
-     * file writing method.
-     * @param content: The line of content.
+     * Reads an existing annotation file back into a set of
+     * bounding boxes, undoing the column order of the mode.
+     * @param image_file_name: The filename of the image
+     * that the annotations were made for.
+     * @param content: The labels and bounding boxes.
+     * @return Whether the annotation file exists.
      */
-    std::string format_line(std::tuple<const char*,
-                            std::vector<int>>& content);
-
+    bool read_annotation_file(const char* image_file_name,
+                              std::vector<std::tuple<std::string,
+                                      std::vector<int>>>& content);
 };
 
 #endif //ANNOTATION_WRITER_H
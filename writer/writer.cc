@@ -19,6 +19,18 @@ std::string FileWriter::get_output_path(const char *image_file) {
         error_exit(msg.c_str());
     }
 
+    // Create the output directory as necessary (otherwise, it has
+    // already been built in the instantiation method).
+    string output_path = this->annotation_path(image_file);
+    if (this->output_dir == nullptr) {
+        FileWriter::build_output_directory(fs::path(output_path).parent_path().c_str());
+    }
+
+    // Return the complete output path.
+    return output_path;
+}
+
+std::string FileWriter::annotation_path(const char* image_file) const {
     // Get the ID of the image file (e.g., the basename of
     // the file, and without the extension).
     const fs::path basename = fs::path(image_file).stem();
@@ -26,27 +38,32 @@ std::string FileWriter::get_output_path(const char *image_file) {
     // Create a new text file with the image ID.
     const fs::path text_base = fs::path(string(basename) + this->ext_mode);
 
-    // Create a holder for the output directory.
-    static fs::path output_directory;
+    // Get the output directory, which by default is the image
+    // directory with `images` replaced by `annotations`.
+    static const regex images_pattern("images");
+    fs::path output_directory = (this->output_dir == nullptr)
+            ? fs::path(regex_replace(fs::path(image_file).parent_path().string(),
+                                     images_pattern, "annotations"))
+            : fs::path(this->output_dir);
 
-    // Create the output directory as necessary.
-    if (this->output_dir == nullptr) {
-        // Replace the `images` directory with `annotations`.
-        string str_path = fs::path(image_file).parent_path().string();
-        output_directory = regex_replace(
-                str_path, regex("images"), "annotations");
-        FileWriter::build_output_directory(output_directory.c_str());
-    } else{
-        // Otherwise, it has already been built in the instantiation
-        // method, so simply just create the path.
-        output_directory = fs::path(this->output_dir);
-    }
+    // Return the complete output path.
+    return fs::absolute(output_directory / text_base).string();
+}
 
-    // Create the complete output path.
-    fs::path full_output_path (output_directory / text_base);
+bool FileWriter::annotation_exists(const char* image_file) {
+    // Check whether the corresponding output file exists (without
+    // creating its directory, or requiring the image to still exist).
+    return fs::exists(this->annotation_path(image_file));
+}
 
-    // Return the complete output path.
-    return fs::absolute(full_output_path).c_str();
+void FileWriter::set_merge_policy(const std::string& policy, float threshold) {
+    // Check whether the merge policy is valid.
+    if (!is_merge_policy(policy)) {
+        string msg = "Invalid merge policy \'" + policy + "\' received.";
+        error_exit(msg.c_str());
+    }
+    this->merge_policy = policy;
+    this->merge_threshold = threshold;
 }
 
 void FileWriter::build_output_directory(const char* path) {
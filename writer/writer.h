@@ -7,6 +7,7 @@
 #include <filesystem>
 
 #include "../system/error.h"
+#include "../merge/merge.h"
 
 #ifndef ANNOTATOR_WRITER_H
 #define ANNOTATOR_WRITER_H
@@ -36,6 +37,12 @@ protected:
      * specific writer type. */
     const char* ext_mode;
 
+    /* How duplicate boxes with the same label are merged before
+     * they are written, and the overlap above which two boxes are
+     * considered to be duplicates (see `merge_boxes`). */
+    std::string merge_policy = "none";
+    float merge_threshold = 0.7f;
+
     /**
      * Gets the name of the output filepath from
      * the corresponding input image file.
@@ -67,6 +74,34 @@ protected:
      */
     FileWriter(const std::vector<int>& mode_choice);
 
+public:
+    /**
+     * Checks whether an annotation file has already
+     * been written for a certain image.
+     * @param image_file: The input image file.
+     */
+    bool annotation_exists(const char* image_file);
+
+    /**
+     * Gets the path of the annotation file for an image, without
+     * checking the image or creating any directories (so that
+     * it can be used when auditing an existing dataset).
+     * @param image_file: The input image file.
+     */
+    std::string annotation_path(const char* image_file) const;
+
+    /**
+     * Returns the column order of the coordinates in the files.
+     */
+    const std::vector<int>& get_mode() const { return mode; }
+
+    /**
+     * Sets how duplicate boxes are merged before they are written.
+     * @param policy: The name of the merge policy.
+     * @param threshold: The overlap above which boxes are duplicates.
+     */
+    void set_merge_policy(const std::string& policy, float threshold);
+
 };
 
 #endif //ANNOTATOR_WRITER_H